@@ -0,0 +1,334 @@
+#include <QtTest>
+#include <QDeadlineTimer>
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "model/dircache.hpp"
+#include "model/dirsnapshot.hpp"
+#include "model/filesystem.hpp"
+#include "model/iconregistry.hpp"
+#include "model/thumbnail.hpp"
+#include "utils/interner.hpp"
+#include "utils/memorybudget.hpp"
+#include "utils/scheduler.hpp"
+#include "vfs/vfs.hpp"
+#include "settings.hpp"
+
+/**
+ * @brief Number of entries of the directory index() and parent() walk.
+ */
+static const int BENCH_MODEL_ROWS = 50000;
+
+/**
+ * @brief Number of entries of the directory refreshed.
+ */
+static const int BENCH_MODEL_REFRESH_ROWS = 20000;
+
+/**
+ * @brief Number of tabs restored at startup.
+ */
+static const int BENCH_MODEL_TABS = 40;
+
+/**
+ * @brief Number of entries of the directory of each tab.
+ */
+static const int BENCH_MODEL_TAB_ROWS = 2000;
+
+/**
+ * @brief Max time a listing may take, in milliseconds.
+ */
+static const int BENCH_MODEL_TIMEOUT_MS = 60000;
+
+/**
+ * @brief Longer than DirCache hands out a listing it has just read even to forced requests.
+ */
+static const int BENCH_MODEL_STALE_MS = 2500;
+
+/**
+ * @brief Create \p count empty files in \p path.
+ * @param[in] path - Directory, created if it does not exist.
+ * @param[in] count - Number of files.
+ * @return true on success.
+ */
+static bool _bench_make_files(const QString& path, int count)
+{
+    if (!QDir().mkpath(path))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        QFile file(path + QString::asprintf("/file_%06d", i));
+        if (!file.open(QIODevice::WriteOnly))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Run the event loop until \p done returns true.
+ * @param[in] done - Condition, checked after every batch of events.
+ * @return false if it timed out.
+ */
+static bool _bench_wait(const std::function<bool()>& done)
+{
+    QDeadlineTimer deadline(BENCH_MODEL_TIMEOUT_MS);
+    while (!done())
+    {
+        if (deadline.hasExpired())
+        {
+            return false;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents | QEventLoop::WaitForMoreEvents, 10);
+    }
+    return true;
+}
+
+typedef std::vector<std::unique_ptr<qfcmd::FileSystemModel>> BenchModelTabs;
+
+/**
+ * @brief Get the directory of tab \p i.
+ * @param[in] root - Directory the tab directories are in.
+ * @param[in] i - Tab.
+ */
+static QString _bench_tab_path(const QString& root, int i)
+{
+    return root + QString::asprintf("/tab_%02d", i);
+}
+
+/**
+ * @brief Show the directory of every restored tab, each in a model of its own
+ *   as tabs have, and wait until all of them have their rows.
+ * @param[in] root - Directory the tab directories are in.
+ * @param[out] models - The models, which keep their listings cached.
+ * @return true if every tab has its rows.
+ */
+static bool _bench_open_tabs(const QString& root, BenchModelTabs& models)
+{
+    QVector<QModelIndex> roots;
+    for (int i = 0; i < BENCH_MODEL_TABS; i++)
+    {
+        models.emplace_back(new qfcmd::FileSystemModel);
+        roots.append(models.back()->setRootPath(_bench_tab_path(root, i)));
+    }
+
+    return _bench_wait([&]() {
+        for (int i = 0; i < BENCH_MODEL_TABS; i++)
+        {
+            if (models[i]->rowCount(roots[i]) != BENCH_MODEL_TAB_ROWS)
+            {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+/**
+ * @brief Get the path of the snapshot file, where DirCache keeps it.
+ */
+static QString _bench_snapshot_path()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/listings.bin";
+}
+
+/**
+ * @brief Start DirCache over, as a new run of the program does.
+ * @param[in] snapshot - Keep listings saved by the "last run".
+ */
+static void _bench_restart_dir_cache(bool snapshot)
+{
+    qfcmd::DirCache::exit();
+    if (!snapshot)
+    {
+        QFile::remove(_bench_snapshot_path());
+    }
+    qfcmd::DirCache::init();
+}
+
+/**
+ * @brief Benchmarks of FileSystemModel.
+ *
+ * Directories are made in a temporary directory, and settings and the
+ * listing snapshot go to the test locations of QStandardPaths.
+ */
+class BenchModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    /**
+     * @brief index() and parent() of every row of a large directory, as a
+     *   view scrolling through it asks for them.
+     */
+    void indexParent();
+
+    /**
+     * @brief Refresh of a directory that lost some of its entries.
+     *
+     * Removed entries are spread over the directory, so every one of them is
+     * a row range of its own. Reading the directory again is part of the
+     * cost, the row with one change is about that alone.
+     */
+    void refresh_data();
+    void refresh();
+
+    /**
+     * @brief Startup with restored tabs, until every tab shows its rows.
+     *
+     * Without a snapshot every directory is read, with one the listings
+     * saved by the last run are shown and then checked in the background.
+     */
+    void startup_data();
+    void startup();
+
+private:
+    QTemporaryDir   m_dir;  /**< Directories listed. */
+};
+
+void BenchModel::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QCoreApplication::setOrganizationName("com.github.qgymib.qfcmd");
+    QCoreApplication::setApplicationName("qfcmd-bench");
+
+    qfcmd::Settings::init();
+    qfcmd::StringInterner::init();
+    qfcmd::IconRegistry::init();
+    qfcmd::TaskScheduler::init();
+    qfcmd::DirCache::init();
+    qfcmd::ThumbnailLoader::init();
+    qfcmd::MemoryBudget::init();
+    qfcmd::VFS::init();
+
+    QVERIFY(m_dir.isValid());
+    QVERIFY(_bench_make_files(m_dir.filePath("rows"), BENCH_MODEL_ROWS));
+    for (int i = 0; i < BENCH_MODEL_TABS; i++)
+    {
+        QVERIFY(_bench_make_files(m_dir.filePath(QString::asprintf("tabs/tab_%02d", i)), BENCH_MODEL_TAB_ROWS));
+    }
+}
+
+void BenchModel::cleanupTestCase()
+{
+    qfcmd::MemoryBudget::exit();
+    qfcmd::ThumbnailLoader::exit();
+    qfcmd::DirCache::exit();
+    qfcmd::TaskScheduler::exit();
+    qfcmd::VFS::exit();
+    qfcmd::IconRegistry::exit();
+    qfcmd::StringInterner::exit();
+    qfcmd::Settings::exit();
+}
+
+void BenchModel::indexParent()
+{
+    qfcmd::FileSystemModel model;
+    const QModelIndex root = model.setRootPath(m_dir.filePath("rows"));
+    QVERIFY(_bench_wait([&]() { return model.rowCount(root) == BENCH_MODEL_ROWS; }));
+
+    QBENCHMARK
+    {
+        for (int row = 0; row < BENCH_MODEL_ROWS; row++)
+        {
+            const QModelIndex index = model.index(row, 0, root);
+            if (model.parent(index) != root)
+            {
+                QFAIL("parent() does not return the directory of the row");
+            }
+        }
+    }
+}
+
+void BenchModel::refresh_data()
+{
+    QTest::addColumn<int>("changed");
+
+    for (int changed : { 1, 10, 100, 1000, 10000 })
+    {
+        QTest::newRow(qPrintable(QString::number(changed))) << changed;
+    }
+}
+
+void BenchModel::refresh()
+{
+    QFETCH(int, changed);
+
+    /* Put back what the previous row removed. */
+    const QString path = m_dir.filePath("refresh");
+    QVERIFY(_bench_make_files(path, BENCH_MODEL_REFRESH_ROWS));
+
+    qfcmd::FileSystemModel model;
+    const QModelIndex root = model.setRootPath(path);
+    QVERIFY(_bench_wait([&]() { return model.rowCount(root) == BENCH_MODEL_REFRESH_ROWS; }));
+
+    const int stride = BENCH_MODEL_REFRESH_ROWS / changed;
+    for (int i = 0; i < changed; i++)
+    {
+        QVERIFY(QFile::remove(path + QString::asprintf("/file_%06d", i * stride)));
+    }
+
+    /* Otherwise the refresh gets the cached listing back. */
+    QTest::qWait(BENCH_MODEL_STALE_MS);
+
+    QBENCHMARK_ONCE
+    {
+        model.setRootPath(path);
+        QVERIFY(_bench_wait([&]() { return model.rowCount(root) == BENCH_MODEL_REFRESH_ROWS - changed; }));
+    }
+}
+
+void BenchModel::startup_data()
+{
+    QTest::addColumn<bool>("snapshot");
+
+    QTest::newRow("cold") << false;
+    QTest::newRow("snapshot") << true;
+}
+
+void BenchModel::startup()
+{
+    QFETCH(bool, snapshot);
+    const QString path = m_dir.filePath("tabs");
+
+    /* The last run, which saves what its tabs show as it quits. */
+    if (snapshot)
+    {
+        _bench_restart_dir_cache(false);
+        BenchModelTabs last;
+        QVERIFY(_bench_open_tabs(path, last));
+        qfcmd::DirCache::save();
+        last.clear();
+
+        qfcmd::DirSnapshot saved;
+        QCOMPARE(saved.open(_bench_snapshot_path()), 0);
+        for (int i = 0; i < BENCH_MODEL_TABS; i++)
+        {
+            qint64 mtime = 0;
+            qint64 listedAt = 0;
+            QVERIFY(saved.find(QUrl::fromLocalFile(_bench_tab_path(path, i)), &mtime, &listedAt));
+        }
+    }
+    _bench_restart_dir_cache(snapshot);
+
+    BenchModelTabs tabs;
+    QBENCHMARK_ONCE
+    {
+        QVERIFY(_bench_open_tabs(path, tabs));
+    }
+}
+
+QTEST_MAIN(BenchModel)
+#include "benchmodel.moc"
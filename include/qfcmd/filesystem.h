@@ -34,15 +34,49 @@ typedef struct qfcmd_fs_stat
  * @param[in] name - name of the file. Encoding in UTF-8.
  * @param[in] stat - stat of the file.
  * @param[in] data - user data.
- * @return 0 on success, or non-zero to stop listing.
+ * @return 0 on success, or non-zero to stop listing. The host also returns
+ *   non-zero once the listing is no longer wanted, so a provider that honors
+ *   the return value can be cancelled even without #qfcmd_fs_cancel_t.
  */
 typedef int (*qfcmd_fs_ls_cb)(const char* name, const qfcmd_fs_stat_t* stat, void* data);
 
+/**
+ * @brief Cancellation handle for long running operations.
+ *
+ * The handle is owned by the host and is only valid during the call it is
+ * passed to. Providers should poll it between blocking steps and return
+ * -ECANCELED as soon as it reports cancelled.
+ */
+typedef struct qfcmd_fs_cancel
+{
+    /**
+     * @brief Check whether the result is still wanted.
+     * @param[in] thiz - This object.
+     * @return 0 if the operation should continue, or -ECANCELED / -ETIMEDOUT
+     *   if it should stop.
+     */
+    int (*is_cancelled)(struct qfcmd_fs_cancel* thiz);
+
+    /**
+     * @brief Get the time left before the deadline.
+     *
+     * Useful for providers that need to pass a timeout to a blocking call, for
+     * example a socket read.
+     *
+     * @param[in] thiz - This object.
+     * @return Remaining time in milliseconds, or -1 if there is no deadline.
+     */
+    int64_t (*remaining)(struct qfcmd_fs_cancel* thiz);
+} qfcmd_fs_cancel_t;
+
 /**
  * @brief Filesystem operations.
  *
  * The filesystem must provide a mount function to mount a file system, see
  * #qfcmd_fs_mount_fn.
+ *
+ * Optional operations that are not implemented must be set to NULL, so always
+ * zero-initialize this structure.
  */
 typedef struct qfcmd_filesystem
 {
@@ -112,6 +146,39 @@ typedef struct qfcmd_filesystem
      * @return Number of bytes written on success, or -errno on error.
      */
     int (*write)(struct qfcmd_filesystem* thiz, uintptr_t fh, const void* buf, size_t size);
+
+    /**
+     * @brief (Optional, since 1.1) List items in directory with cancellation.
+     *
+     * If provided, it is used instead of #qfcmd_filesystem_t::ls. Only read
+     * if the plugin declared `API_VERSION` 1.1 or later in setup(), so
+     * plugins built against 1.0 may allocate this structure without it.
+     *
+     * @param[in] thiz - This object.
+     * @param[in] url - URL of directory. Encoding in UTF-8.
+     * @param[in] cb - Callback function.
+     * @param[in] data - user data which must be passed to the callback.
+     * @param[in] cancel - Cancellation handle. Never NULL.
+     * @return 0 on success, or -errno on error.
+     */
+    int (*ls_ex)(struct qfcmd_filesystem* thiz, const char* url, qfcmd_fs_ls_cb cb, void* data,
+        qfcmd_fs_cancel_t* cancel);
+
+    /**
+     * @brief (Optional, since 1.1) Read data from file with cancellation.
+     *
+     * If provided, it is used instead of #qfcmd_filesystem_t::read. Only
+     * read if the plugin declared `API_VERSION` 1.1 or later in setup().
+     *
+     * @param[in] thiz - This object.
+     * @param[in] fh - File handle.
+     * @param[out] buf - Buffer to store data.
+     * @param[in] size - Buffer size.
+     * @param[in] cancel - Cancellation handle. Never NULL.
+     * @return Number of bytes read on success, or -errno on error.
+     */
+    int (*read_ex)(struct qfcmd_filesystem* thiz, uintptr_t fh, void* buf, size_t size,
+        qfcmd_fs_cancel_t* cancel);
 } qfcmd_filesystem_t;
 
 /**
@@ -6,7 +6,7 @@ extern "C" {
 
 #include "filesystem.h"
 
-#define QFCMD_API_VERSION   "1.0"
+#define QFCMD_API_VERSION   "1.1"
 
 typedef struct qfcmd_host_api
 {
@@ -10,8 +10,14 @@
 #endif
 
 #include "qfcmd/qfcmd.h"
+#include "model/dircache.hpp"
+#include "model/iconregistry.hpp"
+#include "model/thumbnail.hpp"
 #include "vfs/vfs.hpp"
 #include "widget/mainwindow.hpp"
+#include "utils/interner.hpp"
+#include "utils/memorybudget.hpp"
+#include "utils/scheduler.hpp"
 #include "utils/log.hpp"
 #include "settings.hpp"
 
@@ -79,6 +85,12 @@ static void _setup_app(QApplication& a)
     }
     qfcmd::Log::init(logfile);
     qfcmd::Settings::init();
+    qfcmd::StringInterner::init();
+    qfcmd::IconRegistry::init();
+    qfcmd::TaskScheduler::init();
+    qfcmd::DirCache::init();
+    qfcmd::ThumbnailLoader::init();
+    qfcmd::MemoryBudget::init();
     qfcmd::VFS::init();
 }
 
@@ -87,7 +99,13 @@ static void _setup_app(QApplication& a)
  */
 static void _at_exit()
 {
+    qfcmd::MemoryBudget::exit();
+    qfcmd::ThumbnailLoader::exit();
+    qfcmd::DirCache::exit();
+    qfcmd::TaskScheduler::exit();
     qfcmd::VFS::exit();
+    qfcmd::IconRegistry::exit();
+    qfcmd::StringInterner::exit();
     qfcmd::Settings::exit();
     qfcmd::Log::exit();
 }
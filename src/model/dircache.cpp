@@ -0,0 +1,639 @@
+#include <algorithm>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QStandardPaths>
+
+#include "vfs/vfs.hpp"
+#include "dircache.hpp"
+#include "dirsnapshot.hpp"
+#include "iconregistry.hpp"
+
+/**
+ * @brief Publish a partial listing once this many entries are pending.
+ */
+static const int DIR_CACHE_BATCH_SIZE = 2048;
+
+/**
+ * @brief Publish a partial listing once this long has passed since the last one.
+ */
+static const qint64 DIR_CACHE_BATCH_INTERVAL_MS = 16;
+
+/**
+ * @brief A completed listing is handed out even to forced requests for this long.
+ */
+static const qint64 DIR_CACHE_FRESH_MS = 2000;
+
+/**
+ * @brief Max number of complete listings kept that no DirCacheRef references.
+ *
+ * Subscribers only reference a listing once its result reached them, and a
+ * directory opened again shortly after it was left needs no I/O.
+ */
+static const int DIR_CACHE_MAX_IDLE = 64;
+
+/**
+ * @brief Max number of listings kept in the snapshot file.
+ */
+static const int DIR_CACHE_SNAPSHOT_MAX_DIRS = 256;
+
+/**
+ * @brief Directories with more entries are not worth the space in the snapshot file.
+ */
+static const int DIR_CACHE_SNAPSHOT_MAX_ENTRIES = 65536;
+
+namespace qfcmd {
+
+struct DirCacheSubscription
+{
+    const void*         subscriber; /**< Subscriber. */
+    DirCache::ListenFn  fn;         /**< Receiver of results. */
+};
+
+struct DirCacheEntry
+{
+    DirCacheEntry();
+
+    DirStore                    store;      /**< Latest listing, the part read so far if not #complete. */
+    bool                        complete;   /**< #store is a whole listing. */
+    QDeadlineTimer              fresh;      /**< When #store stops being fresh. */
+    qint64                      dirMtime;   /**< Last modified time of directory when #store was read, or -1. */
+    qint64                      listedAt;   /**< When reading #store started, in seconds. */
+    int                         refs;       /**< Number of DirCacheRef. */
+    quint64                     lastUsed;   /**< Value of DirCacheInner::lastUse when last asked for. */
+    quint64                     fetchId;    /**< Id of the listing in flight, or 0. */
+    CancelToken                 token;      /**< Token of the listing in flight. */
+    QList<DirCacheSubscription> subscribers;    /**< Waiting for the listing in flight. */
+};
+
+struct DirCacheInner
+{
+    DirCacheInner();
+    ~DirCacheInner();
+
+    QMutex                      mutex;      /**< Protects everything. */
+    QHash<QUrl, DirCacheEntry>  entries;    /**< Listings by URL without trailing slash. */
+    quint64                     lastFetchId;    /**< Id of the last listing started. */
+    quint64                     lastUse;        /**< Bumped every time a listing is asked for. */
+
+    QReadWriteLock              snapshotLock;   /**< Writers replace #snapshot. */
+    DirSnapshot                 snapshot;       /**< Listings saved by the last run. */
+    QString                     snapshotPath;   /**< Path of the snapshot file. */
+};
+
+} /* namespace qfcmd */
+
+static qfcmd::DirCacheInner* s_dir_cache = nullptr;
+
+qfcmd::DirCacheResult::DirCacheResult()
+{
+    ret = 0;
+    partial = false;
+    cached = false;
+}
+
+qfcmd::DirCacheEntry::DirCacheEntry()
+{
+    complete = false;
+    dirMtime = -1;
+    listedAt = 0;
+    refs = 0;
+    lastUsed = 0;
+    fetchId = 0;
+}
+
+qfcmd::DirCacheInner::DirCacheInner()
+{
+    lastFetchId = 0;
+    lastUse = 0;
+}
+
+qfcmd::DirCacheInner::~DirCacheInner()
+{
+}
+
+static QUrl _dir_cache_key(const QUrl& url)
+{
+    return url.adjusted(QUrl::StripTrailingSlash);
+}
+
+static QUrl _dir_cache_append_path(const QUrl& url, const QString& name)
+{
+    QString url_path = url.path();
+    if (url_path.endsWith('/'))
+    {
+        url_path.chop(1);
+    }
+
+    QUrl new_url = url;
+    new_url.setPath(url_path + "/" + name);
+    return new_url;
+}
+
+/**
+ * @brief Check whether nothing but the idle limit keeps \p entry.
+ */
+static bool _dir_cache_entry_is_idle(const qfcmd::DirCacheEntry& entry)
+{
+    return entry.refs == 0 && entry.fetchId == 0;
+}
+
+/**
+ * @brief Drop \p it if nothing keeps it.
+ *
+ * A complete listing stays as one of the #DIR_CACHE_MAX_IDLE most recently
+ * used idle listings, and the least recently used one beyond that goes.
+ */
+static void _dir_cache_release_entry(QHash<QUrl, qfcmd::DirCacheEntry>::iterator it)
+{
+    const qfcmd::DirCacheEntry& entry = it.value();
+    if (!_dir_cache_entry_is_idle(entry))
+    {
+        return;
+    }
+    if (!entry.complete)
+    {
+        s_dir_cache->entries.erase(it);
+        return;
+    }
+
+    int idle = 0;
+    auto oldest = s_dir_cache->entries.end();
+    for (auto i = s_dir_cache->entries.begin(); i != s_dir_cache->entries.end(); i++)
+    {
+        if (!_dir_cache_entry_is_idle(i.value()))
+        {
+            continue;
+        }
+        idle++;
+        if (oldest == s_dir_cache->entries.end() || i.value().lastUsed < oldest.value().lastUsed)
+        {
+            oldest = i;
+        }
+    }
+    if (idle > DIR_CACHE_MAX_IDLE)
+    {
+        s_dir_cache->entries.erase(oldest);
+    }
+}
+
+/**
+ * @brief Hand \p result of listing \p id to its subscribers.
+ * @param[in] dirMtime - For a final result, last modified time of the
+ *   directory when it was read, or -1 if unknown.
+ * @param[in] listedAt - For a final result, when reading started.
+ * @return false if the listing is no longer wanted.
+ */
+static bool _dir_cache_publish(const QUrl& key, quint64 id, const qfcmd::DirCacheResult& result,
+                               qint64 dirMtime = -1, qint64 listedAt = 0)
+{
+    QMutexLocker locker(&s_dir_cache->mutex);
+
+    auto it = s_dir_cache->entries.find(key);
+    if (it == s_dir_cache->entries.end() || it.value().fetchId != id)
+    {
+        return false;
+    }
+
+    qfcmd::DirCacheEntry& entry = it.value();
+    if (result.ret >= 0)
+    {
+        entry.store = result.store;
+    }
+    for (const qfcmd::DirCacheSubscription& subscription : entry.subscribers)
+    {
+        subscription.fn(result);
+    }
+    if (result.partial)
+    {
+        return true;
+    }
+
+    /* Subscribers take a DirCacheRef once the result reaches them, it stays idle until then. */
+    entry.complete = result.ret >= 0;
+    if (!entry.complete)
+    {
+        entry.store = qfcmd::DirStore();
+    }
+    entry.dirMtime = entry.complete ? dirMtime : -1;
+    entry.listedAt = listedAt;
+    entry.fresh = QDeadlineTimer(DIR_CACHE_FRESH_MS);
+    entry.fetchId = 0;
+    entry.token = qfcmd::CancelToken();
+    entry.subscribers.clear();
+    _dir_cache_release_entry(it);
+
+    return true;
+}
+
+/**
+ * @brief Forget listing \p id, which was cancelled.
+ */
+static void _dir_cache_abandon(const QUrl& key, quint64 id)
+{
+    QMutexLocker locker(&s_dir_cache->mutex);
+
+    auto it = s_dir_cache->entries.find(key);
+    if (it == s_dir_cache->entries.end() || it.value().fetchId != id)
+    {
+        return;
+    }
+
+    qfcmd::DirCacheEntry& entry = it.value();
+    if (!entry.complete)
+    {
+        entry.store = qfcmd::DirStore();
+    }
+    entry.fetchId = 0;
+    entry.token = qfcmd::CancelToken();
+    entry.subscribers.clear();
+    _dir_cache_release_entry(it);
+}
+
+/**
+ * @brief Start listing \p id of \p url from the snapshot saved by the last run.
+ *
+ * If the directory has not changed since it was saved, the saved listing is
+ * the final result. Otherwise it is published as a partial result, and
+ * becomes the base of a refresh.
+ *
+ * @param[in] dirMtime - Last modified time of directory now, or -1.
+ * @param[out] base - The saved listing, if the directory changed.
+ * @return true if the listing is done.
+ */
+static bool _dir_cache_list_snapshot(const QUrl& url, quint64 id, qint64 dirMtime, qfcmd::DirStore* base)
+{
+    qint64 savedMtime = 0;
+    qint64 savedListedAt = 0;
+    qfcmd::DirStore store;
+    {
+        QReadLocker locker(&s_dir_cache->snapshotLock);
+        if (!s_dir_cache->snapshot.find(url, &savedMtime, &savedListedAt))
+        {
+            return false;
+        }
+        store = s_dir_cache->snapshot.load(url);
+    }
+    if (store.isEmpty())
+    {
+        return false;
+    }
+
+    qfcmd::DirCacheResult result;
+    result.url = url;
+    result.cached = true;
+    result.store = store;
+    result.delta = qfcmd::DirStoreDelta::append(qfcmd::DirStore(), store);
+
+    /* A change within the second the listing was read leaves the mtime as saved. */
+    if (dirMtime >= 0 && dirMtime == savedMtime && savedMtime < savedListedAt)
+    {
+        _dir_cache_publish(url, id, result, savedMtime, savedListedAt);
+        return true;
+    }
+
+    result.partial = true;
+    if (!_dir_cache_publish(url, id, result))
+    {
+        return true;
+    }
+    *base = store;
+    return false;
+}
+
+/**
+ * @brief List directory \p url and diff it against \p base.
+ *
+ * If \p base is empty, the snapshot saved by the last run is tried first.
+ * Failing that, only names and types are listed, and entries are published
+ * in partial results every few thousand entries or milliseconds while the
+ * listing goes on. Their metadata is filled in later by whoever shows them.
+ * A refresh needs full stat to tell which entries changed, and is published
+ * in one go to avoid rows vanishing and coming back.
+ */
+static void _dir_cache_list(const QUrl& url, quint64 id, const qfcmd::CancelToken& token,
+                            const qfcmd::DirStore& listBase)
+{
+    if (token.isCancelled())
+    {
+        _dir_cache_abandon(url, id);
+        return;
+    }
+
+    qfcmd::VFS fs;
+    qfcmd::DirStoreBuilder builder;
+
+    /* Taken before reading, so a change while reading makes the mtime newer. */
+    const qint64 listedAt = QDateTime::currentSecsSinceEpoch();
+    qfcmd_fs_stat_t dirStat;
+    const qint64 dirMtime = fs.stat(url, &dirStat) == 0 && (dirStat.st_mode & QFCMD_FS_S_IFDIR)
+        ? (qint64)dirStat.st_mtime : -1;
+
+    qfcmd::DirStore base = listBase;
+    if (base.isEmpty() && _dir_cache_list_snapshot(url, id, dirMtime, &base))
+    {
+        return;
+    }
+
+    const bool stream = base.isEmpty();
+    qfcmd::DirStore published = base;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int ret = fs.ls(url, [&](const QString& name, const qfcmd_fs_stat_t* stat) {
+        if (stream)
+        {
+            builder.append(name, *stat, qfcmd::IconRegistry::typeIcon(*stat), false);
+        }
+        else
+        {
+            builder.append(name, *stat, qfcmd::IconRegistry::lookup(_dir_cache_append_path(url, name), *stat));
+        }
+
+        if (stream && (builder.size() - published.size() >= DIR_CACHE_BATCH_SIZE
+                       || timer.elapsed() >= DIR_CACHE_BATCH_INTERVAL_MS))
+        {
+            qfcmd::DirCacheResult batch;
+            batch.url = url;
+            batch.partial = true;
+            batch.store = builder.snapshot();
+            batch.delta = qfcmd::DirStoreDelta::append(published, batch.store);
+
+            published = batch.store;
+            if (!_dir_cache_publish(url, id, batch))
+            {
+                return 1;
+            }
+            timer.restart();
+        }
+
+        return token.isCancelled() ? 1 : 0;
+    }, token, stream ? qfcmd::FileSystem::LS_TYPE_ONLY : 0);
+
+    /* Nobody is waiting for this result. */
+    if (token.isCancelled())
+    {
+        _dir_cache_abandon(url, id);
+        return;
+    }
+
+    /* The final result also drops entries of base that were not seen. */
+    qfcmd::DirCacheResult result;
+    result.url = url;
+    result.ret = ret;
+    if (ret >= 0)
+    {
+        result.store = builder.finish();
+        result.delta = stream ? qfcmd::DirStoreDelta::append(published, result.store)
+                              : qfcmd::DirStoreDelta::compute(base, result.store);
+    }
+    _dir_cache_publish(url, id, result, dirMtime, listedAt);
+}
+
+/**
+ * @brief Hand cached listing \p store to \p subscriber without I/O.
+ *
+ * The delta is computed in a task owned by \p subscriber, it is O(n).
+ *
+ * @param[in] partial - A fresh listing follows.
+ */
+static void _dir_cache_hand_out(const QUrl& key, const void* subscriber, const qfcmd::DirStore& base,
+                                const qfcmd::DirStore& store, bool partial,
+                                qfcmd::TaskScheduler::Priority priority, const qfcmd::DirCache::ListenFn& fn)
+{
+    qfcmd::TaskScheduler::post(subscriber, qfcmd::TaskScheduler::POOL_CPU, priority,
+                               [key, base, store, partial, fn]() {
+        qfcmd::DirCacheResult result;
+        result.url = key;
+        result.partial = partial;
+        result.cached = true;
+        result.store = store;
+        result.delta = qfcmd::DirStoreDelta::compute(base, store);
+        fn(result);
+    });
+}
+
+void qfcmd::DirCache::init()
+{
+    if (s_dir_cache != nullptr)
+    {
+        return;
+    }
+
+    s_dir_cache = new DirCacheInner;
+
+    s_dir_cache->snapshotPath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/listings.bin";
+    s_dir_cache->snapshot.open(s_dir_cache->snapshotPath);
+
+    /* Tabs still hold their listings then. */
+    if (QCoreApplication::instance() != nullptr)
+    {
+        QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, &DirCache::save);
+    }
+}
+
+void qfcmd::DirCache::exit()
+{
+    if (s_dir_cache == nullptr)
+    {
+        return;
+    }
+
+    {
+        QMutexLocker locker(&s_dir_cache->mutex);
+        for (DirCacheEntry& entry : s_dir_cache->entries)
+        {
+            entry.token.cancel();
+        }
+    }
+    TaskScheduler::cancel(s_dir_cache);
+
+    delete s_dir_cache;
+    s_dir_cache = nullptr;
+}
+
+void qfcmd::DirCache::save()
+{
+    if (s_dir_cache == nullptr)
+    {
+        return;
+    }
+
+    QList<DirSnapshot::Record> records;
+    {
+        QMutexLocker locker(&s_dir_cache->mutex);
+
+        /* Most wanted first: listings tabs still show, then most recently used. */
+        QList<QHash<QUrl, DirCacheEntry>::const_iterator> wanted;
+        for (auto it = s_dir_cache->entries.cbegin(); it != s_dir_cache->entries.cend(); it++)
+        {
+            const DirCacheEntry& entry = it.value();
+            if (entry.complete && entry.dirMtime >= 0 && entry.store.size() <= DIR_CACHE_SNAPSHOT_MAX_ENTRIES)
+            {
+                wanted.append(it);
+            }
+        }
+        std::sort(wanted.begin(), wanted.end(), [](const auto& a, const auto& b) {
+            const bool aRef = a.value().refs > 0;
+            const bool bRef = b.value().refs > 0;
+            return aRef != bRef ? aRef : a.value().lastUsed > b.value().lastUsed;
+        });
+
+        for (const auto& it : wanted)
+        {
+            const DirCacheEntry& entry = it.value();
+            records.append({ it.key(), entry.dirMtime, entry.listedAt, entry.store });
+        }
+    }
+
+    QWriteLocker locker(&s_dir_cache->snapshotLock);
+    QDir().mkpath(QFileInfo(s_dir_cache->snapshotPath).absolutePath());
+    const int ret = s_dir_cache->snapshot.save(s_dir_cache->snapshotPath, records, DIR_CACHE_SNAPSHOT_MAX_DIRS);
+    if (ret < 0)
+    {
+        qWarning() << "Failed to save listings to" << s_dir_cache->snapshotPath << ":" << ret;
+    }
+}
+
+void qfcmd::DirCache::fetch(const QUrl& url, const void* subscriber, const DirStore& base, bool force,
+                            TaskScheduler::Priority priority, const ListenFn& fn)
+{
+    const QUrl key = _dir_cache_key(url);
+
+    QMutexLocker locker(&s_dir_cache->mutex);
+    DirCacheEntry& entry = s_dir_cache->entries[key];
+    entry.lastUsed = ++s_dir_cache->lastUse;
+
+    /* Whatever comes next, hand out the cached listing right away. */
+    const bool fresh = entry.complete && (!force || !entry.fresh.hasExpired());
+    if (entry.complete && (fresh || base.version() != entry.store.version()))
+    {
+        _dir_cache_hand_out(key, subscriber, base, entry.store, !fresh, priority, fn);
+    }
+    if (fresh)
+    {
+        return;
+    }
+
+    /* Join the listing in flight, starting with what a first listing has read so far. */
+    if (entry.fetchId != 0 && !entry.token.isCancelled())
+    {
+        if (!entry.complete && !entry.store.isEmpty())
+        {
+            DirCacheResult result;
+            result.url = key;
+            result.partial = true;
+            result.store = entry.store;
+            result.delta = DirStoreDelta::append(DirStore(), entry.store);
+            fn(result);
+        }
+        entry.subscribers.append({ subscriber, fn });
+        return;
+    }
+
+    /* A previous listing that was cancelled never completes, it is replaced. */
+    if (!entry.complete)
+    {
+        entry.store = DirStore();
+    }
+    entry.fetchId = ++s_dir_cache->lastFetchId;
+    entry.token = CancelToken::create();
+    entry.subscribers.append({ subscriber, fn });
+
+    const quint64 id = entry.fetchId;
+    const CancelToken token = entry.token;
+    const DirStore listBase = entry.complete ? entry.store : DirStore();
+    TaskScheduler::post(s_dir_cache, TaskScheduler::POOL_IO, priority, [key, id, token, listBase]() {
+        _dir_cache_list(key, id, token, listBase);
+    }, strand(key));
+}
+
+void qfcmd::DirCache::unsubscribe(const void* subscriber)
+{
+    QMutexLocker locker(&s_dir_cache->mutex);
+
+    for (auto it = s_dir_cache->entries.begin(); it != s_dir_cache->entries.end(); it++)
+    {
+        DirCacheEntry& entry = it.value();
+        const qsizetype removed = entry.subscribers.removeIf([subscriber](const DirCacheSubscription& subscription) {
+            return subscription.subscriber == subscriber;
+        });
+
+        /* The last one waiting is gone, stop reading. */
+        if (removed != 0 && entry.subscribers.isEmpty())
+        {
+            entry.token.cancel();
+        }
+    }
+}
+
+QString qfcmd::DirCache::strand(const QUrl& url)
+{
+    return _dir_cache_key(url).toString();
+}
+
+bool qfcmd::DirCache::ref(const QUrl& url)
+{
+    if (s_dir_cache == nullptr)
+    {
+        return false;
+    }
+
+    QMutexLocker locker(&s_dir_cache->mutex);
+
+    /* Dropped already, an empty entry would only pin nothing. */
+    auto it = s_dir_cache->entries.find(_dir_cache_key(url));
+    if (it == s_dir_cache->entries.end())
+    {
+        return false;
+    }
+    it.value().refs++;
+    it.value().lastUsed = ++s_dir_cache->lastUse;
+    return true;
+}
+
+void qfcmd::DirCache::unref(const QUrl& url)
+{
+    if (s_dir_cache == nullptr)
+    {
+        return;
+    }
+
+    QMutexLocker locker(&s_dir_cache->mutex);
+
+    auto it = s_dir_cache->entries.find(_dir_cache_key(url));
+    if (it == s_dir_cache->entries.end())
+    {
+        return;
+    }
+    it.value().refs--;
+    _dir_cache_release_entry(it);
+}
+
+qfcmd::DirCacheRef::DirCacheRef()
+{
+}
+
+qfcmd::DirCacheRef::~DirCacheRef()
+{
+    reset();
+}
+
+void qfcmd::DirCacheRef::reset(const QUrl& url)
+{
+    const bool referenced = !url.isEmpty() && DirCache::ref(url);
+    if (!m_url.isEmpty())
+    {
+        DirCache::unref(m_url);
+    }
+    m_url = referenced ? url : QUrl();
+}
@@ -0,0 +1,155 @@
+#ifndef QFCMD_MODEL_DIRCACHE_HPP
+#define QFCMD_MODEL_DIRCACHE_HPP
+
+#include <functional>
+#include <QString>
+#include <QUrl>
+
+#include "utils/scheduler.hpp"
+#include "dirstore.hpp"
+
+namespace qfcmd {
+
+/**
+ * @brief A listing handed out by DirCache.
+ */
+struct DirCacheResult
+{
+    DirCacheResult();
+
+    QUrl            url;        /**< URL of directory. */
+    int             ret;        /**< 0 on success, or -errno. */
+    bool            partial;    /**< More results for this listing follow. */
+    bool            cached;     /**< A whole listing handed out from the cache, or from the snapshot on disk. */
+    DirStore        store;      /**< The listing, or the part of it read so far. */
+    DirStoreDelta   delta;      /**< Difference from the listing the subscriber most likely has. */
+};
+
+/**
+ * @brief Process wide cache of directory listings.
+ *
+ * Listings are keyed by URL, with and without trailing slash being the same.
+ * A directory is listed by one task no matter how many subscribers ask for
+ * it at the same time, and every subscriber gets the same DirStore, so tabs
+ * showing the same directory share one copy of it.
+ *
+ * A listing stays cached while it is referenced by a DirCacheRef, or while
+ * it is being listed. A few complete listings nobody references are kept as
+ * well, least recently used dropped first. Listings cached at exit are saved
+ * to disk, and a directory not cached yet starts from the saved listing, see
+ * save().
+ *
+ * All functions are thread safe.
+ */
+class DirCache
+{
+public:
+    /**
+     * @brief Called with each partial and the final result of a listing.
+     *
+     * It may be called from any thread, possibly with the cache locked, so
+     * it must be quick and must not call into DirCache.
+     */
+    typedef std::function<void(const DirCacheResult&)> ListenFn;
+
+public:
+    /**
+     * @brief Initialize the cache.
+     */
+    static void init();
+
+    /**
+     * @brief Exit the cache. Listings in progress are cancelled.
+     */
+    static void exit();
+
+    /**
+     * @brief Save complete listings to disk, so the next run shows them
+     *   before reading their directories.
+     *
+     * Called when the application is about to quit.
+     */
+    static void save();
+
+    /**
+     * @brief Ask for a listing of \p url.
+     *
+     * If the directory is being listed, \p subscriber joins that listing and
+     * first gets the part read so far. If a listing is cached and either
+     * \p force is not set or it was read just now, \p subscriber gets it
+     * without I/O. Otherwise a new listing is started.
+     *
+     * Only a first listing is streamed in partial results. A cached
+     * directory is listed again in one go, and the delta of the result is
+     * against the cached listing.
+     *
+     * @param[in] url - URL of directory.
+     * @param[in] subscriber - Subscriber, see unsubscribe().
+     * @param[in] base - The listing \p subscriber has, the delta of a cached
+     *   listing is against it.
+     * @param[in] force - Read the directory again if the cached listing is not fresh.
+     * @param[in] priority - Scheduling priority.
+     * @param[in] fn - Receiver of results.
+     */
+    static void fetch(const QUrl& url, const void* subscriber, const DirStore& base, bool force,
+                      TaskScheduler::Priority priority, const ListenFn& fn);
+
+    /**
+     * @brief Stop delivering results to \p subscriber.
+     *
+     * Listings nobody else waits for are cancelled. Once this returns, no
+     * listing task calls \p subscriber's callbacks any more. Cached listings
+     * handed out without I/O are delivered by tasks owned by \p subscriber,
+     * use TaskScheduler::cancel() to stop those.
+     *
+     * @param[in] subscriber - Subscriber.
+     */
+    static void unsubscribe(const void* subscriber);
+
+    /**
+     * @brief Get the strand listings of \p url run in.
+     *
+     * Tasks that write a listing of the directory must run in it too.
+     *
+     * @param[in] url - URL of directory.
+     * @return Strand name.
+     */
+    static QString strand(const QUrl& url);
+
+private:
+    friend class DirCacheRef;
+    static bool ref(const QUrl& url);
+    static void unref(const QUrl& url);
+};
+
+/**
+ * @brief Keep the cached listing of a directory alive.
+ */
+class DirCacheRef
+{
+    Q_DISABLE_COPY_MOVE(DirCacheRef)
+
+public:
+    /**
+     * @brief Create an empty reference.
+     */
+    DirCacheRef();
+    ~DirCacheRef();
+
+public:
+    /**
+     * @brief Reference the listing of \p url, and drop the old one.
+     *
+     * A listing no longer cached is not referenced, the reference is then empty.
+     *
+     * @param[in] url - URL of directory, or empty URL to only drop.
+     */
+    void reset(const QUrl& url = QUrl());
+
+private:
+    QUrl    m_url;  /**< Referenced directory. */
+};
+
+} /* namespace qfcmd */
+
+#endif
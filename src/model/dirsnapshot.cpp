@@ -0,0 +1,373 @@
+#include <cerrno>
+#include <cstring>
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+#include <QSet>
+#include <QVector>
+
+#include "dirsnapshot.hpp"
+#include "iconregistry.hpp"
+
+/**
+ * @brief File layout, in native byte order:
+ * ```
+ * | header | index[count] | urls | data[count] |
+ * ```
+ *
+ * The data of a listing is 8 byte aligned:
+ * ```
+ * | quint32 mode[n] | quint16 nameLen[n] | names |
+ * ```
+ *
+ * A file written on a machine of different byte order fails the version
+ * check and is replaced on next save.
+ */
+static const char DIR_SNAPSHOT_MAGIC[4] = { 'Q', 'F', 'D', 'S' };
+static const quint32 DIR_SNAPSHOT_VERSION = 1;
+
+namespace qfcmd {
+
+struct DirSnapshotHeader
+{
+    char        magic[4];       /**< #DIR_SNAPSHOT_MAGIC. */
+    quint32     version;        /**< #DIR_SNAPSHOT_VERSION. */
+    quint32     count;          /**< Number of listings. */
+    quint32     reserved;       /**< Zero. */
+};
+
+struct DirSnapshotIndex
+{
+    quint64     dataOffset;     /**< Offset of listing data in file. */
+    qint64      mtime;          /**< Last modified time of directory. */
+    qint64      listedAt;       /**< When the listing started. */
+    quint32     urlOffset;      /**< Offset of UTF-8 URL in file. */
+    quint32     urlLen;         /**< Length of URL in bytes. */
+    quint32     entryCount;     /**< Number of entries. */
+    quint32     nameBytes;      /**< Total length of names. */
+};
+
+struct DirSnapshotInner
+{
+    DirSnapshotInner();
+
+    QFile                                   file;   /**< The mapped file. */
+    const uchar*                            data;   /**< Mapping, or nullptr. */
+    qint64                                  size;   /**< Size of #data. */
+    QHash<QUrl, const DirSnapshotIndex*>    index;  /**< Listings by URL. */
+};
+
+} /* namespace qfcmd */
+
+static_assert(sizeof(qfcmd::DirSnapshotHeader) == 16, "unexpected padding");
+static_assert(sizeof(qfcmd::DirSnapshotIndex) == 40, "unexpected padding");
+
+qfcmd::DirSnapshotInner::DirSnapshotInner()
+{
+    data = nullptr;
+    size = 0;
+}
+
+static quint64 _dir_snapshot_align(quint64 size)
+{
+    return (size + 7) & ~(quint64)7;
+}
+
+static bool _dir_snapshot_check_index(const qfcmd::DirSnapshotIndex* rec, quint64 size)
+{
+    if ((quint64)rec->urlOffset + rec->urlLen > size)
+    {
+        return false;
+    }
+    if (rec->dataOffset % 8 != 0 || rec->dataOffset > size)
+    {
+        return false;
+    }
+    return (quint64)rec->entryCount * 6 + rec->nameBytes <= size - rec->dataOffset;
+}
+
+static quint32 _dir_snapshot_name_bytes(const qfcmd::DirStore& store)
+{
+    quint32 bytes = 0;
+    for (int i = 0; i < store.size(); i++)
+    {
+        int len = 0;
+        store.nameUtf8(i, &len);
+        bytes += (quint32)len;
+    }
+    return bytes;
+}
+
+static void _dir_snapshot_encode(QByteArray& out, const qfcmd::DirStore& store)
+{
+    const int n = store.size();
+    out.reserve(out.size() + n * 6);
+
+    for (int i = 0; i < n; i++)
+    {
+        const quint32 mode = (quint32)store.mode(i);
+        out.append(reinterpret_cast<const char*>(&mode), sizeof(mode));
+    }
+    for (int i = 0; i < n; i++)
+    {
+        int len = 0;
+        store.nameUtf8(i, &len);
+        const quint16 len16 = (quint16)len;
+        out.append(reinterpret_cast<const char*>(&len16), sizeof(len16));
+    }
+    for (int i = 0; i < n; i++)
+    {
+        int len = 0;
+        const char* name = store.nameUtf8(i, &len);
+        out.append(name, len);
+    }
+}
+
+qfcmd::DirSnapshot::DirSnapshot()
+{
+    m_inner = new DirSnapshotInner;
+}
+
+qfcmd::DirSnapshot::~DirSnapshot()
+{
+    close();
+    delete m_inner;
+}
+
+int qfcmd::DirSnapshot::open(const QString& path)
+{
+    close();
+
+    m_inner->file.setFileName(path);
+    if (!m_inner->file.open(QIODevice::ReadOnly))
+    {
+        return m_inner->file.error() == QFileDevice::OpenError && !QFile::exists(path) ? -ENOENT : -EIO;
+    }
+
+    const qint64 size = m_inner->file.size();
+    if (size < (qint64)sizeof(DirSnapshotHeader))
+    {
+        close();
+        return -EINVAL;
+    }
+
+    const uchar* data = m_inner->file.map(0, size);
+    if (data == nullptr)
+    {
+        close();
+        return -EIO;
+    }
+    m_inner->data = data;
+    m_inner->size = size;
+
+    const DirSnapshotHeader* header = reinterpret_cast<const DirSnapshotHeader*>(data);
+    if (memcmp(header->magic, DIR_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+        || header->version != DIR_SNAPSHOT_VERSION
+        || sizeof(DirSnapshotHeader) + (quint64)header->count * sizeof(DirSnapshotIndex) > (quint64)size)
+    {
+        close();
+        return -EINVAL;
+    }
+
+    const DirSnapshotIndex* records = reinterpret_cast<const DirSnapshotIndex*>(data + sizeof(DirSnapshotHeader));
+    for (quint32 i = 0; i < header->count; i++)
+    {
+        const DirSnapshotIndex* rec = &records[i];
+        if (!_dir_snapshot_check_index(rec, (quint64)size))
+        {
+            close();
+            return -EINVAL;
+        }
+
+        const QUrl url(QString::fromUtf8(reinterpret_cast<const char*>(data + rec->urlOffset), rec->urlLen));
+        m_inner->index.insert(url, rec);
+    }
+
+    return 0;
+}
+
+void qfcmd::DirSnapshot::close()
+{
+    m_inner->index.clear();
+    if (m_inner->data != nullptr)
+    {
+        m_inner->file.unmap(const_cast<uchar*>(m_inner->data));
+        m_inner->data = nullptr;
+        m_inner->size = 0;
+    }
+    m_inner->file.close();
+}
+
+bool qfcmd::DirSnapshot::find(const QUrl& url, qint64* mtime, qint64* listedAt) const
+{
+    const DirSnapshotIndex* rec = m_inner->index.value(url, nullptr);
+    if (rec == nullptr)
+    {
+        return false;
+    }
+
+    *mtime = rec->mtime;
+    *listedAt = rec->listedAt;
+    return true;
+}
+
+qfcmd::DirStore qfcmd::DirSnapshot::load(const QUrl& url) const
+{
+    const DirSnapshotIndex* rec = m_inner->index.value(url, nullptr);
+    if (rec == nullptr)
+    {
+        return DirStore();
+    }
+
+    const quint32 n = rec->entryCount;
+    const uchar* base = m_inner->data + rec->dataOffset;
+    const quint32* modes = reinterpret_cast<const quint32*>(base);
+    const quint16* nameLens = reinterpret_cast<const quint16*>(base + (size_t)n * 4);
+    const char* names = reinterpret_cast<const char*>(base + (size_t)n * 6);
+
+    DirStoreBuilder builder((int)n);
+    quint32 offset = 0;
+    for (quint32 i = 0; i < n; i++)
+    {
+        /* Lengths are not covered by the check on open. */
+        if (nameLens[i] > rec->nameBytes - offset)
+        {
+            return DirStore();
+        }
+
+        qfcmd_fs_stat_t stat;
+        memset(&stat, 0, sizeof(stat));
+        stat.st_mode = modes[i];
+
+        builder.append(names + offset, nameLens[i], stat, IconRegistry::typeIcon(stat), false);
+        offset += nameLens[i];
+    }
+
+    return builder.finish();
+}
+
+int qfcmd::DirSnapshot::save(const QString& path, const QList<Record>& records, int maxRecords)
+{
+    QList<const Record*> added;
+    QSet<QUrl> addedUrls;
+    for (const Record& record : records)
+    {
+        if (added.size() >= maxRecords)
+        {
+            break;
+        }
+        if (!addedUrls.contains(record.url))
+        {
+            added.append(&record);
+            addedUrls.insert(record.url);
+        }
+    }
+
+    /* Listings saved last time and not read again since keep their place in line. */
+    QList<const DirSnapshotIndex*> kept;
+    if (m_inner->data != nullptr)
+    {
+        const DirSnapshotHeader* header = reinterpret_cast<const DirSnapshotHeader*>(m_inner->data);
+        const DirSnapshotIndex* old = reinterpret_cast<const DirSnapshotIndex*>(m_inner->data + sizeof(DirSnapshotHeader));
+        for (quint32 i = 0; i < header->count && added.size() + kept.size() < maxRecords; i++)
+        {
+            const QUrl url(QString::fromUtf8(reinterpret_cast<const char*>(m_inner->data + old[i].urlOffset),
+                                             old[i].urlLen));
+            if (!addedUrls.contains(url))
+            {
+                kept.append(&old[i]);
+                addedUrls.insert(url);
+            }
+        }
+    }
+
+    const quint32 count = (quint32)(added.size() + kept.size());
+    QVector<DirSnapshotIndex> index(count);
+    QByteArray urls;
+    const quint64 urlOffset = sizeof(DirSnapshotHeader) + (quint64)count * sizeof(DirSnapshotIndex);
+
+    for (int i = 0; i < added.size(); i++)
+    {
+        const QByteArray url = added[i]->url.toString().toUtf8();
+        DirSnapshotIndex& rec = index[i];
+        rec.mtime = added[i]->mtime;
+        rec.listedAt = added[i]->listedAt;
+        rec.urlOffset = (quint32)(urlOffset + urls.size());
+        rec.urlLen = (quint32)url.size();
+        rec.entryCount = (quint32)added[i]->store.size();
+        rec.nameBytes = _dir_snapshot_name_bytes(added[i]->store);
+        urls.append(url);
+    }
+    for (int i = 0; i < kept.size(); i++)
+    {
+        DirSnapshotIndex& rec = index[added.size() + i];
+        rec = *kept[i];
+        rec.urlOffset = (quint32)(urlOffset + urls.size());
+        urls.append(reinterpret_cast<const char*>(m_inner->data + kept[i]->urlOffset), kept[i]->urlLen);
+    }
+
+    quint64 dataOffset = _dir_snapshot_align(urlOffset + urls.size());
+    for (DirSnapshotIndex& rec : index)
+    {
+        rec.dataOffset = dataOffset;
+        dataOffset = _dir_snapshot_align(dataOffset + (quint64)rec.entryCount * 6 + rec.nameBytes);
+    }
+
+    DirSnapshotHeader header;
+    memcpy(header.magic, DIR_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = DIR_SNAPSHOT_VERSION;
+    header.count = count;
+    header.reserved = 0;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return -EIO;
+    }
+
+    QByteArray out;
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.append(reinterpret_cast<const char*>(index.constData()), (qsizetype)(index.size() * sizeof(DirSnapshotIndex)));
+    out.append(urls);
+
+    quint64 written = 0;
+    for (quint32 i = 0; i < count; i++)
+    {
+        out.append((qsizetype)(index[i].dataOffset - written - (quint64)out.size()), '\0');
+
+        if ((int)i < added.size())
+        {
+            _dir_snapshot_encode(out, added[i]->store);
+        }
+        else
+        {
+            const DirSnapshotIndex* old = kept[i - added.size()];
+            out.append(reinterpret_cast<const char*>(m_inner->data + old->dataOffset),
+                       (qsizetype)((quint64)old->entryCount * 6 + old->nameBytes));
+        }
+
+        /* Keep memory bounded by one listing. */
+        if (file.write(out) != out.size())
+        {
+            file.cancelWriting();
+            return -EIO;
+        }
+        written += (quint64)out.size();
+        out.clear();
+    }
+    if (file.write(out) != out.size())
+    {
+        file.cancelWriting();
+        return -EIO;
+    }
+
+    /* A mapped file cannot be replaced on every platform. */
+    close();
+    if (!file.commit())
+    {
+        open(path);
+        return -EIO;
+    }
+
+    return open(path);
+}
@@ -0,0 +1,97 @@
+#ifndef QFCMD_MODEL_DIRSNAPSHOT_HPP
+#define QFCMD_MODEL_DIRSNAPSHOT_HPP
+
+#include <QList>
+#include <QString>
+#include <QUrl>
+
+#include "dirstore.hpp"
+
+namespace qfcmd {
+
+struct DirSnapshotInner;
+
+/**
+ * @brief Listings saved on disk, so directories show up at startup before
+ *   they are read.
+ *
+ * The file is memory mapped and nothing is parsed up front besides the index,
+ * a listing is only decoded when it is loaded. Only names and types are
+ * saved, metadata is filled in later as for any listing streamed without it.
+ *
+ * Every listing carries the mtime of its directory and the time it was read.
+ * A directory whose mtime still matches, and did not change within the second
+ * it was read, has the same names as saved.
+ *
+ * Not thread safe, but const functions may be called concurrently.
+ */
+class DirSnapshot
+{
+    Q_DISABLE_COPY_MOVE(DirSnapshot)
+
+public:
+    /**
+     * @brief A listing to save.
+     */
+    struct Record
+    {
+        QUrl        url;        /**< URL of directory. */
+        qint64      mtime;      /**< Last modified time of directory in seconds. */
+        qint64      listedAt;   /**< When the listing started, in seconds. */
+        DirStore    store;      /**< The listing. */
+    };
+
+public:
+    DirSnapshot();
+    ~DirSnapshot();
+
+public:
+    /**
+     * @brief Map snapshot file \p path.
+     * @param[in] path - Path of file.
+     * @return 0 on success, or -errno. A file that is truncated or not a
+     *   snapshot is -EINVAL.
+     */
+    int open(const QString& path);
+
+    /**
+     * @brief Unmap the file. Listings already loaded stay valid.
+     */
+    void close();
+
+    /**
+     * @brief Look up the listing of \p url.
+     * @param[in] url - URL of directory, without trailing slash.
+     * @param[out] mtime - Last modified time of directory when it was read.
+     * @param[out] listedAt - When it was read.
+     * @return true if found.
+     */
+    bool find(const QUrl& url, qint64* mtime, qint64* listedAt) const;
+
+    /**
+     * @brief Load the listing of \p url.
+     * @param[in] url - URL of directory, without trailing slash.
+     * @return The listing, without metadata and with generic icons. Empty if not found.
+     */
+    DirStore load(const QUrl& url) const;
+
+    /**
+     * @brief Write \p records to \p path, followed by listings of this
+     *   snapshot they do not replace, and map the new file.
+     *
+     * The mapping is dropped before the file is replaced.
+     *
+     * @param[in] path - Path of file.
+     * @param[in] records - Listings to save, most wanted first.
+     * @param[in] maxRecords - Max number of listings in the file.
+     * @return 0 on success, or -errno.
+     */
+    int save(const QString& path, const QList<Record>& records, int maxRecords);
+
+private:
+    DirSnapshotInner*   m_inner;    /**< Internal. */
+};
+
+} /* namespace qfcmd */
+
+#endif
@@ -0,0 +1,569 @@
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <QAtomicInteger>
+
+#include "utils/interner.hpp"
+
+#include "dirstore.hpp"
+#include "iconregistry.hpp"
+
+namespace qfcmd {
+
+/**
+ * @brief Storage of a DirStore.
+ *
+ * The header and all columns share one allocation:
+ * ```
+ * | header | size | mtime | mode | nameOffset | icon | ext | hash | nameLen | flags | names |
+ * ```
+ *
+ * Entries are only ever appended, so a DirStore that refers to the first N
+ * entries stays valid while the builder keeps writing after them. Hash slots
+ * are shared by both sides, so they are atomic.
+ *
+ * Size, mtime and icon of an entry appended without metadata are filled in
+ * later by DirStoreEnricher. Readers only look at them once the entry has
+ * #DIR_STORE_FLAG_META set, and the icon id is published atomically. Icons
+ * themselves live in IconRegistry.
+ */
+struct DirStoreArena
+{
+    size_t      bytes;          /**< Size of the allocation. */
+    int         count;          /**< Number of entries written. */
+    int         capacity;       /**< Max number of entries. */
+    quint32     nameBytes;      /**< Bytes used in #names. */
+    quint32     nameCapacity;   /**< Size of #names in bytes. */
+    quint32     hashMask;       /**< Size of #hash minus one. */
+
+    quint64*    size;           /**< File size. */
+    quint64*    mtime;          /**< Last modified time. */
+    quint32*    mode;           /**< File mode. */
+    quint32*    nameOffset;     /**< Offset of name in #names. */
+    QAtomicInteger<quint32>* icon;  /**< Id in IconRegistry. */
+    quint32*    ext;            /**< Extension id in StringInterner, 0 if none. */
+    QAtomicInteger<quint32>* hash;  /**< Open addressing table of entry index plus one, 0 is empty. */
+    quint16*    nameLen;        /**< Length of name in bytes. */
+    QAtomicInteger<quint8>* flags;  /**< Entry flags, see #DIR_STORE_FLAG_META. */
+    char*       names;          /**< UTF-8 names, not NUL terminated. */
+};
+
+} /* namespace qfcmd */
+
+/**
+ * @brief Size, mtime and icon of the entry are final.
+ */
+static const quint8 DIR_STORE_FLAG_META = 0x01;
+
+static QAtomicInteger<quint64> s_dir_store_version(0);
+
+static size_t _dir_store_align(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+static quint32 _dir_store_hash(const char* data, int len)
+{
+    return (quint32)qHashBits(data, (size_t)len);
+}
+
+static qfcmd::DirStoreArena* _dir_store_arena_new(int capacity, quint32 nameCapacity)
+{
+    quint32 hashSize = 16;
+    while (hashSize < (quint32)capacity * 2)
+    {
+        hashSize <<= 1;
+    }
+
+    const size_t cap = (size_t)capacity;
+    size_t offset = _dir_store_align(sizeof(qfcmd::DirStoreArena));
+    const size_t offSize = offset;          offset += _dir_store_align(sizeof(quint64) * cap);
+    const size_t offMtime = offset;         offset += _dir_store_align(sizeof(quint64) * cap);
+    const size_t offMode = offset;          offset += _dir_store_align(sizeof(quint32) * cap);
+    const size_t offNameOffset = offset;    offset += _dir_store_align(sizeof(quint32) * cap);
+    const size_t offIcon = offset;          offset += _dir_store_align(sizeof(QAtomicInteger<quint32>) * cap);
+    const size_t offExt = offset;           offset += _dir_store_align(sizeof(quint32) * cap);
+    const size_t offHash = offset;          offset += _dir_store_align(sizeof(QAtomicInteger<quint32>) * hashSize);
+    const size_t offNameLen = offset;       offset += _dir_store_align(sizeof(quint16) * cap);
+    const size_t offFlags = offset;         offset += _dir_store_align(sizeof(QAtomicInteger<quint8>) * cap);
+    const size_t offNames = offset;         offset += nameCapacity;
+
+    char* block = static_cast<char*>(malloc(offset));
+    Q_CHECK_PTR(block);
+
+    qfcmd::DirStoreArena* arena = new (block) qfcmd::DirStoreArena;
+    arena->bytes = offset;
+    arena->count = 0;
+    arena->capacity = capacity;
+    arena->nameBytes = 0;
+    arena->nameCapacity = nameCapacity;
+    arena->hashMask = hashSize - 1;
+    arena->size = reinterpret_cast<quint64*>(block + offSize);
+    arena->mtime = reinterpret_cast<quint64*>(block + offMtime);
+    arena->mode = reinterpret_cast<quint32*>(block + offMode);
+    arena->nameOffset = reinterpret_cast<quint32*>(block + offNameOffset);
+    arena->icon = reinterpret_cast<QAtomicInteger<quint32>*>(block + offIcon);
+    arena->ext = reinterpret_cast<quint32*>(block + offExt);
+    arena->hash = reinterpret_cast<QAtomicInteger<quint32>*>(block + offHash);
+    arena->nameLen = reinterpret_cast<quint16*>(block + offNameLen);
+    arena->flags = reinterpret_cast<QAtomicInteger<quint8>*>(block + offFlags);
+    arena->names = block + offNames;
+
+    for (quint32 i = 0; i < hashSize; i++)
+    {
+        new (&arena->hash[i]) QAtomicInteger<quint32>(0);
+    }
+    for (size_t i = 0; i < cap; i++)
+    {
+        new (&arena->icon[i]) QAtomicInteger<quint32>(0);
+        new (&arena->flags[i]) QAtomicInteger<quint8>(0);
+    }
+
+    return arena;
+}
+
+static void _dir_store_arena_free(qfcmd::DirStoreArena* arena)
+{
+    arena->~DirStoreArena();
+    free(arena);
+}
+
+static void _dir_store_hash_insert(qfcmd::DirStoreArena* arena, int idx)
+{
+    const char* name = arena->names + arena->nameOffset[idx];
+    quint32 pos = _dir_store_hash(name, arena->nameLen[idx]) & arena->hashMask;
+
+    while (arena->hash[pos].loadRelaxed() != 0)
+    {
+        pos = (pos + 1) & arena->hashMask;
+    }
+    arena->hash[pos].storeRelaxed((quint32)idx + 1);
+}
+
+/**
+ * @brief Intern the extension of a file name.
+ * @param[in] name - UTF-8 name.
+ * @param[in] len - Length of name in bytes.
+ * @param[in] mode - File mode.
+ * @return Extension id, 0 for directories and names without dot.
+ */
+static quint32 _dir_store_intern_ext(const char* name, int len, quint32 mode)
+{
+    if (mode & QFCMD_FS_S_IFDIR)
+    {
+        return 0;
+    }
+
+    /* '.' never appears inside a multi-byte UTF-8 sequence. */
+    for (int i = len - 1; i >= 0; i--)
+    {
+        if (name[i] == '.')
+        {
+            return qfcmd::StringInterner::intern(name + i + 1, len - i - 1);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Check whether an entry is the same in both listings.
+ *
+ * Metadata is only filled in for rows that were shown, so size and mtime
+ * are only compared when both sides have it. Missing metadata is no change.
+ */
+static bool _dir_store_compare_stat(const qfcmd::DirStore& a, int aIdx, const qfcmd::DirStore& b, int bIdx)
+{
+    if (a.mode(aIdx) != b.mode(bIdx))
+    {
+        return false;
+    }
+    if (!a.hasMeta(aIdx) || !b.hasMeta(bIdx))
+    {
+        return true;
+    }
+    return a.fileSize(aIdx) == b.fileSize(bIdx)
+        && a.mtime(aIdx) == b.mtime(bIdx);
+}
+
+qfcmd::DirStore::DirStore()
+{
+    m_size = 0;
+    m_version = 0;
+}
+
+int qfcmd::DirStore::size() const
+{
+    return m_size;
+}
+
+bool qfcmd::DirStore::isEmpty() const
+{
+    return m_size == 0;
+}
+
+quint64 qfcmd::DirStore::version() const
+{
+    return m_version;
+}
+
+qint64 qfcmd::DirStore::memoryUsage(QSet<const void*>* counted) const
+{
+    if (m_arena.isNull())
+    {
+        return 0;
+    }
+
+    if (counted != nullptr)
+    {
+        if (counted->contains(m_arena.data()))
+        {
+            return 0;
+        }
+        counted->insert(m_arena.data());
+    }
+
+    return (qint64)m_arena->bytes;
+}
+
+QString qfcmd::DirStore::name(int idx) const
+{
+    int len = 0;
+    const char* data = nameUtf8(idx, &len);
+    return QString::fromUtf8(data, len);
+}
+
+const char* qfcmd::DirStore::nameUtf8(int idx, int* len) const
+{
+    Q_ASSERT(idx >= 0 && idx < m_size);
+    *len = m_arena->nameLen[idx];
+    return m_arena->names + m_arena->nameOffset[idx];
+}
+
+const char* qfcmd::DirStore::namesUtf8(int* len) const
+{
+    if (m_size == 0)
+    {
+        *len = 0;
+        return nullptr;
+    }
+
+    /* Names are only ever appended, so the last one ends them. */
+    *len = (int)(m_arena->nameOffset[m_size - 1] + m_arena->nameLen[m_size - 1]);
+    return m_arena->names;
+}
+
+quint64 qfcmd::DirStore::mode(int idx) const
+{
+    Q_ASSERT(idx >= 0 && idx < m_size);
+    return m_arena->mode[idx];
+}
+
+quint64 qfcmd::DirStore::fileSize(int idx) const
+{
+    return hasMeta(idx) ? m_arena->size[idx] : 0;
+}
+
+quint64 qfcmd::DirStore::mtime(int idx) const
+{
+    return hasMeta(idx) ? m_arena->mtime[idx] : 0;
+}
+
+bool qfcmd::DirStore::hasMeta(int idx) const
+{
+    Q_ASSERT(idx >= 0 && idx < m_size);
+    return m_arena->flags[idx].loadAcquire() & DIR_STORE_FLAG_META;
+}
+
+qfcmd_fs_stat_t qfcmd::DirStore::stat(int idx) const
+{
+    qfcmd_fs_stat_t stat;
+    stat.st_mode = mode(idx);
+    stat.st_size = fileSize(idx);
+    stat.st_mtime = mtime(idx);
+    return stat;
+}
+
+QIcon qfcmd::DirStore::icon(int idx) const
+{
+    return IconRegistry::icon(iconId(idx));
+}
+
+quint32 qfcmd::DirStore::iconId(int idx) const
+{
+    Q_ASSERT(idx >= 0 && idx < m_size);
+    return m_arena->icon[idx].loadAcquire();
+}
+
+quint32 qfcmd::DirStore::extId(int idx) const
+{
+    Q_ASSERT(idx >= 0 && idx < m_size);
+    return m_arena->ext[idx];
+}
+
+QString qfcmd::DirStore::ext(int idx) const
+{
+    return StringInterner::get(extId(idx));
+}
+
+bool qfcmd::DirStore::isDir(int idx) const
+{
+    return mode(idx) & QFCMD_FS_S_IFDIR;
+}
+
+int qfcmd::DirStore::find(const QString& name) const
+{
+    const QByteArray utf8 = name.toUtf8();
+    return find(utf8.constData(), utf8.size());
+}
+
+int qfcmd::DirStore::find(const char* name, int len) const
+{
+    if (m_size == 0)
+    {
+        return -1;
+    }
+
+    const DirStoreArena* arena = m_arena.data();
+    quint32 pos = _dir_store_hash(name, len) & arena->hashMask;
+
+    for (;; pos = (pos + 1) & arena->hashMask)
+    {
+        const quint32 slot = arena->hash[pos].loadRelaxed();
+        if (slot == 0)
+        {
+            return -1;
+        }
+
+        /* Entries after m_size are not part of this view. */
+        const int idx = (int)(slot - 1);
+        if (idx >= m_size || arena->nameLen[idx] != len)
+        {
+            continue;
+        }
+        if (memcmp(arena->names + arena->nameOffset[idx], name, len) == 0)
+        {
+            return idx;
+        }
+    }
+}
+
+qfcmd::DirStoreDelta::DirStoreDelta()
+{
+    fromVersion = 0;
+    appendOnly = false;
+}
+
+qfcmd::DirStoreDelta qfcmd::DirStoreDelta::append(const DirStore& from, const DirStore& to)
+{
+    Q_ASSERT(from.size() <= to.size());
+
+    DirStoreDelta delta;
+    delta.fromVersion = from.version();
+    delta.appendOnly = true;
+    delta.added.reserve(to.size() - from.size());
+    for (int j = from.size(); j < to.size(); j++)
+    {
+        delta.added.append(j);
+    }
+
+    return delta;
+}
+
+qfcmd::DirStoreDelta qfcmd::DirStoreDelta::compute(const DirStore& from, const DirStore& to)
+{
+    DirStoreDelta delta;
+    delta.fromVersion = from.version();
+    delta.oldToNew.resize(from.size());
+
+    QVector<bool> seen(to.size(), false);
+    for (int i = 0; i < from.size(); i++)
+    {
+        int len = 0;
+        const char* name = from.nameUtf8(i, &len);
+        const int j = to.find(name, len);
+
+        delta.oldToNew[i] = j;
+        if (j < 0)
+        {
+            delta.removed.append(i);
+            continue;
+        }
+
+        seen[j] = true;
+        if (!_dir_store_compare_stat(from, i, to, j))
+        {
+            delta.changed.append(j);
+        }
+    }
+
+    for (int j = 0; j < to.size(); j++)
+    {
+        if (!seen[j])
+        {
+            delta.added.append(j);
+        }
+    }
+
+    return delta;
+}
+
+qfcmd::DirStoreBuilder::DirStoreBuilder(int capacity)
+{
+    capacity = qMax(capacity, 16);
+    m_arena.reset(_dir_store_arena_new(capacity, (quint32)capacity * 16), _dir_store_arena_free);
+}
+
+qfcmd::DirStoreBuilder::DirStoreBuilder(const DirStore& base)
+    : DirStoreBuilder(base.size() + 1)
+{
+    for (int i = 0; i < base.size(); i++)
+    {
+        int len = 0;
+        const char* name = base.nameUtf8(i, &len);
+        append(name, len, base.stat(i), base.iconId(i), base.hasMeta(i));
+    }
+}
+
+qfcmd::DirStoreBuilder::~DirStoreBuilder()
+{
+}
+
+int qfcmd::DirStoreBuilder::size() const
+{
+    return m_arena.isNull() ? 0 : m_arena->count;
+}
+
+void qfcmd::DirStoreBuilder::append(const QString& name, const qfcmd_fs_stat_t& stat, quint32 iconId,
+                                    bool hasMeta)
+{
+    const QByteArray utf8 = name.toUtf8();
+    append(utf8.constData(), (int)utf8.size(), stat, iconId, hasMeta);
+}
+
+void qfcmd::DirStoreBuilder::append(const char* name, int nameLen, const qfcmd_fs_stat_t& stat, quint32 iconId,
+                                    bool hasMeta)
+{
+    if (m_arena.isNull())
+    {
+        m_arena.reset(_dir_store_arena_new(16, 256), _dir_store_arena_free);
+    }
+
+    Q_ASSERT(nameLen >= 0 && nameLen <= 0xFFFF);
+    const quint32 len = (quint32)nameLen;
+
+    DirStoreArena* arena = m_arena.data();
+    if (arena->count == arena->capacity || arena->nameBytes + len > arena->nameCapacity)
+    {
+        const int capacity = arena->count == arena->capacity ? arena->capacity * 2 : arena->capacity;
+        const quint32 nameCapacity = qMax(arena->nameCapacity * 2, arena->nameBytes + len);
+        grow(capacity, nameCapacity);
+        arena = m_arena.data();
+    }
+
+    const int idx = arena->count;
+    memcpy(arena->names + arena->nameBytes, name, len);
+    arena->nameOffset[idx] = arena->nameBytes;
+    arena->nameLen[idx] = (quint16)len;
+    arena->nameBytes += len;
+    arena->mode[idx] = (quint32)stat.st_mode;
+    arena->size[idx] = stat.st_size;
+    arena->mtime[idx] = stat.st_mtime;
+    arena->icon[idx].storeRelaxed(iconId);
+    arena->flags[idx].storeRelaxed(hasMeta ? DIR_STORE_FLAG_META : 0);
+    arena->ext[idx] = _dir_store_intern_ext(name, (int)len, arena->mode[idx]);
+    arena->count++;
+
+    _dir_store_hash_insert(arena, idx);
+}
+
+qfcmd::DirStore qfcmd::DirStoreBuilder::finish()
+{
+    DirStore store;
+    if (m_arena.isNull())
+    {
+        return store;
+    }
+
+    store.m_arena = m_arena;
+    store.m_size = m_arena->count;
+    store.m_version = s_dir_store_version.fetchAndAddRelaxed(1) + 1;
+
+    m_arena.reset();
+
+    return store;
+}
+
+qfcmd::DirStore qfcmd::DirStoreBuilder::snapshot() const
+{
+    DirStore store;
+    if (m_arena.isNull())
+    {
+        return store;
+    }
+
+    store.m_arena = m_arena;
+    store.m_size = m_arena->count;
+    store.m_version = s_dir_store_version.fetchAndAddRelaxed(1) + 1;
+
+    return store;
+}
+
+void qfcmd::DirStoreBuilder::grow(int capacity, quint32 nameCapacity)
+{
+    const DirStoreArena* src = m_arena.data();
+    DirStoreArena* dst = _dir_store_arena_new(capacity, nameCapacity);
+
+    const size_t count = (size_t)src->count;
+    memcpy(dst->size, src->size, sizeof(quint64) * count);
+    memcpy(dst->mtime, src->mtime, sizeof(quint64) * count);
+    memcpy(dst->mode, src->mode, sizeof(quint32) * count);
+    memcpy(dst->nameOffset, src->nameOffset, sizeof(quint32) * count);
+    memcpy(dst->ext, src->ext, sizeof(quint32) * count);
+    memcpy(dst->nameLen, src->nameLen, sizeof(quint16) * count);
+    memcpy(dst->names, src->names, src->nameBytes);
+    for (size_t i = 0; i < count; i++)
+    {
+        dst->icon[i].storeRelaxed(src->icon[i].loadRelaxed());
+        dst->flags[i].storeRelaxed(src->flags[i].loadRelaxed());
+    }
+
+    dst->count = src->count;
+    dst->nameBytes = src->nameBytes;
+    for (int i = 0; i < dst->count; i++)
+    {
+        _dir_store_hash_insert(dst, i);
+    }
+
+    /* Views of the old arena keep it alive until they go away. */
+    m_arena.reset(dst, _dir_store_arena_free);
+}
+
+qfcmd::DirStoreEnricher::DirStoreEnricher(const DirStore& store)
+{
+    m_arena = qSharedPointerConstCast<DirStoreArena>(store.m_arena);
+    m_size = store.m_size;
+}
+
+qfcmd::DirStoreEnricher::~DirStoreEnricher()
+{
+}
+
+void qfcmd::DirStoreEnricher::set(int idx, const qfcmd_fs_stat_t& stat, quint32 iconId)
+{
+    Q_ASSERT(idx >= 0 && idx < m_size);
+
+    DirStoreArena* arena = m_arena.data();
+    if (arena->flags[idx].loadRelaxed() & DIR_STORE_FLAG_META)
+    {
+        return;
+    }
+
+    /* Nobody reads these until the flag is set. */
+    arena->size[idx] = stat.st_size;
+    arena->mtime[idx] = stat.st_mtime;
+    if (iconId != 0)
+    {
+        arena->icon[idx].storeRelease(iconId);
+    }
+    arena->flags[idx].fetchAndOrRelease(DIR_STORE_FLAG_META);
+}
@@ -0,0 +1,308 @@
+#ifndef QFCMD_MODEL_DIRSTORE_HPP
+#define QFCMD_MODEL_DIRSTORE_HPP
+
+#include <QHash>
+#include <QIcon>
+#include <QSet>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include "qfcmd/filesystem.h"
+
+namespace qfcmd {
+
+struct DirStoreArena;
+
+/**
+ * @brief Columnar listing of one directory.
+ *
+ * All entries of a directory live in a single arena allocation: names are kept
+ * in one UTF-8 buffer, and mode, size, mtime, icon id and extension id are parallel arrays
+ * indexed by entry. The arena is released in one step when the last DirStore
+ * referring to it goes away.
+ *
+ * A DirStore is an immutable view over the first size() entries of an arena,
+ * so it is cheap to copy and safe to pass between threads.
+ */
+class DirStore
+{
+    friend class DirStoreBuilder;
+    friend class DirStoreEnricher;
+
+public:
+    DirStore();
+
+public:
+    /**
+     * @brief Get the number of entries.
+     */
+    int size() const;
+
+    /**
+     * @brief Check if there are no entries.
+     */
+    bool isEmpty() const;
+
+    /**
+     * @brief Get the version of the listing.
+     *
+     * Every DirStore produced by DirStoreBuilder::finish() has an unique
+     * version, an empty store has version 0.
+     */
+    quint64 version() const;
+
+    /**
+     * @brief Get the memory held by the listing.
+     *
+     * Icons are shared through IconRegistry and not counted.
+     *
+     * @param[in,out] counted - If not nullptr, arenas already in it count
+     *   as zero, and the arena of this listing is added to it.
+     * @return Size in bytes.
+     */
+    qint64 memoryUsage(QSet<const void*>* counted = nullptr) const;
+
+    /**
+     * @brief Get entry name.
+     * @param[in] idx - Entry index.
+     */
+    QString name(int idx) const;
+
+    /**
+     * @brief Get entry name as UTF-8 bytes, without copy.
+     * @param[in] idx - Entry index.
+     * @param[out] len - Length of name in bytes.
+     * @return Name, not NUL terminated.
+     */
+    const char* nameUtf8(int idx, int* len) const;
+
+    /**
+     * @brief Get names of all entries, back to back in entry order, without copy.
+     * @param[out] len - Length of names in bytes.
+     * @return Names, not NUL terminated.
+     */
+    const char* namesUtf8(int* len) const;
+
+    quint64 mode(int idx) const;
+    quint64 fileSize(int idx) const;
+    quint64 mtime(int idx) const;
+    qfcmd_fs_stat_t stat(int idx) const;
+    QIcon icon(int idx) const;
+
+    /**
+     * @brief Get id of entry icon in IconRegistry.
+     * @param[in] idx - Entry index.
+     */
+    quint32 iconId(int idx) const;
+
+    /**
+     * @brief Check if size, mtime and icon of entry are known.
+     *
+     * Until they are, fileSize() and mtime() return 0 and icon() returns the
+     * icon given when the entry was appended.
+     *
+     * @param[in] idx - Entry index.
+     */
+    bool hasMeta(int idx) const;
+
+    /**
+     * @brief Get id of entry extension in StringInterner.
+     *
+     * The extension is split from the name once when the entry is appended,
+     * directories and names without dot have id 0.
+     *
+     * @param[in] idx - Entry index.
+     */
+    quint32 extId(int idx) const;
+
+    /**
+     * @brief Get entry extension.
+     * @param[in] idx - Entry index.
+     * @return The shared extension string, empty if none.
+     */
+    QString ext(int idx) const;
+
+    /**
+     * @brief Check if entry is a directory.
+     * @param[in] idx - Entry index.
+     */
+    bool isDir(int idx) const;
+
+    /**
+     * @brief Find entry by name.
+     * @param[in] name - Entry name.
+     * @return Entry index, or -1 if not found.
+     */
+    int find(const QString& name) const;
+
+    /**
+     * @brief Find entry by UTF-8 name.
+     * @param[in] name - Entry name.
+     * @param[in] len - Length of name in bytes.
+     * @return Entry index, or -1 if not found.
+     */
+    int find(const char* name, int len) const;
+
+private:
+    QSharedPointer<const DirStoreArena> m_arena;    /**< Storage. */
+    int                                 m_size;     /**< Number of visible entries in arena. */
+    quint64                             m_version;  /**< Listing version. */
+};
+
+/**
+ * @brief Difference between two listings of the same directory.
+ *
+ * Only entry indexes are stored, so a delta is small compared to the listings
+ * it describes and can be computed away from the GUI thread.
+ */
+struct DirStoreDelta
+{
+    DirStoreDelta();
+
+    /**
+     * @brief Compute difference between \p from and \p to.
+     * @param[in] from - The old listing.
+     * @param[in] to - The new listing.
+     * @return Delta.
+     */
+    static DirStoreDelta compute(const DirStore& from, const DirStore& to);
+
+    /**
+     * @brief Describe \p to as \p from with entries appended.
+     *
+     * Only valid if \p from is a prefix of \p to, as between two snapshots of
+     * the same DirStoreBuilder. Costs nothing for the entries already in \p from.
+     *
+     * @param[in] from - The old listing.
+     * @param[in] to - The new listing.
+     * @return Delta.
+     */
+    static DirStoreDelta append(const DirStore& from, const DirStore& to);
+
+    quint64         fromVersion;    /**< Version of the old listing, the delta only applies to it. */
+    bool            appendOnly;     /**< Old entries keep their index, #oldToNew is empty. */
+    QVector<int>    oldToNew;       /**< Index in new listing for every old entry, or -1 if removed. */
+    QVector<int>    removed;        /**< Old entries that do not exist in new listing, in ascending order. */
+    QVector<int>    added;          /**< New entries that do not exist in old listing, in ascending order. */
+    QVector<int>    changed;        /**< New entries whose stat differs from old listing. */
+};
+
+/**
+ * @brief Build a DirStore.
+ *
+ * Entries are written straight into the arena, which grows geometrically when
+ * full, so building a listing costs a handful of allocations no matter how
+ * many entries it has.
+ */
+class DirStoreBuilder
+{
+    Q_DISABLE_COPY_MOVE(DirStoreBuilder)
+
+public:
+    /**
+     * @brief Create an empty builder.
+     * @param[in] capacity - Number of entries to reserve.
+     */
+    DirStoreBuilder(int capacity = 0);
+
+    /**
+     * @brief Create a builder that starts with all entries of \p base.
+     * @param[in] base - The listing to copy.
+     */
+    DirStoreBuilder(const DirStore& base);
+
+    ~DirStoreBuilder();
+
+public:
+    /**
+     * @brief Append an entry.
+     * @param[in] name - Entry name.
+     * @param[in] stat - Entry stat.
+     * @param[in] iconId - Id of entry icon in IconRegistry, 0 for none.
+     * @param[in] hasMeta - Size, mtime and icon are final. If not, only
+     *   st_mode of \p stat is used, and DirStoreEnricher fills in the rest.
+     */
+    void append(const QString& name, const qfcmd_fs_stat_t& stat, quint32 iconId, bool hasMeta = true);
+
+    /**
+     * @brief Append an entry whose name is already UTF-8.
+     * @param[in] name - Entry name, not required to be NUL terminated.
+     * @param[in] nameLen - Length of \p name in bytes, at most 65535.
+     * @see append(const QString&, const qfcmd_fs_stat_t&, quint32, bool)
+     */
+    void append(const char* name, int nameLen, const qfcmd_fs_stat_t& stat, quint32 iconId,
+                bool hasMeta = true);
+
+    /**
+     * @brief Get the number of entries appended so far.
+     */
+    int size() const;
+
+    /**
+     * @brief Get a listing of the entries appended so far, and keep building.
+     *
+     * The snapshot is safe to read from another thread while more entries
+     * are appended, and it is a prefix of later snapshots and of finish().
+     *
+     * @return The listing.
+     */
+    DirStore snapshot() const;
+
+    /**
+     * @brief Finish building.
+     *
+     * The builder is reset to empty afterwards.
+     *
+     * @return The listing.
+     */
+    DirStore finish();
+
+private:
+    void grow(int capacity, quint32 nameCapacity);
+
+private:
+    QSharedPointer<DirStoreArena>   m_arena;    /**< Storage being written. */
+};
+
+/**
+ * @brief Fill in metadata of entries appended without it.
+ *
+ * The entries are updated in place, so every DirStore sharing the arena sees
+ * the metadata as soon as it is set, even from other threads.
+ *
+ * Only one enricher may write an arena at a time, and not concurrently with
+ * the DirStoreBuilder that is still appending to it.
+ */
+class DirStoreEnricher
+{
+    Q_DISABLE_COPY_MOVE(DirStoreEnricher)
+
+public:
+    /**
+     * @brief Create an enricher for entries of \p store.
+     * @param[in] store - The listing.
+     */
+    DirStoreEnricher(const DirStore& store);
+    ~DirStoreEnricher();
+
+public:
+    /**
+     * @brief Set metadata of entry.
+     *
+     * Nothing is done if the entry already has metadata.
+     *
+     * @param[in] idx - Entry index.
+     * @param[in] stat - Entry stat, st_mode is ignored.
+     * @param[in] iconId - Id of entry icon in IconRegistry, or 0 to keep the current one.
+     */
+    void set(int idx, const qfcmd_fs_stat_t& stat, quint32 iconId);
+
+private:
+    QSharedPointer<DirStoreArena>   m_arena;    /**< Storage being written. */
+    int                             m_size;     /**< Number of entries that may be written. */
+};
+
+} /* namespace qfcmd */
+
+#endif
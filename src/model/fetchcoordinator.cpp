@@ -0,0 +1,82 @@
+#include "fetchcoordinator.hpp"
+
+/**
+ * @brief Number of completed listings kept before expired ones are dropped.
+ */
+static const int FETCH_COORDINATOR_PRUNE_THRESHOLD = 256;
+
+qfcmd::FetchCoordinator::FetchCoordinator(qint64 freshMs)
+{
+    m_freshMs = freshMs;
+}
+
+bool qfcmd::FetchCoordinator::begin(const QUrl& url, bool force)
+{
+    const QUrl k = key(url);
+    if (m_inFlight.contains(k))
+    {
+        return false;
+    }
+
+    if (!force)
+    {
+        auto it = m_completed.constFind(k);
+        if (it != m_completed.constEnd() && !it.value().hasExpired())
+        {
+            return false;
+        }
+    }
+
+    m_completed.remove(k);
+    m_inFlight.insert(k);
+    return true;
+}
+
+void qfcmd::FetchCoordinator::finish(const QUrl& url)
+{
+    const QUrl k = key(url);
+    m_inFlight.remove(k);
+
+    if (m_completed.size() >= FETCH_COORDINATOR_PRUNE_THRESHOLD)
+    {
+        prune();
+    }
+    m_completed.insert(k, QDeadlineTimer(m_freshMs));
+}
+
+void qfcmd::FetchCoordinator::cancelAll()
+{
+    m_inFlight.clear();
+}
+
+void qfcmd::FetchCoordinator::forget(const QUrl& url)
+{
+    const QUrl k = key(url);
+    m_inFlight.remove(k);
+    m_completed.remove(k);
+}
+
+bool qfcmd::FetchCoordinator::isInFlight(const QUrl& url) const
+{
+    return m_inFlight.contains(key(url));
+}
+
+QUrl qfcmd::FetchCoordinator::key(const QUrl& url)
+{
+    return url.adjusted(QUrl::StripTrailingSlash);
+}
+
+void qfcmd::FetchCoordinator::prune()
+{
+    for (auto it = m_completed.begin(); it != m_completed.end();)
+    {
+        if (it.value().hasExpired())
+        {
+            it = m_completed.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef QFCMD_MODEL_FETCHCOORDINATOR_HPP
+#define QFCMD_MODEL_FETCHCOORDINATOR_HPP
+
+#include <QDeadlineTimer>
+#include <QHash>
+#include <QSet>
+#include <QUrl>
+
+namespace qfcmd {
+
+/**
+ * @brief Track directory listings per URL so the same one is not queued twice.
+ *
+ * A URL is in flight between begin() and finish(). After finish() it stays
+ * fresh for a while, during which non-forced requests are dropped too.
+ *
+ * URLs with and without trailing slash are treated the same. The coordinator
+ * is not thread safe, it is meant to be used from the model's thread.
+ */
+class FetchCoordinator
+{
+    Q_DISABLE_COPY_MOVE(FetchCoordinator)
+
+public:
+    /**
+     * @brief Create coordinator.
+     * @param[in] freshMs - How long a completed listing is considered fresh.
+     */
+    FetchCoordinator(qint64 freshMs = 2000);
+
+public:
+    /**
+     * @brief Ask whether a listing of \p url should be issued.
+     *
+     * If it should, \p url is marked in flight.
+     *
+     * @param[in] url - URL of directory.
+     * @param[in] force - Ignore a recently completed listing.
+     * @return true if caller should issue the listing.
+     */
+    bool begin(const QUrl& url, bool force = false);
+
+    /**
+     * @brief Mark listing of \p url completed.
+     * @param[in] url - URL of directory.
+     */
+    void finish(const QUrl& url);
+
+    /**
+     * @brief Forget all listings in flight.
+     *
+     * Call it after cancelling outstanding listings, whose results never come.
+     */
+    void cancelAll();
+
+    /**
+     * @brief Forget that \p url was listed recently, or is being listed.
+     *
+     * Call it when the listing is thrown away, so it is read again next time.
+     * A result still on its way may be dropped, it does not block a new
+     * listing.
+     *
+     * @param[in] url - URL of directory.
+     */
+    void forget(const QUrl& url);
+
+    /**
+     * @brief Check if a listing of \p url is in flight.
+     * @param[in] url - URL of directory.
+     */
+    bool isInFlight(const QUrl& url) const;
+
+private:
+    static QUrl key(const QUrl& url);
+    void prune();
+
+private:
+    qint64                          m_freshMs;      /**< How long a completed listing is fresh. */
+    QSet<QUrl>                      m_inFlight;     /**< Listings issued and not completed. */
+    QHash<QUrl, QDeadlineTimer>     m_completed;    /**< Recently completed listings, and when they expire. */
+};
+
+} /* namespace qfcmd */
+
+#endif
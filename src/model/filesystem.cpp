@@ -1,19 +1,216 @@
+#include <algorithm>
+#include <climits>
+#include <iterator>
+#include <numeric>
+#include <utility>
 #include <QApplication>
-#include <QImageReader>
-
+#include <QBitArray>
+#include <QPixmapCache>
+#include <QSemaphore>
+#include <QSet>
+#include <QThread>
+#include <QTimer>
+
+#include "utils/interner.hpp"
 #include "vfs/vfs.hpp"
 #include "filesystem.hpp"
+#include "iconregistry.hpp"
+#include "thumbnail.hpp"
+
+/**
+ * @brief Max number of row ranges a refresh emits separate signals for.
+ *
+ * Beyond this a refresh is published as one layout change, which costs the
+ * view a single relayout no matter how scattered the changes are.
+ */
+static const int FS_MODEL_MAX_ROW_RANGES = 32;
+
+/**
+ * @brief Publish filled metadata once this many entries are done.
+ */
+static const int FS_MODEL_META_BATCH_SIZE = 64;
+
+/**
+ * @brief Max number of entries a sort metadata task stats before it yields the strand.
+ */
+static const int FS_MODEL_SORT_META_CHUNK = 512;
+
+/**
+ * @brief Publish decoded thumbnails once this many are done.
+ */
+static const int FS_MODEL_THUMBNAIL_BATCH_SIZE = 8;
+
+/**
+ * @brief Max number of decoded thumbnails waiting to be painted.
+ */
+static const int FS_MODEL_MAX_PENDING_THUMBNAILS = 512;
+
+/**
+ * @brief Sort and make collation keys on several threads from this many entries per thread.
+ */
+static const int FS_MODEL_PARALLEL_SORT_MIN = 16384;
+
+/**
+ * @brief Rough heap size of a collation key, for memory accounting.
+ */
+static const int FS_MODEL_SORT_KEY_BYTES = 64;
+
+/**
+ * @brief Rough heap size of a cached cell, for memory accounting.
+ */
+static const int FS_MODEL_DISPLAY_CELL_BYTES = 96;
+
+/**
+ * @brief Days the date formatter remembers.
+ */
+static const int FS_MODEL_DATE_DAYS = 16;
+
+namespace qfcmd {
+
+/**
+ * @brief What rows of one directory are ordered by.
+ */
+struct FileSystemModelSortContext
+{
+    const DirStore*                         store;      /**< The listing. */
+    const std::vector<QCollatorSortKey>*    keys;       /**< Name collation key of every entry. */
+    const QHash<quint32, int>*              extRanks;   /**< Collation rank of extensions. */
+    FileSystemModel::TitleType              type;       /**< Column sorted by. */
+    bool                                    descending; /**< Sort order. */
+    bool                                    sorted;     /**< Otherwise rows are in listing order. */
+};
+
+/**
+ * @brief Sort fields of an entry, read once so concurrent metadata writes
+ *   cannot change the order in the middle of a sort.
+ */
+struct FileSystemModelSortItem
+{
+    qint64  primary;    /**< Value of the sorted column. */
+    int     group;      /**< 0 for directories, 1 for files. */
+    int     entry;      /**< Entry index. */
+};
+
+} /* namespace qfcmd */
 
-static qfcmd::FileSystemModelNode* _fs_mode_index_to_node(const QModelIndex& index)
+/**
+ * @brief Get the directory node that contains the item at \p index.
+ */
+static qfcmd::FileSystemModelNode* _fs_model_index_to_dir(const QModelIndex& index)
 {
     return static_cast<qfcmd::FileSystemModelNode*>(index.internalPointer());
 }
 
+/**
+ * @brief Get the entry index of the item at \p index.
+ */
+static int _fs_model_index_to_entry(const QModelIndex& index)
+{
+    return _fs_model_index_to_dir(index)->m_visibleChildren[index.row()];
+}
+
+/**
+ * @brief Get the node of the directory at \p index.
+ * @return The node, or nullptr if the directory is not visited yet.
+ */
+static qfcmd::FileSystemModelNode* _fs_model_index_to_node(const qfcmd::FileSystemModel* thiz,
+                                                           const QModelIndex& index)
+{
+    if (!index.isValid())
+    {
+        return thiz->m_root;
+    }
+
+    qfcmd::FileSystemModelNode* dir = _fs_model_index_to_dir(index);
+    return dir->m_children.value(_fs_model_index_to_entry(index), nullptr);
+}
+
+/**
+ * @brief Get key of a cell in #qfcmd::FileSystemModelNode::m_display.
+ */
+static quint64 _fs_model_display_key(int entry, int col)
+{
+    return ((quint64)(quint32)entry << 32) | (quint32)col;
+}
+
+/**
+ * @brief Drop cached cells of \p entries of \p node.
+ */
+static void _fs_model_node_drop_display(const qfcmd::FileSystemModel* thiz, qfcmd::FileSystemModelNode* node,
+                                        const QVector<int>& entries)
+{
+    if (node->m_display.isEmpty())
+    {
+        return;
+    }
+    for (int entry : entries)
+    {
+        for (int col = 0; col < thiz->m_titles.size(); col++)
+        {
+            node->m_display.remove(_fs_model_display_key(entry, col));
+        }
+    }
+}
+
+/**
+ * @brief Format \p secs as "yyyy-MM-dd HH:mm:ss" in local time.
+ *
+ * Converting to local time is the slow part, so it is only done once per day.
+ */
+static QString _fs_model_format_date(qfcmd::FileSystemModelDateFormatter& formatter, qint64 secs)
+{
+    const qfcmd::FileSystemModelDateFormatter::Day* day = nullptr;
+    for (const qfcmd::FileSystemModelDateFormatter::Day& known : formatter.days)
+    {
+        if (secs >= known.begin && secs < known.end)
+        {
+            day = &known;
+            break;
+        }
+    }
+
+    if (day == nullptr)
+    {
+        const QDateTime time = QDateTime::fromSecsSinceEpoch(secs);
+        const QDate date = time.date();
+        const QDateTime begin = date.startOfDay();
+        const QDateTime end = date.addDays(1).startOfDay();
+
+        /* Clocks jump during the day, seconds since midnight are not the time of day. */
+        if (begin.offsetFromUtc() != end.offsetFromUtc())
+        {
+            return time.toString("yyyy-MM-dd HH:mm:ss");
+        }
+
+        if (formatter.days.size() >= FS_MODEL_DATE_DAYS)
+        {
+            formatter.days.removeFirst();
+        }
+        formatter.days.append({ begin.toSecsSinceEpoch(), end.toSecsSinceEpoch(), date.toString("yyyy-MM-dd ") });
+        day = &formatter.days.last();
+    }
+
+    const int sec = (int)(secs - day->begin);
+    const int hour = sec / 3600;
+    const int minute = sec / 60 % 60;
+    const char clock[8] = {
+        (char)('0' + hour / 10), (char)('0' + hour % 10), ':',
+        (char)('0' + minute / 10), (char)('0' + minute % 10), ':',
+        (char)('0' + sec % 60 / 10), (char)('0' + sec % 10),
+    };
+
+    QString text;
+    text.reserve(day->prefix.size() + (int)sizeof(clock));
+    text += day->prefix;
+    text += QLatin1String(clock, sizeof(clock));
+    return text;
+}
+
 static QVariant _fs_model_data_display(const qfcmd::FileSystemModel* thiz,
                                        const QModelIndex &index)
 {
-    qfcmd::FileSystemModelNode* node = _fs_mode_index_to_node(index);
-    Q_ASSERT(node != nullptr);
+    qfcmd::FileSystemModelNode* dir = _fs_model_index_to_dir(index);
+    Q_ASSERT(dir != nullptr);
 
     int col = index.column();
     if (col < 0 || col >= thiz->m_titles.size())
@@ -21,7 +218,23 @@ static QVariant _fs_model_data_display(const qfcmd::FileSystemModel* thiz,
         return QVariant();
     }
 
-    return thiz->m_titles[col].func(node);
+    /* Views ask again on every paint, format a cell once until its entry changes. */
+    const int entry = _fs_model_index_to_entry(index);
+    const quint64 key = _fs_model_display_key(entry, col);
+    auto it = dir->m_display.constFind(key);
+    if (it != dir->m_display.constEnd())
+    {
+        return it.value();
+    }
+
+    const QVariant value = thiz->m_titles[col].func(thiz, dir->m_store, entry);
+
+    /* Metadata may be written any time, so cells waiting for it are not kept. */
+    if (dir->m_store.hasMeta(entry))
+    {
+        dir->m_display.insert(key, value);
+    }
+    return value;
 }
 
 static QVariant _fs_model_data_decoration(const qfcmd::FileSystemModel* thiz,
@@ -37,119 +250,237 @@ static QVariant _fs_model_data_decoration(const qfcmd::FileSystemModel* thiz,
         return QVariant();
     }
 
-    qfcmd::FileSystemModelNode* node = _fs_mode_index_to_node(index);
-    Q_ASSERT(node != nullptr);
+    qfcmd::FileSystemModelNode* dir = _fs_model_index_to_dir(index);
+    Q_ASSERT(dir != nullptr);
+
+    const int entry = _fs_model_index_to_entry(index);
+    const QPixmap pixmap = thiz->thumbnail(dir, entry);
+    if (!pixmap.isNull())
+    {
+        return QIcon(pixmap);
+    }
 
-    return node->m_icon;
+    return dir->m_store.icon(entry);
 }
 
-static QVariant _fs_model_node_get_name(qfcmd::FileSystemModelNode* node)
+static QVariant _fs_model_node_get_name(const qfcmd::FileSystemModel*, const qfcmd::DirStore& store, int entry)
 {
-    return node->m_name;
+    return store.name(entry);
 }
 
-static QVariant _fs_model_node_get_ext(qfcmd::FileSystemModelNode* node)
+static QVariant _fs_model_node_get_ext(const qfcmd::FileSystemModel*, const qfcmd::DirStore& store, int entry)
 {
-    if (node->m_stat.st_mode & QFCMD_FS_S_IFDIR)
+    if (store.isDir(entry))
     {
         return QVariant();
     }
 
-    int dotIndex = node->m_name.lastIndexOf('.');
-    if (dotIndex < 0)
+    const quint32 ext = store.extId(entry);
+    if (ext == 0)
     {
         return QVariant();
     }
 
-    return node->m_name.mid(dotIndex + 1);
+    return store.ext(entry);
 }
 
-static QVariant _fs_model_node_get_size(qfcmd::FileSystemModelNode* node)
+static QVariant _fs_model_node_get_size(const qfcmd::FileSystemModel* thiz, const qfcmd::DirStore& store, int entry)
 {
-    if (node->m_stat.st_mode & QFCMD_FS_S_IFDIR)
+    if (store.isDir(entry))
     {
-        const QString info = QApplication::translate("FileSystemModel", "Dir");
-        return "<" + info + ">";
+        return thiz->m_dirText;
     }
 
-    return (qsizetype)node->m_stat.st_size;
+    if (!store.hasMeta(entry))
+    {
+        return QVariant();
+    }
+
+    return (qsizetype)store.fileSize(entry);
 }
 
-static QVariant _fs_model_node_get_date(qfcmd::FileSystemModelNode* node)
+static QVariant _fs_model_node_get_date(const qfcmd::FileSystemModel* thiz, const qfcmd::DirStore& store, int entry)
 {
-    return QDateTime::fromSecsSinceEpoch(node->m_stat.st_mtime).toString("yyyy-MM-dd HH:mm:ss");
+    if (!store.hasMeta(entry))
+    {
+        return QVariant();
+    }
+
+    return _fs_model_format_date(thiz->m_dateFormatter, store.mtime(entry));
 }
 
-static qfcmd::FileSystemModelNode* _fs_model_get_scheme_node(
-    qfcmd::FileSystemModel* thiz, const QUrl& url)
+/**
+ * @brief Rebuild the entry to row lookup table of \p node.
+ */
+static void _fs_model_node_update_row_of(qfcmd::FileSystemModelNode* node)
 {
-    qfcmd::FileSystemModelNode* root = thiz->m_root;
-    const QString scheme = url.scheme() + "://";
-
-    auto it = root->m_children.find(scheme);
-    if (it != root->m_children.end())
+    node->m_rowsVersion++;
+    node->m_rowOf.fill(-1, node->m_store.size());
+    for (int row = 0; row < node->m_visibleChildren.size(); row++)
     {
-        return it.value();
+        node->m_rowOf[node->m_visibleChildren[row]] = row;
     }
-
-    qfcmd::FileSystemModelNode* node = new qfcmd::FileSystemModelNode(root);
-    node->m_name = scheme;
-    root->m_children.insert(scheme, node);
-    root->m_visibleChildren.append(scheme);
-    return node;
 }
 
-static bool _fs_model_compare_stat(const qfcmd_fs_stat_t& a, const qfcmd_fs_stat_t& b)
+/**
+ * @brief Get the collator names are sorted with.
+ *
+ * Digits compare by value, so `file10` comes after `file9`.
+ */
+static QCollator _fs_model_collator()
 {
-    return a.st_mode == b.st_mode && a.st_size == b.st_size && a.st_mtime == b.st_mtime;
+    QCollator collator;
+    collator.setNumericMode(true);
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+    return collator;
 }
 
-static QIcon _fs_model_get_local_file_icon_direct_read(const QUrl &url, const qfcmd_fs_stat_t& stat)
+/**
+ * @brief Switch \p node to a new listing.
+ *
+ * Rows that no longer exist must be removed from #m_visibleChildren before
+ * calling this. Rows stay the same, only entry index change.
+ *
+ * @param[in] node - The directory node.
+ * @param[in] delta - Difference between current listing and \p store.
+ * @param[in] store - The new listing.
+ */
+static void _fs_model_node_switch_store(qfcmd::FileSystemModelNode* node,
+                                        const qfcmd::DirStoreDelta& delta,
+                                        const qfcmd::DirStore& store)
 {
-    const uint64_t maxSize = 131072;
-    if (stat.st_size > maxSize)
+    /* Nothing moves, only rows for the new entries are missing. */
+    if (delta.appendOnly)
+    {
+        node->m_store = store;
+        node->m_rowOf.resize(store.size(), -1);
+        node->m_accepted.resize(store.size());
+        return;
+    }
+
+    /* Cells are keyed by entry, which moves. */
+    node->m_display.clear();
+
+    QHash<int, qfcmd::FileSystemModelNode*> children;
+    for (qfcmd::FileSystemModelNode* child : node->m_children)
     {
-        return QIcon();
+        child->m_entry = delta.oldToNew[child->m_entry];
+        if (child->m_entry < 0)
+        {
+            child->m_parent = nullptr;
+            delete child;
+            continue;
+        }
+        children.insert(child->m_entry, child);
     }
+    node->m_children.swap(children);
 
-    const QString path = url.toLocalFile();
-    QFile file(path);
-    if (!file.open(QIODevice::ReadOnly))
+    for (int& entry : node->m_visibleChildren)
     {
-        return QIcon();
+        entry = delta.oldToNew[entry];
     }
 
-    QImageReader imgReader(&file);
-    if (!imgReader.canRead())
+    /* Names decide, so kept entries keep their result and new ones are tested on insert. */
+    QBitArray accepted(store.size());
+    for (int entry = 0; entry < node->m_accepted.size(); entry++)
     {
-        return QIcon();
+        if (node->m_accepted.testBit(entry) && delta.oldToNew[entry] >= 0)
+        {
+            accepted.setBit(delta.oldToNew[entry]);
+        }
     }
+    node->m_accepted.swap(accepted);
 
-    QImage image;
-    if (!imgReader.read(&image))
+    /* Names of entries do not change, keep their keys and only make new ones. */
+    if (!node->m_sortKeys.empty())
     {
-        return QIcon();
+        QVector<int> newToOld(store.size(), -1);
+        for (int entry = 0; entry < (int)node->m_sortKeys.size(); entry++)
+        {
+            if (delta.oldToNew[entry] >= 0)
+            {
+                newToOld[delta.oldToNew[entry]] = entry;
+            }
+        }
+
+        const QCollator collator = _fs_model_collator();
+        std::vector<QCollatorSortKey> keys;
+        keys.reserve(store.size());
+        for (int entry = 0; entry < store.size(); entry++)
+        {
+            const int old = newToOld[entry];
+            keys.push_back(old >= 0 ? node->m_sortKeys[old] : collator.sortKey(store.name(entry)));
+        }
+        node->m_sortKeys.swap(keys);
     }
 
-    QPixmap pix = QPixmap::fromImage(image, Qt::ThresholdDither | Qt::AutoColor);
-    return QIcon(pix);
+    node->m_store = store;
+    _fs_model_node_update_row_of(node);
 }
 
-static qfcmd::FileSystemModelNode* _fs_model_get_authority_node(qfcmd::FileSystemModelNode* schemeNode, const QUrl &url)
+/**
+ * @brief Append \p entries as rows at the end of \p node.
+ */
+static void _fs_model_node_append_rows(qfcmd::FileSystemModelNode* node, const QVector<int>& entries)
 {
-    const QString authority = url.authority();
-    auto it = schemeNode->m_children.find(authority);
-    if (it != schemeNode->m_children.end())
+    node->m_rowsVersion++;
+    for (int entry : entries)
     {
-        return it.value();
+        node->m_rowOf[entry] = node->m_visibleChildren.size();
+        node->m_visibleChildren.append(entry);
+    }
+}
+
+/**
+ * @brief Add \p node and all its descendants to \p nodes.
+ */
+static void _fs_model_node_collect(const qfcmd::FileSystemModelNode* node,
+                                   QSet<const qfcmd::FileSystemModelNode*>& nodes)
+{
+    nodes.insert(node);
+    for (const qfcmd::FileSystemModelNode* child : node->m_children)
+    {
+        _fs_model_node_collect(child, nodes);
     }
+}
 
-    qfcmd::FileSystemModelNode* authorityNode = new qfcmd::FileSystemModelNode(schemeNode);
-    authorityNode->m_name = authority;
-    schemeNode->m_children.insert(authority, authorityNode);
-    schemeNode->m_visibleChildren.append(authority);
+/**
+ * @brief Get memory held by \p node and all its descendants.
+ * @see MemoryConsumer::memoryUsage
+ */
+static qint64 _fs_model_node_usage(const qfcmd::FileSystemModelNode* node, QSet<const void*>* counted)
+{
+    qint64 usage = sizeof(*node) + node->m_name.capacity() * sizeof(QChar)
+        + (node->m_visibleChildren.capacity() + node->m_rowOf.capacity()) * sizeof(int)
+        + node->m_children.capacity() * (sizeof(int) + sizeof(void*)) * 2
+        + (qint64)node->m_sortKeys.capacity() * (sizeof(QCollatorSortKey) + FS_MODEL_SORT_KEY_BYTES)
+        + node->m_accepted.size() / 8
+        + (qint64)node->m_display.capacity() * FS_MODEL_DISPLAY_CELL_BYTES
+        + node->m_store.memoryUsage(counted);
+
+    for (const qfcmd::FileSystemModelNode* child : node->m_children)
+    {
+        usage += _fs_model_node_usage(child, counted);
+    }
+    return usage;
+}
 
-    return authorityNode;
+/**
+ * @brief Merge ascending \p rows into contiguous ranges.
+ */
+static QVector<qfcmd::FileSystemModelRowRange> _fs_model_make_row_ranges(const QVector<int>& rows)
+{
+    QVector<qfcmd::FileSystemModelRowRange> ranges;
+    for (int row : rows)
+    {
+        if (!ranges.isEmpty() && ranges.last().last + 1 == row)
+        {
+            ranges.last().last = row;
+            continue;
+        }
+        ranges.append({ row, row });
+    }
+    return ranges;
 }
 
 static QStringList _fs_model_split_path(const QUrl& url)
@@ -166,6 +497,34 @@ static QStringList _fs_model_split_path(const QUrl& url)
     return paths;
 }
 
+static qfcmd::FileSystemModelNode* _fs_model_find_child(const qfcmd::FileSystemModelNode* parent,
+                                                        const QString& name)
+{
+    const int entry = parent->m_store.find(name);
+    return entry < 0 ? nullptr : parent->m_children.value(entry, nullptr);
+}
+
+/**
+ * @brief Find the node of \p url without creating it.
+ * @return The node, or nullptr if it does not exist.
+ */
+static qfcmd::FileSystemModelNode* _fs_model_find_node(const qfcmd::FileSystemModel* thiz, const QUrl& url)
+{
+    qfcmd::FileSystemModelNode* node = _fs_model_find_child(thiz->m_root, url.scheme() + "://");
+    if (node != nullptr)
+    {
+        node = _fs_model_find_child(node, url.authority());
+    }
+
+    const QStringList paths = _fs_model_split_path(url);
+    for (int i = 0; node != nullptr && i < paths.size(); i++)
+    {
+        node = _fs_model_find_child(node, paths[i]);
+    }
+
+    return node;
+}
+
 static QUrl _fs_model_append_path(const QUrl& url, const QString& path)
 {
     QString url_path = url.path();
@@ -181,291 +540,1562 @@ static QUrl _fs_model_append_path(const QUrl& url, const QString& path)
     return new_url;
 }
 
-qfcmd::IconProvider::IconProvider()
+/**
+ * @brief Get the number of chunks _fs_model_parallel_for() splits \p count items in.
+ */
+static int _fs_model_chunk_count(int count)
 {
+    return qBound(1, count / FS_MODEL_PARALLEL_SORT_MIN, qMax(1, QThread::idealThreadCount()));
 }
 
-QIcon qfcmd::IconProvider::icon(const QUrl &url, const qfcmd_fs_stat_t& stat)
+/**
+ * @brief Get the first item of chunk \p chunk, or \p count for \p chunks.
+ */
+static int _fs_model_chunk_begin(int count, int chunks, int chunk)
 {
-    QIcon icon;
-    const QString scheme = url.scheme();
-    if (scheme == "file")
+    return (int)((qint64)count * chunk / chunks);
+}
+
+/**
+ * @brief Call \p fn for every chunk of \p count items, and wait for all of them.
+ *
+ * The first chunk runs on the calling thread, the others on the CPU pool.
+ *
+ * @param[in] count - Number of items.
+ * @param[in] fn - Called with the chunk number and the items of the chunk.
+ */
+static void _fs_model_parallel_for(int count, const std::function<void(int, int, int)>& fn)
+{
+    const int chunks = _fs_model_chunk_count(count);
+    QSemaphore done;
+    for (int i = 1; i < chunks; i++)
     {
-        icon = getNativeIcon(url, stat);
+        const int begin = _fs_model_chunk_begin(count, chunks, i);
+        const int end = _fs_model_chunk_begin(count, chunks, i + 1);
+        qfcmd::TaskScheduler::post(&done, qfcmd::TaskScheduler::POOL_CPU, qfcmd::TaskScheduler::PRIORITY_HIGH,
+                                   [&fn, &done, i, begin, end]() {
+            fn(i, begin, end);
+            done.release();
+        });
     }
 
-    if (!icon.isNull())
+    fn(0, 0, _fs_model_chunk_begin(count, chunks, 1));
+    done.acquire(chunks - 1);
+}
+
+/**
+ * @brief Make collation keys for entries of \p node that have none yet.
+ *
+ * Keys of existing entries are carried over by _fs_model_node_switch_store(),
+ * so a refresh only pays for its new names.
+ */
+static void _fs_model_node_update_keys(qfcmd::FileSystemModelNode* node)
+{
+    const int first = (int)node->m_sortKeys.size();
+    const int count = node->m_store.size() - first;
+    if (count <= 0)
     {
-        return icon;
+        return;
     }
 
-    if (stat.st_mode & QFCMD_FS_S_IFDIR)
+    const qfcmd::DirStore store = node->m_store;
+    std::vector<std::vector<QCollatorSortKey>> parts(_fs_model_chunk_count(count));
+    _fs_model_parallel_for(count, [&store, &parts, first](int chunk, int begin, int end) {
+        /* Each thread has its own collator, they are not thread safe. */
+        const QCollator collator = _fs_model_collator();
+        std::vector<QCollatorSortKey>& part = parts[chunk];
+        part.reserve(end - begin);
+        for (int i = begin; i < end; i++)
+        {
+            part.push_back(collator.sortKey(store.name(first + i)));
+        }
+    });
+
+    node->m_sortKeys.reserve(store.size());
+    for (std::vector<QCollatorSortKey>& part : parts)
     {
-        return QFileIconProvider::icon(QFileIconProvider::Folder);
+        for (QCollatorSortKey& key : part)
+        {
+            node->m_sortKeys.push_back(std::move(key));
+        }
     }
-    return QFileIconProvider::icon(QFileIconProvider::File);
 }
 
-QIcon qfcmd::IconProvider::getNativeIcon(const QUrl &url, const qfcmd_fs_stat_t &stat)
+/**
+ * @brief Give every extension of \p entries a rank in collation order.
+ *
+ * There are few distinct extensions, so all of them are ranked again
+ * whenever one is new, and sorting compares ranks instead of strings.
+ */
+static void _fs_model_update_ext_ranks(qfcmd::FileSystemModel* thiz, const qfcmd::DirStore& store,
+                                       const QVector<int>& entries)
 {
-    QIcon icon = _fs_model_get_local_file_icon_direct_read(url, stat);
-    if (!icon.isNull())
+    bool grown = false;
+    for (int entry : entries)
     {
-        return icon;
+        const quint32 ext = store.extId(entry);
+        if (!thiz->m_extRanks.contains(ext))
+        {
+            thiz->m_extRanks.insert(ext, 0);
+            grown = true;
+        }
+    }
+    if (!grown)
+    {
+        return;
     }
 
-    const QString path = url.toLocalFile();
-    const QFileInfo info(path);
-    return QFileIconProvider::icon(info);
-}
-
-qfcmd::FileSystemModelNode::FileSystemModelNode(FileSystemModelNode* parent)
-{
-    m_parent = parent;
-    memset(&m_stat, 0, sizeof(m_stat));
+    QVector<quint32> exts = thiz->m_extRanks.keys();
+    std::sort(exts.begin(), exts.end(), [thiz](quint32 a, quint32 b) {
+        return thiz->m_collator.compare(qfcmd::StringInterner::get(a), qfcmd::StringInterner::get(b)) < 0;
+    });
+    for (int i = 0; i < exts.size(); i++)
+    {
+        thiz->m_extRanks[exts[i]] = i;
+    }
 }
 
-qfcmd::FileSystemModelNode::~FileSystemModelNode()
+/**
+ * @brief Prepare sorting \p entries of \p node.
+ * @param[in] thiz - The model.
+ * @param[in] node - The directory node.
+ * @param[in] entries - Entries about to be sorted or placed.
+ * @param[out] ctx - Sort context, orders by entry index if rows are in listing order.
+ * @return false if rows are in listing order.
+ */
+static bool _fs_model_sort_context(qfcmd::FileSystemModel* thiz, qfcmd::FileSystemModelNode* node,
+                                   const QVector<int>& entries, qfcmd::FileSystemModelSortContext* ctx)
 {
-    /* Remove link for parent. */
-    if (m_parent != nullptr)
+    ctx->store = &node->m_store;
+    ctx->keys = &node->m_sortKeys;
+    ctx->extRanks = &thiz->m_extRanks;
+    ctx->type = qfcmd::FileSystemModel::TITLE_NAME;
+    ctx->descending = thiz->m_sortOrder == Qt::DescendingOrder;
+    ctx->sorted = thiz->m_sortColumn >= 0;
+    if (!ctx->sorted)
     {
-        Q_ASSERT(m_parent->m_children.size() == m_parent->m_visibleChildren.size());
+        return false;
+    }
 
-        m_parent->m_children.remove(m_name);
-        m_parent->m_visibleChildren.removeOne(m_name);
+    ctx->type = thiz->m_titles[thiz->m_sortColumn].type;
+    if (ctx->type == qfcmd::FileSystemModel::TITLE_EXT)
+    {
+        _fs_model_update_ext_ranks(thiz, node->m_store, entries);
+    }
+    _fs_model_node_update_keys(node);
+    return true;
+}
 
-        Q_ASSERT(m_parent->m_children.size() == m_parent->m_visibleChildren.size());
+static qfcmd::FileSystemModelSortItem _fs_model_sort_item(const qfcmd::FileSystemModelSortContext& ctx, int entry)
+{
+    const qfcmd::DirStore& store = *ctx.store;
 
-        m_parent = nullptr;
+    qfcmd::FileSystemModelSortItem item;
+    item.entry = entry;
+    item.group = store.isDir(entry) ? 0 : 1;
+    if (!ctx.sorted)
+    {
+        item.primary = 0;
+        return item;
     }
 
-    Q_ASSERT(m_children.size() == m_visibleChildren.size());
-
-    while (!m_visibleChildren.empty())
+    /* Metadata not read yet sorts before any real value. */
+    switch (ctx.type)
     {
-        const QString childName = m_visibleChildren.takeLast();
+    case qfcmd::FileSystemModel::TITLE_EXT:
+        item.primary = ctx.extRanks->value(store.extId(entry), 0);
+        break;
 
-        auto it_child = m_children.find(childName);
-        Q_ASSERT(it_child != m_children.end());
-        FileSystemModelNode* child = it_child.value();
-        m_children.erase(it_child);
+    case qfcmd::FileSystemModel::TITLE_SIZE:
+        item.primary = item.group == 0 ? 0 : store.hasMeta(entry) ? (qint64)store.fileSize(entry) : -1;
+        break;
 
-        child->m_parent = nullptr;
-        delete child;
+    case qfcmd::FileSystemModel::TITLE_DATE:
+        item.primary = store.hasMeta(entry) ? (qint64)store.mtime(entry) : -1;
+        break;
+
+    default:
+        item.primary = 0;
+        break;
     }
+
+    return item;
 }
 
-void qfcmd::FileSystemModelWorker::doFetch(const QUrl &url)
+static bool _fs_model_sort_less(const qfcmd::FileSystemModelSortContext& ctx,
+                                const qfcmd::FileSystemModelSortItem& a, const qfcmd::FileSystemModelSortItem& b)
 {
-    VFS fs;
-
-    FileSystem::FileInfoEntry entry;
-    int ret = fs.ls(url, &entry);
-
-    FileInfoMap records;
-    for (auto it = entry.begin(); it != entry.end(); it++)
+    if (!ctx.sorted)
     {
-        const QString name = it.key();
-        const QUrl item_url = _fs_model_append_path(url, name);
-
-        FileInfo info;
-        info.info = it.value();
-        info.icon = m_iconProvider.icon(item_url, info.info);
+        return a.entry < b.entry;
+    }
 
-        records.insert(name, info);
+    /* Directories come first in both orders. */
+    if (a.group != b.group)
+    {
+        return a.group < b.group;
+    }
+    if (a.primary != b.primary)
+    {
+        return ctx.descending ? a.primary > b.primary : a.primary < b.primary;
     }
 
-    emit fetchReady(url, ret, records);
+    const int cmp = (*ctx.keys)[a.entry].compare((*ctx.keys)[b.entry]);
+    if (cmp != 0)
+    {
+        return ctx.descending ? cmp > 0 : cmp < 0;
+    }
+    return a.entry < b.entry;
 }
 
-qfcmd::FileSystemModelNode* qfcmd::FileSystemModel::getNode(const QUrl &url)
+/**
+ * @brief Sort \p entries, in chunks on several threads for large directories.
+ */
+static void _fs_model_sort_entries(const qfcmd::FileSystemModelSortContext& ctx, QVector<int>& entries)
 {
-    const QStringList paths = _fs_model_split_path(url);
+    const int count = entries.size();
+    QVector<qfcmd::FileSystemModelSortItem> items(count);
+    qfcmd::FileSystemModelSortItem* data = items.data();
+    for (int i = 0; i < count; i++)
+    {
+        data[i] = _fs_model_sort_item(ctx, entries[i]);
+    }
 
-    qfcmd::FileSystemModelNode* schemeNode = _fs_model_get_scheme_node(this, url);
-    qfcmd::FileSystemModelNode* authorityNode = _fs_model_get_authority_node(schemeNode, url);
+    auto less = [&ctx](const qfcmd::FileSystemModelSortItem& a, const qfcmd::FileSystemModelSortItem& b) {
+        return _fs_model_sort_less(ctx, a, b);
+    };
+    _fs_model_parallel_for(count, [data, &less](int, int begin, int end) {
+        std::sort(data + begin, data + end, less);
+    });
 
-    qfcmd::FileSystemModelNode* node = authorityNode;
-    for (qsizetype i = 0; i < paths.size(); i++)
+    /* Merge neighbouring chunks until one is left. */
+    const int chunks = _fs_model_chunk_count(count);
+    for (int width = 1; width < chunks; width *= 2)
     {
-        const QString name = paths[i];
-        auto it = node->m_children.find(name);
-        if (it != node->m_children.end())
+        for (int i = 0; i + width < chunks; i += width * 2)
         {
-            node = it.value();
-            continue;
+            std::inplace_merge(data + _fs_model_chunk_begin(count, chunks, i),
+                               data + _fs_model_chunk_begin(count, chunks, i + width),
+                               data + _fs_model_chunk_begin(count, chunks, qMin(i + width * 2, chunks)),
+                               less);
         }
-
-        qfcmd::FileSystemModelNode* new_node = new qfcmd::FileSystemModelNode(node);
-        new_node->m_name = paths[i];
-        new_node->m_stat.st_mode |= QFCMD_FS_S_IFDIR;
-        node->m_children.insert(name, new_node);
-        node->m_visibleChildren.append(name);
-        node = new_node;
     }
 
-    Q_ASSERT(node->m_parent != nullptr);
-    Q_ASSERT(node->m_parent->m_children.size() == node->m_parent->m_visibleChildren.size());
+    for (int i = 0; i < count; i++)
+    {
+        entries[i] = data[i].entry;
+    }
+}
 
-    return node;
+/**
+ * @brief Get the row \p entry belongs at among rows of \p node.
+ */
+static int _fs_model_sort_find_row(const qfcmd::FileSystemModelSortContext& ctx,
+                                   const qfcmd::FileSystemModelNode* node, int entry)
+{
+    const qfcmd::FileSystemModelSortItem item = _fs_model_sort_item(ctx, entry);
+    auto it = std::upper_bound(node->m_visibleChildren.begin(), node->m_visibleChildren.end(), item,
+                               [&ctx](const qfcmd::FileSystemModelSortItem& value, int other) {
+        return _fs_model_sort_less(ctx, value, _fs_model_sort_item(ctx, other));
+    });
+    return (int)(it - node->m_visibleChildren.begin());
 }
 
-QModelIndex qfcmd::FileSystemModel::getIndex(FileSystemModelNode *node)
+/**
+ * @brief Sort \p entries and merge them into \p rows.
+ */
+static void _fs_model_merge_rows(const qfcmd::FileSystemModelSortContext& ctx, QVector<int>& rows,
+                                 const QVector<int>& entries)
 {
-    qfcmd::FileSystemModelNode* parentNode = node ? node->m_parent : nullptr;
-    if (parentNode == m_root || parentNode == nullptr)
+    QVector<int> sorted = entries;
+    _fs_model_sort_entries(ctx, sorted);
+
+    /* Rows in listing order get new entries at the end, as when they arrive. */
+    if (!ctx.sorted)
     {
-        return QModelIndex();
+        rows += sorted;
+        return;
     }
 
-    int visualRow = parentNode->m_visibleChildren.indexOf(node->m_name);
-    Q_ASSERT(visualRow >= 0);
-
-    return createIndex(visualRow, 0, node);
+    QVector<int> merged;
+    merged.reserve(rows.size() + sorted.size());
+    std::merge(rows.begin(), rows.end(), sorted.begin(), sorted.end(),
+               std::back_inserter(merged), [&ctx](int a, int b) {
+        return _fs_model_sort_less(ctx, _fs_model_sort_item(ctx, a), _fs_model_sort_item(ctx, b));
+    });
+    rows.swap(merged);
 }
 
-QUrl qfcmd::FileSystemModel::getUrl(const FileSystemModelNode* node) const
+/**
+ * @brief Check if \p node and every directory above it have a row.
+ */
+static bool _fs_model_node_is_shown(const qfcmd::FileSystemModelNode* node)
 {
-    QList<const FileSystemModelNode*> nodeChain;
-
-    const FileSystemModelNode* tmpNode = node;
-    for (; tmpNode->m_parent != nullptr; tmpNode = tmpNode->m_parent)
+    for (; node->m_parent != nullptr; node = node->m_parent)
     {
-        nodeChain.prepend(tmpNode);
+        if (node->m_parent->m_rowOf[node->m_entry] < 0)
+        {
+            return false;
+        }
     }
+    return true;
+}
 
-    /*
-     * [0]: scheme
-     * [1]: authority
-     */
-    Q_ASSERT(nodeChain.size() >= 2);
-
-    QString fullPath = nodeChain.takeFirst()->m_name;
-    fullPath += nodeChain.takeFirst()->m_name + "/";
-
-    size_t cnt = 0;
-    while (!nodeChain.isEmpty())
+/**
+ * @brief Mark entries of \p store whose name contains the pattern of \p matcher.
+ */
+static QBitArray _fs_model_match_names(const qfcmd::DirStore& store, const qfcmd::NameMatcher& matcher)
+{
+    const int count = store.size();
+    QBitArray matched(count, matcher.isEmpty());
+    if (matcher.isEmpty())
     {
-        fullPath += nodeChain.takeFirst()->m_name + "/";
-        cnt++;
+        return matched;
     }
 
-    /* If path empty, the last slash should not remove */
-    if (cnt != 0 && !(node->m_stat.st_mode & QFCMD_FS_S_IFDIR))
+    if (!matcher.isAscii())
     {
-        fullPath.chop(1);
+        for (int entry = 0; entry < count; entry++)
+        {
+            int len = 0;
+            const char* name = store.nameUtf8(entry, &len);
+            matched.setBit(entry, matcher.matches(name, len));
+        }
+        return matched;
     }
 
-    return QUrl(fullPath);
+    /* Names are back to back in entry order, search all of them in one pass. */
+    int bytes = 0;
+    const char* names = store.namesUtf8(&bytes);
+    int entry = 0;
+    qsizetype end = 0;
+    for (qsizetype pos = matcher.indexIn(names, bytes); pos >= 0; pos = matcher.indexIn(names, bytes, pos))
+    {
+        for (; pos >= end; entry++)
+        {
+            int len = 0;
+            end = store.nameUtf8(entry, &len) - names + len;
+        }
+
+        /* A hit across the end of a name is not in it, look again right after its start. */
+        if (pos + matcher.size() > end)
+        {
+            pos++;
+            continue;
+        }
+        matched.setBit(entry - 1);
+        pos = end;
+    }
+    return matched;
 }
 
-void qfcmd::FileSystemModel::clearChildren(FileSystemModelNode *node)
+/**
+ * @brief Test \p entries of \p node against the name filter and keep the result.
+ */
+static void _fs_model_node_accept(const qfcmd::FileSystemModel* thiz, qfcmd::FileSystemModelNode* node,
+                                  const QVector<int>& entries)
 {
-    QModelIndex nodeIndex = getIndex(node);
-
-    beginRemoveRows(nodeIndex, 0, node->m_visibleChildren.size());
-    while (node->m_children.size() != 0)
+    node->m_accepted.resize(node->m_store.size());
+    for (int entry : entries)
     {
-        auto it = node->m_children.begin();
-        qfcmd::FileSystemModelNode* child = it.value();
-        delete child;
+        node->m_accepted.setBit(entry, thiz->m_nameFilter.accepts(node->m_store, entry));
     }
-    endRemoveRows();
 }
 
-void qfcmd::FileSystemModel::handleFetchResult(const QUrl& url, int ret, const FileSystemModelWorker::FileInfoMap& entry)
+/**
+ * @brief Get the entry of \p node that leads to \p root.
+ * @return Entry index, or -1 if \p root is not below \p node.
+ */
+static int _fs_model_node_pinned_entry(const qfcmd::FileSystemModelNode* root, const qfcmd::FileSystemModelNode* node)
 {
-    FileSystemModelNode* node = getNode(url);
-    Q_ASSERT(node->m_children.size() == node->m_visibleChildren.size());
-
-    /* Error occur, clear clildren. */
-    if (ret < 0)
+    for (; root != nullptr && root->m_parent != nullptr; root = root->m_parent)
     {
-        clearChildren(node);
-        return;
+        if (root->m_parent == node)
+        {
+            return root->m_entry;
+        }
     }
+    return -1;
+}
 
-    Q_ASSERT(node->m_children.size() == node->m_visibleChildren.size());
-
-    FileSystemModelWorker::FileInfoMap entryCopy = entry;
-    const QModelIndex nodeIndex = getIndex(node);
-
-    for (auto it = node->m_children.begin(); it != node->m_children.end(); )
+/**
+ * @brief Get entries of \p entries that the filters of \p node let through.
+ *
+ * Entries must have been tested by _fs_model_node_accept().
+ */
+static QVector<int> _fs_model_filter_entries(const qfcmd::FileSystemModel* thiz,
+                                             const qfcmd::FileSystemModelNode* node, const QVector<int>& entries)
+{
+    const qfcmd::FileSystemModelNode* root = _fs_model_find_node(thiz, thiz->m_rootUrl);
+    const bool quick = !thiz->m_quickFilter.isEmpty() && root == node;
+    if (!quick && thiz->m_nameFilter.isEmpty())
     {
-        const QString childName = it.key();
-        FileSystemModelNode* child = it.value();
+        return entries;
+    }
 
-        auto entry_it = entryCopy.find(childName);
+    /* Leaving the directory the user is in would leave the view without a root. */
+    const int pinned = _fs_model_node_pinned_entry(root, node);
 
-        /* If name not found in entry, this child should be delete. */
-        if (entry_it == entryCopy.end())
+    QVector<int> accepted;
+    for (int entry : entries)
+    {
+        if (!node->m_accepted.testBit(entry) && entry != pinned)
         {
-            int row = node->m_visibleChildren.indexOf(childName);
-            Q_ASSERT(row >= 0);
-
-            beginRemoveRows(nodeIndex, row, row);
-            {
-                /*
-                 * The following delete step automatically remove child from tree,
-                 * so we need to move iterator to next node, without delete it.
-                 */
-                it++;
-                delete child;
-            }
-            endRemoveRows();
-            Q_ASSERT(node->m_children.size() == node->m_visibleChildren.size());
-
             continue;
         }
 
-        /* Child found, check if it is changed. */
-        const qfcmd_fs_stat_t info = entry_it.value().info;
-        if (!_fs_model_compare_stat(info, child->m_stat))
+        int len = 0;
+        const char* name = node->m_store.nameUtf8(entry, &len);
+        if (quick && !thiz->m_quickFilter.matches(name, len))
         {
-            child->m_stat = info;
-            child->m_icon = entry_it.value().icon;
-            const QModelIndex childIndex = getIndex(child);
-            emit dataChanged(childIndex, childIndex, {Qt::DisplayRole});
+            continue;
         }
-
-        /* Remove from entry. */
-        entryCopy.erase(entry_it);
-        it++;
+        accepted.append(entry);
     }
+    return accepted;
+}
 
-    Q_ASSERT(node->m_children.size() == node->m_visibleChildren.size());
+/**
+ * @brief Get rows of \p node after the name filter changed.
+ *
+ * Rows that still pass keep their order, entries that pass now are merged in.
+ */
+static QVector<int> _fs_model_node_refilter(qfcmd::FileSystemModel* thiz, qfcmd::FileSystemModelNode* node)
+{
+    const int pinned = _fs_model_node_pinned_entry(_fs_model_find_node(thiz, thiz->m_rootUrl), node);
 
-    if (entryCopy.size() == 0)
+    QVector<int> rows;
+    for (int entry : node->m_visibleChildren)
     {
-        return;
+        if (node->m_accepted.testBit(entry) || entry == pinned)
+        {
+            rows.append(entry);
+        }
     }
 
-    /* Now everything left should be append. */
-    const int beginRow = node->m_children.size();
-    const int endRow = beginRow + entryCopy.size() - 1;
-    beginInsertRows(nodeIndex, beginRow, endRow);
-    for (auto it = entryCopy.begin(); it != entryCopy.end(); it++)
+    QVector<int> hidden;
+    for (int entry = 0; entry < node->m_store.size(); entry++)
     {
-        const QString new_node_name = it.key();
-        qfcmd::FileSystemModelNode* new_node = new qfcmd::FileSystemModelNode(node);
-        node->m_children.insert(new_node_name, new_node);
-        node->m_visibleChildren.append(new_node_name);
-        new_node->m_name = new_node_name;
-        new_node->m_stat = it.value().info;
-        new_node->m_icon = it.value().icon;
+        if (node->m_rowOf[entry] < 0)
+        {
+            hidden.append(entry);
+        }
     }
-    endInsertRows();
+    const QVector<int> shown = _fs_model_filter_entries(thiz, node, hidden);
 
-    Q_ASSERT(node->m_children.size() == node->m_visibleChildren.size());
+    qfcmd::FileSystemModelSortContext ctx;
+    _fs_model_sort_context(thiz, node, shown, &ctx);
+    _fs_model_merge_rows(ctx, rows, shown);
+    return rows;
 }
 
-qfcmd::FileSystemModel::FileSystemModel(QObject *parent)
-    : QAbstractItemModel(parent)
+/**
+ * @brief Get rows of \p node whose name contains the pattern of \p matcher, testing every entry.
+ *
+ * Rows shown now keep their order, entries shown again are merged in.
+ */
+static QVector<int> _fs_model_quick_filter_rescan(qfcmd::FileSystemModel* thiz, qfcmd::FileSystemModelNode* node,
+                                                  const qfcmd::NameMatcher& matcher)
 {
-    m_titles = {
+    const QBitArray matched = _fs_model_match_names(node->m_store, matcher);
+
+    QVector<int> rows;
+    for (int entry : node->m_visibleChildren)
+    {
+        if (matched.testBit(entry))
         {
-            TITLE_NAME,
+            rows.append(entry);
+        }
+    }
+
+    QVector<int> shown;
+    for (int entry = 0; entry < node->m_store.size(); entry++)
+    {
+        if (matched.testBit(entry) && node->m_rowOf[entry] < 0 && node->m_accepted.testBit(entry))
+        {
+            shown.append(entry);
+        }
+    }
+
+    qfcmd::FileSystemModelSortContext ctx;
+    _fs_model_sort_context(thiz, node, shown, &ctx);
+    _fs_model_merge_rows(ctx, rows, shown);
+    return rows;
+}
+
+qfcmd::FileSystemModelNode::FileSystemModelNode(FileSystemModelNode* parent, const QString& name, int entry)
+{
+    m_name = name;
+    m_parent = parent;
+    m_entry = entry;
+    m_fetched = false;
+    m_lastUsed = 0;
+    m_rowsVersion = 0;
+
+    if (m_parent != nullptr)
+    {
+        Q_ASSERT(!m_parent->m_children.contains(m_entry));
+        m_parent->m_children.insert(m_entry, this);
+    }
+}
+
+qfcmd::FileSystemModelNode::~FileSystemModelNode()
+{
+    /* Remove link for parent. */
+    if (m_parent != nullptr)
+    {
+        m_parent->m_children.remove(m_entry);
+        m_parent = nullptr;
+    }
+
+    clearChildren();
+}
+
+int qfcmd::FileSystemModelNode::row() const
+{
+    if (m_parent == nullptr)
+    {
+        return -1;
+    }
+    return m_parent->m_rowOf[m_entry];
+}
+
+void qfcmd::FileSystemModelNode::clearChildren()
+{
+    /* Unlink first so children do not touch the table we are iterating. */
+    for (FileSystemModelNode* child : m_children)
+    {
+        child->m_parent = nullptr;
+        delete child;
+    }
+    m_children.clear();
+}
+
+qfcmd::FileSystemModelFetchResult::FileSystemModelFetchResult()
+{
+    type = TYPE_LISTING;
+    generation = 0;
+    ret = 0;
+    partial = false;
+    cached = false;
+}
+
+qfcmd::FileSystemModelWorker::FileSystemModelWorker(QObject* receiver, FileSystemModelFetchQueue* results,
+                                                    QAtomicInt* wakePending,
+                                                    QAtomicInteger<quint64>* metaGeneration,
+                                                    QAtomicInteger<quint64>* sortGeneration)
+{
+    m_receiver = receiver;
+    m_results = results;
+    m_wakePending = wakePending;
+    m_metaGeneration = metaGeneration;
+    m_sortGeneration = sortGeneration;
+}
+
+void qfcmd::FileSystemModelWorker::deliver(const DirCacheResult& listing, quint64 generation) const
+{
+    FileSystemModelFetchResult result;
+    result.generation = generation;
+    result.url = listing.url;
+    result.ret = listing.ret;
+    result.partial = listing.partial;
+    result.cached = listing.cached;
+    result.store = listing.store;
+    result.delta = listing.delta;
+    publish(std::move(result));
+}
+
+void qfcmd::FileSystemModelWorker::doEnrich(const QUrl& url, const qfcmd::DirStore& store,
+                                            const QVector<int>& entries, quint64 generation) const
+{
+    enrich(url, store, entries, generation, m_metaGeneration);
+}
+
+void qfcmd::FileSystemModelWorker::doEnrichForSort(const QUrl& url, const qfcmd::DirStore& store,
+                                                   const QVector<int>& entries, quint64 generation) const
+{
+    const QVector<int> chunk = entries.mid(0, FS_MODEL_SORT_META_CHUNK);
+    enrich(url, store, chunk, generation, m_sortGeneration);
+
+    if (chunk.size() == entries.size() || m_sortGeneration->loadAcquire() != generation)
+    {
+        return;
+    }
+
+    /* Queue the rest behind listings and metadata posted to the strand meanwhile. */
+    const QVector<int> rest = entries.mid(chunk.size());
+    const FileSystemModelWorker* worker = this;
+    TaskScheduler::post(m_receiver, TaskScheduler::POOL_IO, TaskScheduler::PRIORITY_LOW,
+                        [worker, url, store, rest, generation]() {
+        worker->doEnrichForSort(url, store, rest, generation);
+    }, DirCache::strand(url));
+}
+
+void qfcmd::FileSystemModelWorker::enrich(const QUrl& url, const qfcmd::DirStore& store,
+                                          const QVector<int>& entries, quint64 generation,
+                                          const QAtomicInteger<quint64>* current) const
+{
+    VFS fs;
+    DirStoreEnricher enricher(store);
+
+    FileSystemModelFetchResult batch;
+    for (int entry : entries)
+    {
+        /* The view has moved on, these rows are probably off screen. */
+        if (current->loadAcquire() != generation)
+        {
+            break;
+        }
+        if (store.hasMeta(entry))
+        {
+            /* Filled in for another model, this one has yet to repaint it. */
+            batch.entries.append(entry);
+            continue;
+        }
+
+        const QUrl item_url = _fs_model_append_path(url, store.name(entry));
+        qfcmd_fs_stat_t stat;
+        if (fs.stat(item_url, &stat) != 0)
+        {
+            /* Still mark it done, so the view does not ask again and again. */
+            stat = store.stat(entry);
+        }
+        enricher.set(entry, stat, IconRegistry::lookup(item_url, stat));
+
+        batch.entries.append(entry);
+        if (batch.entries.size() >= FS_MODEL_META_BATCH_SIZE)
+        {
+            batch.type = FileSystemModelFetchResult::TYPE_METADATA;
+            batch.url = url;
+            batch.store = store;
+            publish(std::move(batch));
+            batch = FileSystemModelFetchResult();
+        }
+    }
+
+    if (!batch.entries.isEmpty())
+    {
+        batch.type = FileSystemModelFetchResult::TYPE_METADATA;
+        batch.url = url;
+        batch.store = store;
+        publish(std::move(batch));
+    }
+}
+
+void qfcmd::FileSystemModelWorker::doThumbnails(const QUrl& url, const qfcmd::DirStore& store,
+                                                const QVector<int>& entries, quint64 generation) const
+{
+    FileSystemModelFetchResult batch;
+    for (int entry : entries)
+    {
+        /* The view has moved on, these rows are probably off screen. */
+        if (m_metaGeneration->loadAcquire() != generation)
+        {
+            break;
+        }
+
+        const QUrl item_url = _fs_model_append_path(url, store.name(entry));
+        batch.entries.append(entry);
+        batch.thumbnails.append(ThumbnailLoader::load(item_url, store.stat(entry)));
+
+        if (batch.entries.size() >= FS_MODEL_THUMBNAIL_BATCH_SIZE)
+        {
+            batch.type = FileSystemModelFetchResult::TYPE_THUMBNAIL;
+            batch.url = url;
+            batch.store = store;
+            publish(std::move(batch));
+            batch = FileSystemModelFetchResult();
+        }
+    }
+
+    if (!batch.entries.isEmpty())
+    {
+        batch.type = FileSystemModelFetchResult::TYPE_THUMBNAIL;
+        batch.url = url;
+        batch.store = store;
+        publish(std::move(batch));
+    }
+}
+
+void qfcmd::FileSystemModelWorker::publish(FileSystemModelFetchResult&& result) const
+{
+    m_results->push(std::move(result));
+
+    /* One wake up is enough for any number of queued results. */
+    if (m_wakePending->fetchAndStoreOrdered(1) == 0)
+    {
+        QMetaObject::invokeMethod(m_receiver, "handleFetchResults", Qt::QueuedConnection);
+    }
+}
+
+qfcmd::FileSystemModelNode* qfcmd::FileSystemModel::getChildNode(FileSystemModelNode* parent, const QString& name)
+{
+    int entry = parent->m_store.find(name);
+    if (entry < 0)
+    {
+        qfcmd_fs_stat_t stat;
+        memset(&stat, 0, sizeof(stat));
+        stat.st_mode = QFCMD_FS_S_IFDIR;
+
+        DirStoreBuilder builder(parent->m_store);
+        builder.append(name, stat, IconRegistry::typeIcon(stat));
+
+        /* The entry is appended, so index of existing entries stay the same. */
+        parent->m_store = builder.finish();
+        entry = parent->m_store.size() - 1;
+        parent->m_rowOf.append(-1);
+
+        /* Directories on the way to a node must have a row for it to have an index. */
+        insertEntries(parent, { entry }, true);
+    }
+
+    FileSystemModelNode* node = parent->m_children.value(entry, nullptr);
+    if (node == nullptr)
+    {
+        node = new FileSystemModelNode(parent, name, entry);
+    }
+    return node;
+}
+
+qfcmd::FileSystemModelNode* qfcmd::FileSystemModel::getNode(const QUrl &url)
+{
+    const QStringList paths = _fs_model_split_path(url);
+
+    qfcmd::FileSystemModelNode* schemeNode = getChildNode(m_root, url.scheme() + "://");
+    qfcmd::FileSystemModelNode* node = getChildNode(schemeNode, url.authority());
+
+    for (const QString& name : paths)
+    {
+        node = getChildNode(node, name);
+    }
+
+    node->m_lastUsed = MemoryBudget::tick();
+    return node;
+}
+
+QModelIndex qfcmd::FileSystemModel::getIndex(FileSystemModelNode *node) const
+{
+    if (node == nullptr || node->m_parent == nullptr)
+    {
+        return QModelIndex();
+    }
+
+    const int row = node->row();
+    if (row < 0)
+    {
+        return QModelIndex();
+    }
+
+    return createIndex(row, 0, node->m_parent);
+}
+
+QUrl qfcmd::FileSystemModel::getUrl(const FileSystemModelNode* node) const
+{
+    QList<const FileSystemModelNode*> nodeChain;
+
+    const FileSystemModelNode* tmpNode = node;
+    for (; tmpNode->m_parent != nullptr; tmpNode = tmpNode->m_parent)
+    {
+        nodeChain.prepend(tmpNode);
+    }
+
+    /*
+     * [0]: scheme
+     * [1]: authority
+     */
+    Q_ASSERT(nodeChain.size() >= 2);
+
+    QString fullPath = nodeChain.takeFirst()->m_name;
+    fullPath += nodeChain.takeFirst()->m_name + "/";
+
+    while (!nodeChain.isEmpty())
+    {
+        fullPath += nodeChain.takeFirst()->m_name + "/";
+    }
+
+    return QUrl(fullPath);
+}
+
+QUrl qfcmd::FileSystemModel::getUrl(const QModelIndex& index) const
+{
+    if (!index.isValid())
+    {
+        return QUrl();
+    }
+
+    qfcmd::FileSystemModelNode* dir = _fs_model_index_to_dir(index);
+    const int entry = _fs_model_index_to_entry(index);
+
+    /* Scheme and authority are not path components. */
+    if (dir == m_root || dir->m_parent == m_root)
+    {
+        qfcmd::FileSystemModelNode* node = dir->m_children.value(entry, nullptr);
+        return node != nullptr ? getUrl(node) : QUrl();
+    }
+
+    return _fs_model_append_path(getUrl(dir), dir->m_store.name(entry));
+}
+
+void qfcmd::FileSystemModel::clearChildren(FileSystemModelNode *node)
+{
+    /* Views cannot reach rows below a filtered out directory. */
+    const bool hasRows = !node->m_visibleChildren.isEmpty() && _fs_model_node_is_shown(node);
+    if (hasRows)
+    {
+        beginRemoveRows(getIndex(node), 0, node->m_visibleChildren.size() - 1);
+    }
+
+    node->clearChildren();
+    node->m_store = DirStore();
+    node->m_visibleChildren.clear();
+    node->m_rowOf.clear();
+    node->m_accepted.clear();
+    node->m_display.clear();
+    node->m_rowsVersion++;
+    std::vector<QCollatorSortKey>().swap(node->m_sortKeys);
+
+    if (hasRows)
+    {
+        endRemoveRows();
+    }
+}
+
+void qfcmd::FileSystemModel::handleFetchResults()
+{
+    /* Clear first, results pushed from now on wake us up again. */
+    m_fetchWakePending.fetchAndStoreOrdered(0);
+
+    FileSystemModelFetchResult result;
+    while (m_fetchResults.pop(result))
+    {
+        const bool loaded = result.type == FileSystemModelFetchResult::TYPE_LISTING
+            && (!result.partial || result.cached) && result.ret >= 0 && result.generation == m_rootGeneration.loadRelaxed();
+
+        handleFetchResult(result);
+
+        if (loaded)
+        {
+            FileSystemModelNode* node = _fs_model_find_node(this, result.url);
+            if (node != nullptr)
+            {
+                requestSortMeta(node);
+            }
+            emit directoryLoaded(result.url.toLocalFile());
+        }
+    }
+
+    /* Rows that got metadata move once for all results drained. */
+    const QHash<QUrl, FileSystemModelMetaRequest> resort = std::move(m_resortWanted);
+    m_resortWanted.clear();
+    for (const FileSystemModelMetaRequest& request : resort)
+    {
+        FileSystemModelNode* node = _fs_model_find_node(this, request.url);
+        if (node != nullptr && node->m_store.version() == request.store.version())
+        {
+            resortEntries(node, request.entries);
+        }
+    }
+}
+
+void qfcmd::FileSystemModel::requestFetch(const QUrl& url, const FileSystemModelNode* node, bool force,
+                                          TaskScheduler::Priority priority)
+{
+    if (!m_fetches.begin(url, force))
+    {
+        return;
+    }
+
+    /* A directory not visited yet has no listing to diff against. */
+    const DirStore base = node != nullptr ? node->m_store : DirStore();
+    const quint64 generation = m_rootGeneration.loadRelaxed();
+    const FileSystemModelWorker* worker = m_worker;
+
+    DirCache::fetch(url, this, base, force, priority, [worker, generation](const DirCacheResult& listing) {
+        worker->deliver(listing, generation);
+    });
+}
+
+void qfcmd::FileSystemModel::flushMetaRequests()
+{
+    m_metaFlushPending = false;
+
+    /* Supersede requests the worker has not finished. */
+    const quint64 generation = m_metaGeneration.fetchAndAddOrdered(1) + 1;
+    const FileSystemModelWorker* worker = m_worker;
+    for (const FileSystemModelMetaRequest& request : m_metaWanted)
+    {
+        /* Same strand as listings, both write the listing arena. */
+        const QUrl url = request.url;
+        const DirStore store = request.store;
+        const QVector<int> entries = request.entries;
+        TaskScheduler::post(this, TaskScheduler::POOL_IO, TaskScheduler::PRIORITY_HIGH,
+                            [worker, url, store, entries, generation]() {
+            worker->doEnrich(url, store, entries, generation);
+        }, DirCache::strand(url));
+    }
+    m_metaWanted.clear();
+
+    /* Previews come after metadata, and read nothing the listing writes. */
+    for (const FileSystemModelMetaRequest& request : m_thumbWanted)
+    {
+        const QUrl url = request.url;
+        const DirStore store = request.store;
+        const QVector<int> entries = request.entries;
+        TaskScheduler::post(this, TaskScheduler::POOL_IO, TaskScheduler::PRIORITY_NORMAL,
+                            [worker, url, store, entries, generation]() {
+            worker->doThumbnails(url, store, entries, generation);
+        });
+    }
+    m_thumbWanted.clear();
+}
+
+void qfcmd::FileSystemModel::wantMeta(const FileSystemModelNode* dir, int entry) const
+{
+    /* Scheme and authority are not files. */
+    if (dir == m_root || dir->m_parent == m_root)
+    {
+        return;
+    }
+
+    auto it = m_metaWanted.find(dir->m_store.version());
+    if (it == m_metaWanted.end())
+    {
+        FileSystemModelMetaRequest request;
+        request.url = getUrl(dir);
+        request.store = dir->m_store;
+        it = m_metaWanted.insert(dir->m_store.version(), request);
+    }
+
+    FileSystemModelMetaRequest& request = it.value();
+    if (request.pending.contains(entry))
+    {
+        return;
+    }
+    request.pending.insert(entry);
+    request.entries.append(entry);
+
+    if (!m_metaFlushPending)
+    {
+        m_metaFlushPending = true;
+        QTimer::singleShot(0, this, &FileSystemModel::flushMetaRequests);
+    }
+}
+
+void qfcmd::FileSystemModel::wantThumbnail(const FileSystemModelNode* dir, int entry) const
+{
+    auto it = m_thumbWanted.find(dir->m_store.version());
+    if (it == m_thumbWanted.end())
+    {
+        FileSystemModelMetaRequest request;
+        request.url = getUrl(dir);
+        request.store = dir->m_store;
+        it = m_thumbWanted.insert(dir->m_store.version(), request);
+    }
+
+    FileSystemModelMetaRequest& request = it.value();
+    if (request.pending.contains(entry))
+    {
+        return;
+    }
+    request.pending.insert(entry);
+    request.entries.append(entry);
+
+    if (!m_metaFlushPending)
+    {
+        m_metaFlushPending = true;
+        QTimer::singleShot(0, this, &FileSystemModel::flushMetaRequests);
+    }
+}
+
+/**
+ * @brief Get how many thumbnails of edge \p size QPixmapCache holds.
+ */
+static int _fs_model_thumbnail_capacity(int size)
+{
+    const qint64 bytes = (qint64)size * size * 4;
+    return (int)qMin<qint64>((qint64)QPixmapCache::cacheLimit() * 1024 / bytes, INT_MAX);
+}
+
+QPixmap qfcmd::FileSystemModel::thumbnail(const FileSystemModelNode* dir, int entry) const
+{
+    /* Scheme and authority are not files. */
+    const DirStore& store = dir->m_store;
+    if (dir == m_root || dir->m_parent == m_root || store.isDir(entry) || !store.hasMeta(entry)
+        || !ThumbnailLoader::accepts(store.ext(entry)))
+    {
+        return QPixmap();
+    }
+
+    const QString key = ThumbnailLoader::key(_fs_model_append_path(getUrl(dir), store.name(entry)),
+                                             store.mtime(entry));
+    const QString pixmapKey = key + QStringLiteral("@%1").arg(m_thumbSize);
+    QPixmap pixmap;
+    if (QPixmapCache::find(pixmapKey, &pixmap))
+    {
+        return pixmap;
+    }
+
+    /* Decoded but not painted yet, pixmaps only exist for what is on screen. */
+    auto it = m_thumbImages.find(key);
+    if (it != m_thumbImages.end())
+    {
+        const QImage& image = it.value();
+        pixmap = QPixmap::fromImage(image.width() > m_thumbSize || image.height() > m_thumbSize
+                                    ? image.scaled(m_thumbSize, m_thumbSize, Qt::KeepAspectRatio,
+                                                   Qt::SmoothTransformation)
+                                    : image);
+        m_thumbImages.erase(it);
+
+        /* The cache turned over, thumbnails it dropped may be wanted again. */
+        if (m_thumbPainted.size() >= _fs_model_thumbnail_capacity(m_thumbSize))
+        {
+            m_thumbPainted.clear();
+        }
+        m_thumbPainted.insert(key);
+        QPixmapCache::insert(pixmapKey, pixmap);
+        return pixmap;
+    }
+
+    /* Evicted by cells painted after it, asking again would evict those in turn. */
+    if (!m_thumbFailed.contains(key) && !m_thumbPainted.contains(key))
+    {
+        wantThumbnail(dir, entry);
+    }
+    return QPixmap();
+}
+
+void qfcmd::FileSystemModel::handleThumbnailResult(const FileSystemModelFetchResult& result)
+{
+    for (int i = 0; i < result.entries.size(); i++)
+    {
+        const int entry = result.entries[i];
+        const QString key = ThumbnailLoader::key(_fs_model_append_path(result.url, result.store.name(entry)),
+                                                 result.store.mtime(entry));
+        if (result.thumbnails[i].isNull())
+        {
+            m_thumbFailed.insert(key);
+        }
+        else
+        {
+            m_thumbImages.insert(key, result.thumbnails[i]);
+        }
+    }
+
+    /* Rows scrolled away before they were painted would keep their image forever. */
+    if (m_thumbImages.size() > FS_MODEL_MAX_PENDING_THUMBNAILS)
+    {
+        m_thumbImages.clear();
+    }
+
+    handleMetaResult(result);
+}
+
+void qfcmd::FileSystemModel::handleMetaResult(const FileSystemModelFetchResult& result)
+{
+    /* A late batch for a directory evicted or left since, nothing to repaint. */
+    FileSystemModelNode* node = _fs_model_find_node(this, result.url);
+    if (node == nullptr)
+    {
+        return;
+    }
+
+    if (result.type == FileSystemModelFetchResult::TYPE_METADATA)
+    {
+        _fs_model_node_drop_display(this, node, result.entries);
+    }
+
+    /*
+     * Entry indexes only mean something for the listing they came with, but
+     * this is just a repaint, a stale one does no harm.
+     */
+    QVector<int> rows;
+    for (int entry : result.entries)
+    {
+        if (entry < node->m_rowOf.size() && node->m_rowOf[entry] >= 0)
+        {
+            rows.append(node->m_rowOf[entry]);
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+
+    for (const FileSystemModelRowRange& range : _fs_model_make_row_ranges(rows))
+    {
+        emit dataChanged(createIndex(range.first, 0, node),
+                         createIndex(range.last, m_titles.size() - 1, node));
+    }
+
+    /* Entries without metadata were sorted as if empty and old. */
+    if (result.type != FileSystemModelFetchResult::TYPE_METADATA || m_sortColumn < 0 || rows.isEmpty()
+        || node->m_store.version() != result.store.version())
+    {
+        return;
+    }
+    const TitleType type = m_titles[m_sortColumn].type;
+    if (type != TITLE_SIZE && type != TITLE_DATE)
+    {
+        return;
+    }
+
+    FileSystemModelMetaRequest& request = m_resortWanted[result.url];
+    if (request.store.version() != result.store.version())
+    {
+        request = FileSystemModelMetaRequest();
+        request.url = result.url;
+        request.store = result.store;
+    }
+    for (int entry : result.entries)
+    {
+        if (!request.pending.contains(entry))
+        {
+            request.pending.insert(entry);
+            request.entries.append(entry);
+        }
+    }
+}
+
+void qfcmd::FileSystemModel::handleFetchResult(FileSystemModelFetchResult& result)
+{
+    if (result.type == FileSystemModelFetchResult::TYPE_METADATA)
+    {
+        handleMetaResult(result);
+        return;
+    }
+    if (result.type == FileSystemModelFetchResult::TYPE_THUMBNAIL)
+    {
+        handleThumbnailResult(result);
+        return;
+    }
+
+    /* Queued before root path changed, the coordinator already forgot it. */
+    if (result.generation != m_rootGeneration.loadRelaxed())
+    {
+        return;
+    }
+
+    /* Evicted together with a directory above it, which forgot the fetch already. */
+    FileSystemModelNode* node = _fs_model_find_node(this, result.url);
+    if (node == nullptr)
+    {
+        return;
+    }
+    if (!result.partial)
+    {
+        m_fetches.finish(result.url);
+        node->m_fetched = true;
+    }
+
+    /* Error occur, clear clildren. */
+    if (result.ret < 0)
+    {
+        node->m_cacheRef.reset();
+        clearChildren(node);
+        return;
+    }
+    if (!result.partial)
+    {
+        node->m_cacheRef.reset(result.url);
+        MemoryBudget::check();
+    }
+
+    node->m_lastUsed = MemoryBudget::tick();
+
+    /*
+     * The cache diffed against the listing we most likely have. If it has
+     * been replaced since, the delta does not apply and must be redone.
+     */
+    if (result.delta.fromVersion != node->m_store.version())
+    {
+        /*
+         * A partial listing would drop entries it has not reached yet. The
+         * final result contains all of it, so wait for that one.
+         */
+        if (result.partial)
+        {
+            return;
+        }
+        result.delta = DirStoreDelta::compute(node->m_store, result.store);
+    }
+
+    const DirStore& store = result.store;
+    const DirStoreDelta& delta = result.delta;
+
+    QVector<int> removedRows;
+    for (int entry : delta.removed)
+    {
+        const int row = node->m_rowOf[entry];
+        if (row >= 0)
+        {
+            removedRows.append(row);
+        }
+    }
+    std::sort(removedRows.begin(), removedRows.end());
+
+    const QVector<FileSystemModelRowRange> removed = _fs_model_make_row_ranges(removedRows);
+    if (removed.size() > FS_MODEL_MAX_ROW_RANGES || !_fs_model_node_is_shown(node))
+    {
+        applyFetchResultAsLayout(node, delta, store);
+        return;
+    }
+
+    const QModelIndex nodeIndex = getIndex(node);
+
+    /* Walk backwards so removing a range does not shift ranges not yet visited. */
+    for (int i = removed.size() - 1; i >= 0; i--)
+    {
+        const FileSystemModelRowRange& range = removed[i];
+
+        beginRemoveRows(nodeIndex, range.first, range.last);
+        {
+            for (int row = range.first; row <= range.last; row++)
+            {
+                const int entry = node->m_visibleChildren[row];
+                node->m_rowOf[entry] = -1;
+                delete node->m_children.value(entry, nullptr);
+            }
+
+            node->m_visibleChildren.remove(range.first, range.last - range.first + 1);
+            node->m_rowsVersion++;
+            for (int row = range.first; row < node->m_visibleChildren.size(); row++)
+            {
+                node->m_rowOf[node->m_visibleChildren[row]] = row;
+            }
+        }
+        endRemoveRows();
+    }
+
+    _fs_model_node_switch_store(node, delta, store);
+    _fs_model_node_drop_display(this, node, delta.changed);
+
+    QVector<int> changedRows;
+    for (int entry : delta.changed)
+    {
+        const int row = node->m_rowOf[entry];
+        if (row >= 0)
+        {
+            changedRows.append(row);
+        }
+    }
+    std::sort(changedRows.begin(), changedRows.end());
+
+    /* Too many scattered rows, just repaint the span that covers them. */
+    QVector<FileSystemModelRowRange> changed = _fs_model_make_row_ranges(changedRows);
+    if (changed.size() > FS_MODEL_MAX_ROW_RANGES)
+    {
+        changed = { { changed.first().first, changed.last().last } };
+    }
+    for (const FileSystemModelRowRange& range : changed)
+    {
+        emit dataChanged(createIndex(range.first, 0, node),
+                         createIndex(range.last, m_titles.size() - 1, node));
+    }
+    if (!delta.changed.isEmpty())
+    {
+        resortEntries(node, delta.changed);
+    }
+
+    if (delta.added.isEmpty())
+    {
+        return;
+    }
+
+    /* Now everything left should be insert. */
+    insertEntries(node, delta.added);
+}
+
+void qfcmd::FileSystemModel::applyFetchResultAsLayout(FileSystemModelNode* node,
+                                                      const DirStoreDelta& delta,
+                                                      const DirStore& store)
+{
+    const QList<QPersistentModelIndex> parents = { getIndex(node) };
+    emit layoutAboutToBeChanged(parents);
+
+    /* Nodes that go away with removed entries, their indexes become invalid. */
+    QSet<const FileSystemModelNode*> doomed;
+    for (FileSystemModelNode* child : node->m_children)
+    {
+        if (delta.oldToNew[child->m_entry] < 0)
+        {
+            _fs_model_node_collect(child, doomed);
+        }
+    }
+
+    /* Remember which new entry every persistent index points to. */
+    const QModelIndexList oldIndexes = persistentIndexList();
+    QVector<int> newEntries(oldIndexes.size(), -1);
+    for (int i = 0; i < oldIndexes.size(); i++)
+    {
+        const FileSystemModelNode* dir = _fs_model_index_to_dir(oldIndexes[i]);
+        if (doomed.contains(dir))
+        {
+            continue;
+        }
+        if (dir == node)
+        {
+            newEntries[i] = delta.oldToNew[_fs_model_index_to_entry(oldIndexes[i])];
+        }
+    }
+
+    QVector<int> visibleChildren;
+    visibleChildren.reserve(node->m_visibleChildren.size());
+    for (int entry : node->m_visibleChildren)
+    {
+        if (delta.oldToNew[entry] >= 0)
+        {
+            visibleChildren.append(entry);
+            continue;
+        }
+        delete node->m_children.value(entry, nullptr);
+    }
+    node->m_visibleChildren.swap(visibleChildren);
+
+    _fs_model_node_switch_store(node, delta, store);
+
+    _fs_model_node_accept(this, node, delta.added);
+    const QVector<int> added = _fs_model_filter_entries(this, node, delta.added);
+    FileSystemModelSortContext ctx;
+    if (_fs_model_sort_context(this, node, added, &ctx))
+    {
+        _fs_model_merge_rows(ctx, node->m_visibleChildren, added);
+        _fs_model_node_update_row_of(node);
+    }
+    else
+    {
+        _fs_model_node_append_rows(node, added);
+    }
+
+    QModelIndexList newIndexes;
+    newIndexes.reserve(oldIndexes.size());
+    for (int i = 0; i < oldIndexes.size(); i++)
+    {
+        const QModelIndex& index = oldIndexes[i];
+        const FileSystemModelNode* dir = _fs_model_index_to_dir(index);
+
+        if (doomed.contains(dir))
+        {
+            newIndexes.append(QModelIndex());
+        }
+        else if (dir != node)
+        {
+            newIndexes.append(index);
+        }
+        else if (newEntries[i] < 0 || node->m_rowOf[newEntries[i]] < 0)
+        {
+            newIndexes.append(QModelIndex());
+        }
+        else
+        {
+            newIndexes.append(createIndex(node->m_rowOf[newEntries[i]], index.column(), node));
+        }
+    }
+    changePersistentIndexList(oldIndexes, newIndexes);
+
+    emit layoutChanged(parents);
+}
+
+void qfcmd::FileSystemModel::reorderRows(const QVector<FileSystemModelNode*>& nodes,
+                                         const std::function<void(FileSystemModelNode*)>& reorder)
+{
+    QList<QPersistentModelIndex> parents;
+    for (FileSystemModelNode* node : nodes)
+    {
+        parents.append(getIndex(node));
+    }
+    emit layoutAboutToBeChanged(parents, QAbstractItemModel::VerticalSortHint);
+
+    /* Entries stay, only their rows change. */
+    const QModelIndexList oldIndexes = persistentIndexList();
+    QVector<int> entries(oldIndexes.size());
+    for (int i = 0; i < oldIndexes.size(); i++)
+    {
+        entries[i] = _fs_model_index_to_entry(oldIndexes[i]);
+    }
+
+    for (FileSystemModelNode* node : nodes)
+    {
+        reorder(node);
+        _fs_model_node_update_row_of(node);
+    }
+
+    QModelIndexList newIndexes;
+    newIndexes.reserve(oldIndexes.size());
+    for (int i = 0; i < oldIndexes.size(); i++)
+    {
+        FileSystemModelNode* dir = _fs_model_index_to_dir(oldIndexes[i]);
+        const int row = dir->m_rowOf[entries[i]];
+        if (row < 0 || !_fs_model_node_is_shown(dir))
+        {
+            newIndexes.append(QModelIndex());
+            continue;
+        }
+        newIndexes.append(createIndex(row, oldIndexes[i].column(), dir));
+    }
+    changePersistentIndexList(oldIndexes, newIndexes);
+
+    emit layoutChanged(parents, QAbstractItemModel::VerticalSortHint);
+}
+
+void qfcmd::FileSystemModel::insertEntries(FileSystemModelNode* node, const QVector<int>& entries, bool force)
+{
+    _fs_model_node_accept(this, node, entries);
+    const QVector<int> shown = force ? entries : _fs_model_filter_entries(this, node, entries);
+    if (shown.isEmpty())
+    {
+        return;
+    }
+    const QModelIndex nodeIndex = getIndex(node);
+
+    FileSystemModelSortContext ctx;
+    const bool sorted = _fs_model_sort_context(this, node, shown, &ctx);
+
+    /* Rows below a filtered out directory have no index, there is nobody to tell. */
+    if (!_fs_model_node_is_shown(node))
+    {
+        _fs_model_merge_rows(ctx, node->m_visibleChildren, shown);
+        _fs_model_node_update_row_of(node);
+        return;
+    }
+
+    if (!sorted)
+    {
+        const int beginRow = node->m_visibleChildren.size();
+        beginInsertRows(nodeIndex, beginRow, beginRow + shown.size() - 1);
+        _fs_model_node_append_rows(node, shown);
+        endInsertRows();
+        return;
+    }
+
+    /* First batch of a listing. */
+    if (node->m_visibleChildren.isEmpty())
+    {
+        QVector<int> rows = shown;
+        _fs_model_sort_entries(ctx, rows);
+
+        beginInsertRows(nodeIndex, 0, rows.size() - 1);
+        _fs_model_node_append_rows(node, rows);
+        endInsertRows();
+        return;
+    }
+
+    /* Same trade off as for removed rows. */
+    if (shown.size() > FS_MODEL_MAX_ROW_RANGES)
+    {
+        reorderRows({ node }, [&ctx, &shown](FileSystemModelNode* node) {
+            _fs_model_merge_rows(ctx, node->m_visibleChildren, shown);
+        });
+        return;
+    }
+
+    for (int entry : shown)
+    {
+        const int row = _fs_model_sort_find_row(ctx, node, entry);
+        beginInsertRows(nodeIndex, row, row);
+        {
+            node->m_visibleChildren.insert(row, entry);
+            node->m_rowsVersion++;
+            for (int i = row; i < node->m_visibleChildren.size(); i++)
+            {
+                node->m_rowOf[node->m_visibleChildren[i]] = i;
+            }
+        }
+        endInsertRows();
+    }
+}
+
+void qfcmd::FileSystemModel::resortEntries(FileSystemModelNode* node, const QVector<int>& entries)
+{
+    if (m_sortColumn < 0)
+    {
+        return;
+    }
+    const TitleType type = m_titles[m_sortColumn].type;
+    if (type != TITLE_SIZE && type != TITLE_DATE)
+    {
+        return;
+    }
+
+    QVector<int> moved;
+    for (int entry : entries)
+    {
+        if (node->m_rowOf[entry] >= 0)
+        {
+            moved.append(entry);
+        }
+    }
+    if (moved.isEmpty())
+    {
+        return;
+    }
+
+    FileSystemModelSortContext ctx;
+    _fs_model_sort_context(this, node, moved, &ctx);
+    reorderRows({ node }, [&ctx, &moved](FileSystemModelNode* node) {
+        /* Take them out and merge them back in where they now belong. */
+        for (int entry : moved)
+        {
+            node->m_rowOf[entry] = -1;
+        }
+        QVector<int> kept;
+        kept.reserve(node->m_visibleChildren.size() - moved.size());
+        for (int entry : node->m_visibleChildren)
+        {
+            if (node->m_rowOf[entry] >= 0)
+            {
+                kept.append(entry);
+            }
+        }
+        node->m_visibleChildren.swap(kept);
+        _fs_model_merge_rows(ctx, node->m_visibleChildren, moved);
+    });
+}
+
+void qfcmd::FileSystemModel::requestSortMeta(const FileSystemModelNode* node)
+{
+    if (m_sortColumn < 0)
+    {
+        return;
+    }
+    const TitleType type = m_titles[m_sortColumn].type;
+    if (type != TITLE_SIZE && type != TITLE_DATE)
+    {
+        return;
+    }
+
+    /* Scheme and authority are not files. */
+    if (node == m_root || node->m_parent == m_root)
+    {
+        return;
+    }
+
+    QVector<int> entries;
+    for (int entry : node->m_visibleChildren)
+    {
+        if (!node->m_store.hasMeta(entry))
+        {
+            entries.append(entry);
+        }
+    }
+    if (entries.isEmpty())
+    {
+        return;
+    }
+
+    /* Behind rows on screen, on the same strand as they are read, in chunks. */
+    const QUrl url = getUrl(node);
+    const DirStore store = node->m_store;
+    const quint64 generation = m_sortGeneration.loadRelaxed();
+    const FileSystemModelWorker* worker = m_worker;
+    TaskScheduler::post(this, TaskScheduler::POOL_IO, TaskScheduler::PRIORITY_LOW,
+                        [worker, url, store, entries, generation]() {
+        worker->doEnrichForSort(url, store, entries, generation);
+    }, DirCache::strand(url));
+}
+
+qfcmd::FileSystemModel::FileSystemModel(QObject *parent)
+    : QAbstractItemModel(parent)
+{
+    m_titles = {
+        {
+            TITLE_NAME,
             QApplication::translate("FileSystemModel", "Name"),
             _fs_model_node_get_name,
         },
@@ -486,48 +2116,230 @@ qfcmd::FileSystemModel::FileSystemModel(QObject *parent)
         },
     };
 
-    m_root = new FileSystemModelNode(nullptr);
-
-    {
-        FileSystemModelWorker* worker = new FileSystemModelWorker;
-        worker->moveToThread(&m_workerThread);
+    m_dirText = "<" + QApplication::translate("FileSystemModel", "Dir") + ">";
 
-        connect(&m_workerThread, &QThread::finished, worker, &QObject::deleteLater);
-        connect(this, &FileSystemModel::doFetch, worker, &FileSystemModelWorker::doFetch);
-        connect(worker, &FileSystemModelWorker::fetchReady, this, &FileSystemModel::handleFetchResult);
+    m_root = new FileSystemModelNode(nullptr, QString(), -1);
+    m_metaFlushPending = false;
+    m_sortColumn = -1;
+    m_sortOrder = Qt::AscendingOrder;
+    m_collator = _fs_model_collator();
+    m_quickFilterRowsVersion = 0;
+    m_evictOrderValid = false;
+    m_thumbSize = ThumbnailLoader::SIZE;
 
-        m_workerThread.start();
-    }
+    m_worker = new FileSystemModelWorker(this, &m_fetchResults, &m_fetchWakePending, &m_metaGeneration,
+                                         &m_sortGeneration);
+    MemoryBudget::add(this);
 }
 
 qfcmd::FileSystemModel::~FileSystemModel()
 {
-    m_workerThread.quit();
-    m_workerThread.wait();
+    MemoryBudget::remove(this);
 
+    /* Make running tasks return early, then wait for them. */
+    DirCache::unsubscribe(this);
+    m_metaGeneration.fetchAndAddOrdered(1);
+    m_sortGeneration.fetchAndAddOrdered(1);
+    TaskScheduler::cancel(this);
+
+    delete m_worker;
     delete m_root;
 }
 
 QModelIndex qfcmd::FileSystemModel::setRootPath(const QString &path)
 {
+    /* The filter belongs to the old directory, give it back its rows. */
+    setQuickFilter(QString());
+
     const QUrl url = QUrl::fromLocalFile(path);
     FileSystemModelNode* node = getNode(url);
 
-    emit doFetch(url);
-    return createIndex(0, 0, node);
+    m_rootUrl = url;
+
+    /* Listings this model waits for never complete, forget them. */
+    DirCache::unsubscribe(this);
+    m_fetches.cancelAll();
+    m_rootGeneration.fetchAndAddOrdered(1);
+
+    /* Metadata and previews of the old directory are not wanted either. */
+    m_metaGeneration.fetchAndAddOrdered(1);
+    m_sortGeneration.fetchAndAddOrdered(1);
+    m_metaWanted.clear();
+    m_thumbWanted.clear();
+    m_thumbImages.clear();
+    m_thumbFailed.clear();
+    m_thumbPainted.clear();
+
+    requestFetch(url, node, true, TaskScheduler::PRIORITY_HIGH);
+    return getIndex(node);
+}
+
+void qfcmd::FileSystemModel::setQuickFilter(const QString& text)
+{
+    if (text == m_quickFilter.pattern())
+    {
+        return;
+    }
+
+    const NameMatcher matcher(text);
+    FileSystemModelNode* node = _fs_model_find_node(this, m_rootUrl);
+    if (node == nullptr)
+    {
+        m_quickFilterSteps.clear();
+        m_quickFilter = matcher;
+        return;
+    }
+
+    /* A refresh changed rows since, what earlier texts left is stale. */
+    if (node->m_rowsVersion != m_quickFilterRowsVersion)
+    {
+        m_quickFilterSteps.clear();
+    }
+    if (m_quickFilterSteps.isEmpty() && m_quickFilter.isEmpty())
+    {
+        m_quickFilterSteps.append({ QString(), node->m_visibleChildren });
+    }
+
+    /* Rows of a text the new one does not contain may miss matches. */
+    while (!m_quickFilterSteps.isEmpty() && !text.contains(m_quickFilterSteps.last().text, Qt::CaseInsensitive))
+    {
+        m_quickFilterSteps.removeLast();
+    }
+
+    QVector<int> rows;
+    if (!m_quickFilterSteps.isEmpty() && m_quickFilterSteps.last().text.compare(text, Qt::CaseInsensitive) == 0)
+    {
+        rows = m_quickFilterSteps.last().rows;
+    }
+    else if (!m_quickFilterSteps.isEmpty())
+    {
+        for (int entry : m_quickFilterSteps.last().rows)
+        {
+            int len = 0;
+            const char* name = node->m_store.nameUtf8(entry, &len);
+            if (matcher.matches(name, len))
+            {
+                rows.append(entry);
+            }
+        }
+        m_quickFilterSteps.append({ text, rows });
+    }
+    else
+    {
+        rows = _fs_model_quick_filter_rescan(this, node, matcher);
+        m_quickFilterSteps.append({ text, rows });
+    }
+
+    m_quickFilter = matcher;
+    reorderRows({ node }, [&rows](FileSystemModelNode* node) {
+        node->m_visibleChildren = rows;
+    });
+    m_quickFilterRowsVersion = node->m_rowsVersion;
+
+    if (text.isEmpty())
+    {
+        m_quickFilterSteps.clear();
+    }
+}
+
+QString qfcmd::FileSystemModel::quickFilter() const
+{
+    return m_quickFilter.pattern();
+}
+
+/**
+ * @brief Add listed nodes below \p node to \p nodes, parents first.
+ */
+static void _fs_model_collect_listed(qfcmd::FileSystemModelNode* node, QVector<qfcmd::FileSystemModelNode*>& nodes)
+{
+    for (qfcmd::FileSystemModelNode* child : node->m_children)
+    {
+        if (child->m_store.size() > 0)
+        {
+            nodes.append(child);
+        }
+        _fs_model_collect_listed(child, nodes);
+    }
+}
+
+void qfcmd::FileSystemModel::setNameFilter(const NameFilter& filter)
+{
+    if (filter.rules() == m_nameFilter.rules())
+    {
+        return;
+    }
+    m_nameFilter = filter;
+
+    /* Scheme nodes under the root are not entries of a directory. */
+    QVector<FileSystemModelNode*> nodes;
+    for (FileSystemModelNode* scheme : m_root->m_children)
+    {
+        _fs_model_collect_listed(scheme, nodes);
+    }
+    if (nodes.isEmpty())
+    {
+        return;
+    }
+
+    reorderRows(nodes, [this](FileSystemModelNode* node) {
+        QVector<int> entries(node->m_store.size());
+        std::iota(entries.begin(), entries.end(), 0);
+        _fs_model_node_accept(this, node, entries);
+        node->m_visibleChildren = _fs_model_node_refilter(this, node);
+    });
+}
+
+const qfcmd::NameFilter& qfcmd::FileSystemModel::nameFilter() const
+{
+    return m_nameFilter;
+}
+
+void qfcmd::FileSystemModel::setThumbnailSize(int size)
+{
+    size = qBound(1, size, (int)ThumbnailLoader::SIZE);
+    if (size == m_thumbSize)
+    {
+        return;
+    }
+
+    /* Pixmaps of the old size are not looked up any more, QPixmapCache drops them in time. */
+    m_thumbSize = size;
+    m_thumbPainted.clear();
+}
+
+QModelIndex qfcmd::FileSystemModel::index(const QString& path, int column) const
+{
+    const QUrl url = QUrl::fromLocalFile(path).adjusted(QUrl::StripTrailingSlash);
+    const FileSystemModelNode* dir = _fs_model_find_node(this, url.adjusted(QUrl::RemoveFilename));
+    if (dir == nullptr)
+    {
+        return QModelIndex();
+    }
+
+    const int entry = dir->m_store.find(url.fileName());
+    if (entry < 0 || dir->m_rowOf[entry] < 0)
+    {
+        return QModelIndex();
+    }
+
+    return createIndex(dir->m_rowOf[entry], column, static_cast<void*>(const_cast<FileSystemModelNode*>(dir)));
 }
 
 QString qfcmd::FileSystemModel::filePath(const QModelIndex &index) const
 {
-    qfcmd::FileSystemModelNode* node = _fs_mode_index_to_node(index);
-    const QUrl url = getUrl(node);
+    const QUrl url = getUrl(index);
     return url.toLocalFile();
 }
 
 bool qfcmd::FileSystemModel::isDir(const QModelIndex &index) const
 {
-    qfcmd::FileSystemModelNode* node = _fs_mode_index_to_node(index);
-    return node->m_stat.st_mode & QFCMD_FS_S_IFDIR;
+    if (!index.isValid())
+    {
+        return false;
+    }
+
+    qfcmd::FileSystemModelNode* dir = _fs_model_index_to_dir(index);
+    return dir->m_store.isDir(_fs_model_index_to_entry(index));
 }
 
 QVariant qfcmd::FileSystemModel::headerData(int section, Qt::Orientation orientation, int role) const
@@ -550,39 +2362,25 @@ QVariant qfcmd::FileSystemModel::headerData(int section, Qt::Orientation orienta
     return m_titles[section].name;
 }
 
-static qfcmd::FileSystemModelNode* _fs_model_get_child(qfcmd::FileSystemModelNode* parent, const QString& name)
-{
-    auto it = parent->m_children.find(name);
-    if (it == parent->m_children.end())
-    {
-        return nullptr;
-    }
-    return it.value();
-}
-
 QModelIndex qfcmd::FileSystemModel::index(int row, int column, const QModelIndex& parent) const
 {
-    if (column >= m_titles.size())
+    if (column < 0 || column >= m_titles.size())
     {
         return QModelIndex();
     }
 
     /* Find the correct parent node. */
-    qfcmd::FileSystemModelNode* parentNode = _fs_mode_index_to_node(parent);
+    qfcmd::FileSystemModelNode* parentNode = _fs_model_index_to_node(this, parent);
     if (parentNode == nullptr)
     {
-        parentNode = m_root;
+        return QModelIndex();
     }
-    if (row >= parentNode->m_visibleChildren.size())
+    if (row < 0 || row >= parentNode->m_visibleChildren.size())
     {
         return QModelIndex();
     }
 
-    const QString childName = parentNode->m_visibleChildren[row];
-    FileSystemModelNode* node = _fs_model_get_child(parentNode, childName);
-    Q_ASSERT(node != nullptr);
-
-    return createIndex(row, column, static_cast<void*>(node));
+    return createIndex(row, column, static_cast<void*>(parentNode));
 }
 
 QModelIndex qfcmd::FileSystemModel::parent(const QModelIndex &index) const
@@ -592,19 +2390,10 @@ QModelIndex qfcmd::FileSystemModel::parent(const QModelIndex &index) const
         return QModelIndex();
     }
 
-    qfcmd::FileSystemModelNode* node = _fs_mode_index_to_node(index);
-    Q_ASSERT(node != nullptr);
-    qfcmd::FileSystemModelNode* parentNode = node->m_parent;
-    if (parentNode == nullptr)
-    {
-        return QModelIndex();
-    }
-
-    Q_ASSERT(parentNode->m_children.size() == parentNode->m_visibleChildren.size());
-    int visualRow = parentNode->m_visibleChildren.indexOf(node->m_name);
-    Q_ASSERT(visualRow >= 0);
+    qfcmd::FileSystemModelNode* dir = _fs_model_index_to_dir(index);
+    Q_ASSERT(dir != nullptr);
 
-    return createIndex(visualRow, 0, static_cast<void*>(parentNode));
+    return getIndex(dir);
 }
 
 int qfcmd::FileSystemModel::rowCount(const QModelIndex &parent) const
@@ -614,14 +2403,13 @@ int qfcmd::FileSystemModel::rowCount(const QModelIndex &parent) const
         return 0;
     }
 
-    if (!parent.isValid())
+    qfcmd::FileSystemModelNode* node = _fs_model_index_to_node(this, parent);
+    if (node == nullptr)
     {
-        return m_root->m_visibleChildren.size();
+        return 0;
     }
 
-    qfcmd::FileSystemModelNode* node = _fs_mode_index_to_node(parent);
-    Q_ASSERT(node != nullptr);
-
+    node->m_lastUsed = MemoryBudget::tick();
     return node->m_visibleChildren.size();
 }
 
@@ -647,17 +2435,45 @@ bool qfcmd::FileSystemModel::hasChildren(const QModelIndex &parent) const
         return false;
     }
 
-    qfcmd::FileSystemModelNode* parentNode = _fs_mode_index_to_node(parent);
-    Q_ASSERT(parentNode != nullptr);
+    qfcmd::FileSystemModelNode* dir = _fs_model_index_to_dir(parent);
+    Q_ASSERT(dir != nullptr);
+
+    /* Content is unknown until listed, let the view offer to expand it. */
+    return dir->m_store.isDir(_fs_model_index_to_entry(parent));
+}
+
+bool qfcmd::FileSystemModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (!parent.isValid() || parent.column() > 0)
+    {
+        return false;
+    }
+
+    qfcmd::FileSystemModelNode* dir = _fs_model_index_to_dir(parent);
+    if (!dir->m_store.isDir(_fs_model_index_to_entry(parent)))
+    {
+        return false;
+    }
 
-    if (!(parentNode->m_stat.st_mode & QFCMD_FS_S_IFDIR))
+    const FileSystemModelNode* node = _fs_model_index_to_node(this, parent);
+    if (node != nullptr && node->m_fetched)
     {
         return false;
     }
 
-    const QUrl url = getUrl(parentNode);
-    emit doFetch(url);
-    return true;
+    return !m_fetches.isInFlight(getUrl(parent));
+}
+
+void qfcmd::FileSystemModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent))
+    {
+        return;
+    }
+
+    /* Results are only applied to nodes that exist. */
+    const QUrl url = getUrl(parent);
+    requestFetch(url, getNode(url), false, TaskScheduler::PRIORITY_NORMAL);
 }
 
 QVariant qfcmd::FileSystemModel::data(const QModelIndex &index, int role) const
@@ -667,6 +2483,18 @@ QVariant qfcmd::FileSystemModel::data(const QModelIndex &index, int role) const
         return QVariant();
     }
 
+    /* The view only asks for rows it paints, so these are the ones on screen. */
+    if (role == Qt::DisplayRole || role == Qt::DecorationRole)
+    {
+        FileSystemModelNode* dir = _fs_model_index_to_dir(index);
+        const int entry = _fs_model_index_to_entry(index);
+        dir->m_lastUsed = MemoryBudget::tick();
+        if (!dir->m_store.hasMeta(entry))
+        {
+            wantMeta(dir, entry);
+        }
+    }
+
     switch(role)
     {
     case Qt::DisplayRole:
@@ -681,3 +2509,164 @@ QVariant qfcmd::FileSystemModel::data(const QModelIndex &index, int role) const
 
     return QVariant();
 }
+
+void qfcmd::FileSystemModel::sort(int column, Qt::SortOrder order)
+{
+    if (column < 0 || column >= m_titles.size())
+    {
+        column = -1;
+    }
+    if (column == m_sortColumn && order == m_sortOrder)
+    {
+        return;
+    }
+    m_sortColumn = column;
+    m_sortOrder = order;
+
+    /* Metadata still being read for the old order is no longer in the way. */
+    m_sortGeneration.fetchAndAddOrdered(1);
+    m_resortWanted.clear();
+
+    QVector<FileSystemModelNode*> nodes;
+    QVector<FileSystemModelNode*> stack = { m_root };
+    while (!stack.isEmpty())
+    {
+        FileSystemModelNode* node = stack.takeLast();
+        nodes.append(node);
+        for (FileSystemModelNode* child : node->m_children)
+        {
+            stack.append(child);
+        }
+    }
+
+    reorderRows(nodes, [this](FileSystemModelNode* node) {
+        FileSystemModelSortContext ctx;
+        if (_fs_model_sort_context(this, node, node->m_visibleChildren, &ctx))
+        {
+            _fs_model_sort_entries(ctx, node->m_visibleChildren);
+            return;
+        }
+
+        /* Back to listing order, keys are only worth their memory while sorted. */
+        std::sort(node->m_visibleChildren.begin(), node->m_visibleChildren.end());
+        std::vector<QCollatorSortKey>().swap(node->m_sortKeys);
+    });
+
+    for (const FileSystemModelNode* node : nodes)
+    {
+        requestSortMeta(node);
+    }
+}
+
+qint64 qfcmd::FileSystemModel::memoryUsage(QSet<const void*>* counted) const
+{
+    return _fs_model_node_usage(m_root, counted);
+}
+
+qint64 qfcmd::FileSystemModel::memoryOldestUse() const
+{
+    if (m_evictOrderValid)
+    {
+        return !m_evictOrder.isEmpty() ? m_evictOrder.last()->m_lastUsed : -1;
+    }
+
+    const QVector<FileSystemModelNode*> nodes = evictableNodes();
+    return !nodes.isEmpty() ? nodes.last()->m_lastUsed : -1;
+}
+
+qint64 qfcmd::FileSystemModel::memoryEvictOldest()
+{
+    QVector<FileSystemModelNode*> computed;
+    if (!m_evictOrderValid)
+    {
+        computed = evictableNodes();
+    }
+    QVector<FileSystemModelNode*>& nodes = m_evictOrderValid ? m_evictOrder : computed;
+    if (nodes.isEmpty())
+    {
+        return 0;
+    }
+    FileSystemModelNode* node = nodes.takeLast();
+
+    /* Listings below are dropped too, and with them their fetches. */
+    QSet<const FileSystemModelNode*> doomed;
+    _fs_model_node_collect(node, doomed);
+    for (const FileSystemModelNode* child : doomed)
+    {
+        m_fetches.forget(getUrl(child));
+    }
+
+    const qint64 before = _fs_model_node_usage(node, nullptr);
+
+    /* Back to a directory never visited, a view asking for it lists it again. */
+    clearChildren(node);
+    node->m_fetched = false;
+    node->m_cacheRef.reset();
+
+    /* Descendants just deleted must not be evicted later in this trim. */
+    if (doomed.size() > 1)
+    {
+        nodes.removeIf([&doomed](const FileSystemModelNode* n) { return doomed.contains(n); });
+    }
+
+    return before - _fs_model_node_usage(node, nullptr);
+}
+
+void qfcmd::FileSystemModel::memoryTrimBegin()
+{
+    m_evictOrder = evictableNodes();
+    m_evictOrderValid = true;
+}
+
+void qfcmd::FileSystemModel::memoryTrimEnd()
+{
+    m_evictOrder.clear();
+    m_evictOrderValid = false;
+}
+
+QVector<qfcmd::FileSystemModelNode*> qfcmd::FileSystemModel::evictableNodes() const
+{
+    /* Nodes views refer to, and everything above them. */
+    QSet<const FileSystemModelNode*> pinned;
+    auto pin = [&pinned](const FileSystemModelNode* node) {
+        for (; node != nullptr && !pinned.contains(node); node = node->m_parent)
+        {
+            pinned.insert(node);
+        }
+    };
+
+    pin(_fs_model_find_node(this, m_rootUrl));
+    for (const QModelIndex& index : persistentIndexList())
+    {
+        const FileSystemModelNode* dir = _fs_model_index_to_dir(index);
+        pin(dir);
+        pin(dir->m_children.value(_fs_model_index_to_entry(index), nullptr));
+    }
+
+    QVector<FileSystemModelNode*> nodes;
+    QVector<FileSystemModelNode*> stack = { m_root };
+    while (!stack.isEmpty())
+    {
+        FileSystemModelNode* node = stack.takeLast();
+        for (FileSystemModelNode* child : node->m_children)
+        {
+            stack.append(child);
+        }
+
+        /* Scheme and authority are not directories. */
+        if (node == m_root || node->m_parent == m_root)
+        {
+            continue;
+        }
+        if (!node->m_fetched || pinned.contains(node))
+        {
+            continue;
+        }
+        nodes.append(node);
+    }
+
+    std::sort(nodes.begin(), nodes.end(), [](const FileSystemModelNode* a, const FileSystemModelNode* b) {
+        return a->m_lastUsed > b->m_lastUsed;
+    });
+    return nodes;
+}
@@ -2,73 +2,278 @@
 #define QFCMD_MODEL_FILESYSTEMMODEL_H
 
 #include <functional>
+#include <vector>
 #include <QAbstractItemModel>
-#include <QFileIconProvider>
+#include <QAtomicInt>
+#include <QBitArray>
+#include <QCollator>
+#include <QHash>
 #include <QIcon>
-#include <QThread>
+#include <QImage>
+#include <QPixmap>
+#include <QSet>
 #include <QUrl>
 #include <QVector>
 
 #include "qfcmd/qfcmd.h"
+#include "utils/memorybudget.hpp"
+#include "utils/mpscqueue.hpp"
+#include "utils/namematcher.hpp"
+#include "utils/scheduler.hpp"
 #include "vfs/filesystem.hpp"
+#include "dircache.hpp"
+#include "dirstore.hpp"
+#include "fetchcoordinator.hpp"
+#include "namefilter.hpp"
 
 namespace qfcmd {
 
-class IconProvider : public QFileIconProvider
+/**
+ * @brief A directory in the model tree.
+ *
+ * Entries of the directory live in #m_store. Files never get a node, and a
+ * directory only gets one once it is visited, so the node count is bounded by
+ * the number of directories the user has seen rather than the number of files.
+ */
+class FileSystemModelNode
 {
-    Q_DISABLE_COPY_MOVE(IconProvider)
+    Q_DISABLE_COPY_MOVE(FileSystemModelNode)
 
 public:
-    IconProvider();
+    /**
+     * @brief Create node and register it as child of \p parent.
+     * @param[in] parent - The parent node, or nullptr for root.
+     * @param[in] name - The name of the node.
+     * @param[in] entry - Entry index in parent's #m_store.
+     */
+    FileSystemModelNode(FileSystemModelNode* parent, const QString& name, int entry);
+
+    /**
+     * @brief Destroy node and all children, and unlink it from parent.
+     */
+    ~FileSystemModelNode();
 
 public:
-    QIcon icon(const QUrl& url, const qfcmd_fs_stat_t& stat);
+    /**
+     * @brief Get the row of this node in parent.
+     * @return Row, or -1 for root.
+     */
+    int row() const;
 
-private:
-    QIcon getNativeIcon(const QUrl& url, const qfcmd_fs_stat_t& stat);
+    /**
+     * @brief Delete all child nodes.
+     */
+    void clearChildren();
+
+public:
+    QString                             m_name;             /**< The name of the node. */
+    FileSystemModelNode*                m_parent;           /**< The parent node. */
+    int                                 m_entry;            /**< Entry index in parent's #m_store, -1 for root. */
+    bool                                m_fetched;          /**< A listing result has been applied. */
+    DirCacheRef                         m_cacheRef;         /**< Keeps the shared listing cached. */
+    qint64                              m_lastUsed;         /**< MemoryBudget::tick() when last shown or visited. */
+    quint64                             m_rowsVersion;      /**< Bumped whenever rows change. */
+
+    DirStore                            m_store;            /**< Entries of this directory. */
+    QVector<int>                        m_visibleChildren;  /**< Visible entries, in row order. */
+    QVector<int>                        m_rowOf;            /**< Row of every entry, or -1 if not visible. */
+    QBitArray                           m_accepted;         /**< Entries that pass the name filter, tested once when inserted. */
+    QHash<quint64, QVariant>            m_display;          /**< Formatted cells painted so far, by entry and column. */
+    QHash<int, FileSystemModelNode*>    m_children;         /**< Child directory nodes, by entry index. */
+    std::vector<QCollatorSortKey>       m_sortKeys;         /**< Name collation key of leading entries, only while sorted. */
 };
 
-class FileSystemModelNode
+/**
+ * @brief Result of listing a directory, passed from worker to model.
+ */
+struct FileSystemModelFetchResult
 {
-    Q_DISABLE_COPY_MOVE(FileSystemModelNode)
+    Q_DISABLE_COPY(FileSystemModelFetchResult)
 
-public:
-    FileSystemModelNode(FileSystemModelNode* parent);
-    ~FileSystemModelNode();
-
-public:
-    QString                             m_name;             /**< The name of the node. */
-    qfcmd_fs_stat_t                     m_stat;             /**< File stat. */
-    QIcon                               m_icon;
+    enum Type
+    {
+        TYPE_LISTING,   /**< #store is a new listing of the directory. */
+        TYPE_METADATA,  /**< Metadata of #entries in #store is filled in. */
+        TYPE_THUMBNAIL, /**< #thumbnails of #entries in #store are decoded. */
+    };
 
-    FileSystemModelNode*                m_parent;           /**< The parent node. */
-    QMap<QString, FileSystemModelNode*> m_children;         /**< The children nodes. */
-    QVector<QString>                    m_visibleChildren;  /**< The visible children nodes. */
+    FileSystemModelFetchResult();
+    FileSystemModelFetchResult(FileSystemModelFetchResult&&) = default;
+    FileSystemModelFetchResult& operator=(FileSystemModelFetchResult&&) = default;
+
+    Type            type;       /**< What this result carries. */
+    quint64         generation; /**< Root generation the listing was requested in. */
+    QUrl            url;        /**< URL of directory. */
+    int             ret;        /**< 0 on success, or -errno. */
+    bool            partial;    /**< More results for this listing follow. */
+    bool            cached;     /**< #store is a whole listing from the cache, maybe stale. */
+    DirStore        store;      /**< The new listing, or the part of it read so far. */
+    DirStoreDelta   delta;      /**< Difference from the listing the model has before applying it. */
+    QVector<int>    entries;    /**< Entries of #store that got metadata or thumbnails. */
+    QVector<QImage> thumbnails; /**< Thumbnail of each of #entries, null if it has none. */
 };
 
-class FileSystemModelWorker : public QObject
+/**
+ * @brief Entries of one listing whose metadata or thumbnails the view is waiting for.
+ */
+struct FileSystemModelMetaRequest
 {
-    Q_OBJECT
+    QUrl            url;        /**< URL of directory. */
+    DirStore        store;      /**< The listing. */
+    QVector<int>    entries;    /**< Entries, in the order they were asked for. */
+    QSet<int>       pending;    /**< Same as #entries, for lookup. */
+};
 
-public:
-    struct FileInfo
+/**
+ * @brief Days whose dates were formatted lately.
+ *
+ * Times of a known day only format hours, minutes and seconds after the
+ * saved date text.
+ */
+struct FileSystemModelDateFormatter
+{
+    struct Day
     {
-        QIcon           icon;
-        qfcmd_fs_stat_t info;
+        qint64      begin;      /**< Local midnight, in seconds since epoch. */
+        qint64      end;        /**< Next local midnight. */
+        QString     prefix;     /**< Date and separator, as "yyyy-MM-dd ". */
     };
-    typedef QMap<QString, FileInfo> FileInfoMap;
 
-public slots:
-    void doFetch(const QUrl& url);
+    QVector<Day>    days;       /**< Oldest first. */
+};
 
-signals:
-    void fetchReady(const QUrl& url, int ret, const FileInfoMap& entry);
+/**
+ * @brief Rows the quick filter left for one text.
+ */
+struct FileSystemModelFilterStep
+{
+    QString         text;       /**< Filter text. */
+    QVector<int>    rows;       /**< Entries shown, in row order. */
+};
+
+typedef MpscQueue<FileSystemModelFetchResult> FileSystemModelFetchQueue;
+
+/**
+ * @brief Listing and metadata tasks of a model.
+ *
+ * Listings are read by DirCache and passed on by deliver(), metadata is read
+ * by doEnrich(). The methods run on TaskScheduler threads, possibly several at
+ * once for different directories, so the worker keeps no state of its own
+ * besides pointers into the model it serves.
+ */
+class FileSystemModelWorker
+{
+    Q_DISABLE_COPY_MOVE(FileSystemModelWorker)
+
+public:
+    /**
+     * @brief Create worker.
+     * @param[in] receiver - Object whose handleFetchResults() slot drains \p results.
+     * @param[in] results - Queue to put results in.
+     * @param[in] wakePending - Non-zero while a wake up of \p receiver is not yet handled.
+     * @param[in] metaGeneration - Generation of the latest metadata request.
+     * @param[in] sortGeneration - Generation of the latest sort order.
+     */
+    FileSystemModelWorker(QObject* receiver, FileSystemModelFetchQueue* results, QAtomicInt* wakePending,
+                          QAtomicInteger<quint64>* metaGeneration, QAtomicInteger<quint64>* sortGeneration);
+
+public:
+    /**
+     * @brief Pass a listing from DirCache on to the model.
+     *
+     * The result is put into the queue, and the receiver is woken up if it is
+     * not already going to drain it.
+     *
+     * @param[in] listing - The listing.
+     * @param[in] generation - Root generation of the request.
+     */
+    void deliver(const DirCacheResult& listing, quint64 generation) const;
+
+    /**
+     * @brief Fill in size, mtime and icon of \p entries.
+     *
+     * Progress is published as metadata results in small batches. The rest
+     * is dropped once a newer request generation is issued, since the rows
+     * asked for are probably no longer on screen.
+     *
+     * Must run in the DirCache::strand() of the directory, since listing it
+     * writes the same arena. The arena is shared by every model showing the
+     * directory, so entries another model filled in are reported as well, to
+     * get them repainted.
+     *
+     * @param[in] url - URL of directory.
+     * @param[in] store - The listing.
+     * @param[in] entries - Entries to fill, most wanted first.
+     * @param[in] generation - Generation of the request.
+     */
+    void doEnrich(const QUrl& url, const qfcmd::DirStore& store, const QVector<int>& entries,
+                  quint64 generation) const;
+
+    /**
+     * @brief Fill in size, mtime and icon of \p entries to sort by them.
+     *
+     * Same as doEnrich(), but scrolling does not drop the request, only a
+     * change of sort order does. A large directory is done in chunks, each
+     * posting the rest to the strand again, so listings and metadata of
+     * rows on screen do not wait for all of it.
+     *
+     * @param[in] url - URL of directory.
+     * @param[in] store - The listing.
+     * @param[in] entries - Entries to fill.
+     * @param[in] generation - Sort generation of the request.
+     */
+    void doEnrichForSort(const QUrl& url, const qfcmd::DirStore& store, const QVector<int>& entries,
+                         quint64 generation) const;
+
+    /**
+     * @brief Decode thumbnails of \p entries.
+     *
+     * Only QImage is produced, pixmaps are made on the GUI thread when the
+     * rows are painted. Requests are dropped like in doEnrich().
+     *
+     * @param[in] url - URL of directory.
+     * @param[in] store - The listing.
+     * @param[in] entries - Entries with metadata, most wanted first.
+     * @param[in] generation - Generation of the request.
+     */
+    void doThumbnails(const QUrl& url, const qfcmd::DirStore& store, const QVector<int>& entries,
+                      quint64 generation) const;
+
+private:
+    void enrich(const QUrl& url, const qfcmd::DirStore& store, const QVector<int>& entries,
+                quint64 generation, const QAtomicInteger<quint64>* current) const;
+    void publish(FileSystemModelFetchResult&& result) const;
 
 private:
-    IconProvider            m_iconProvider;
+    QObject*                    m_receiver;         /**< Woken up when results are queued. */
+    FileSystemModelFetchQueue*  m_results;          /**< Result queue. */
+    QAtomicInt*                 m_wakePending;      /**< Set when #m_receiver is woken up. */
+    QAtomicInteger<quint64>*    m_metaGeneration;   /**< Generation of the latest metadata request. */
+    QAtomicInteger<quint64>*    m_sortGeneration;   /**< Generation of the latest sort order. */
 };
 
-class FileSystemModel : public QAbstractItemModel
+/**
+ * @brief Contiguous rows, both ends inclusive.
+ */
+struct FileSystemModelRowRange
+{
+    int first;
+    int last;
+};
+
+/**
+ * @brief Tree model of directories.
+ *
+ * The model is a MemoryConsumer. Listings of directories that are neither
+ * the root path nor referenced by any view are evicted least recently used
+ * first, and listed again when a view asks for them.
+ *
+ * Rows are sorted in the model, directories first. Names are compared by
+ * collation keys computed once per entry, and entries of later listings are
+ * inserted in place, so only the first listing of a directory is sorted as
+ * a whole.
+ */
+class FileSystemModel : public QAbstractItemModel, public MemoryConsumer
 {
     Q_OBJECT
 
@@ -84,9 +289,9 @@ public:
 
     struct TitleEntry
     {
-        TitleType                                               type;
-        QString                                                 name;
-        std::function<QVariant(qfcmd::FileSystemModelNode*)>    func;
+        TitleType                                           type;
+        QString                                             name;
+        std::function<QVariant(const FileSystemModel*, const DirStore&, int)> func;
     };
 
 public:
@@ -105,6 +310,16 @@ public:
      */
     QModelIndex setRootPath(const QString& path);
 
+    /**
+     * @brief Get index of a file the model has listed.
+     *
+     * Unlike QFileSystemModel, nothing is listed to find it.
+     *
+     * @see https://doc.qt.io/qt-6/qfilesystemmodel.html#index-1
+     * @return The index, or invalid index if the file is not in the model.
+     */
+    QModelIndex index(const QString& path, int column = 0) const;
+
     /**
      * @see https://doc.qt.io/qt-6/qfilesystemmodel.html#filePath
      */
@@ -116,10 +331,91 @@ public:
     bool isDir(const QModelIndex &index) const;
 
     FileSystemModelNode* getNode(const QUrl& url);
-    QModelIndex getIndex(FileSystemModelNode* node);
+    QModelIndex getIndex(FileSystemModelNode* node) const;
     QUrl getUrl(const FileSystemModelNode* node) const;
+    QUrl getUrl(const QModelIndex& index) const;
     void clearChildren(FileSystemModelNode* node);
 
+    /**
+     * @brief Only show rows of the root path whose name contains \p text, ignoring case.
+     *
+     * A text that contains the previous one only tests the rows that one
+     * left, and going back to an earlier text restores its rows as they were,
+     * as long as no refresh changed them in between.
+     *
+     * @param[in] text - Filter text, empty to show every row.
+     */
+    void setQuickFilter(const QString& text);
+
+    /**
+     * @brief Get the quick filter text.
+     */
+    QString quickFilter() const;
+
+    /**
+     * @brief Hide entries of every directory that \p filter rejects.
+     *
+     * Listed entries are tested again and rows change in one layout change,
+     * nothing is read again. Entries of a refresh are tested as they come.
+     * Directories on the way to the root path stay shown.
+     *
+     * @param[in] filter - Compiled rules.
+     */
+    void setNameFilter(const NameFilter& filter);
+
+    /**
+     * @brief Get the name filter.
+     */
+    const NameFilter& nameFilter() const;
+
+    /**
+     * @brief Set the edge length thumbnails are painted at.
+     *
+     * Thumbnails are kept in QPixmapCache at this size, so a grid of small
+     * cells fits many more of them than at the size they are decoded at.
+     *
+     * @param[in] size - Edge length in pixels, at most ThumbnailLoader::SIZE.
+     */
+    void setThumbnailSize(int size);
+
+    /**
+     * @brief Get the thumbnail of an entry.
+     *
+     * Only image files with metadata have one. If it is not decoded yet, it
+     * is asked for and the row is repainted once it is.
+     *
+     * @param[in] dir - The directory node.
+     * @param[in] entry - Entry index in \p dir.
+     * @return The thumbnail, or null pixmap if there is none yet.
+     */
+    QPixmap thumbnail(const FileSystemModelNode* dir, int entry) const;
+
+public:
+    /**
+     * @see MemoryConsumer::memoryUsage
+     */
+    qint64 memoryUsage(QSet<const void*>* counted = nullptr) const override;
+
+    /**
+     * @see MemoryConsumer::memoryOldestUse
+     */
+    qint64 memoryOldestUse() const override;
+
+    /**
+     * @see MemoryConsumer::memoryEvictOldest
+     */
+    qint64 memoryEvictOldest() override;
+
+    /**
+     * @see MemoryConsumer::memoryTrimBegin
+     */
+    void memoryTrimBegin() override;
+
+    /**
+     * @see MemoryConsumer::memoryTrimEnd
+     */
+    void memoryTrimEnd() override;
+
 public:
     // Header:
     QVariant headerData(int section,
@@ -135,17 +431,171 @@ public:
 
     // Fetch data dynamically:
     bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
 
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
 
+    /**
+     * @brief Sort rows of every directory.
+     *
+     * Sorting by size or date reads metadata of whole directories, rows move
+     * to their place as it comes in.
+     *
+     * @see https://doc.qt.io/qt-6/qabstractitemmodel.html#sort
+     * @param[in] column - Column to sort by, or -1 for listing order.
+     * @param[in] order - Sort order.
+     */
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
 signals:
-    void doFetch(const QUrl& url) const;
+    /**
+     * @brief The listing of \p path is applied.
+     *
+     * Also emitted for a cached listing, before the fresh one replaces it.
+     *
+     * @see https://doc.qt.io/qt-6/qfilesystemmodel.html#directoryLoaded
+     */
+    void directoryLoaded(const QString& path);
 
 private slots:
-    void handleFetchResult(const QUrl& url, int ret, const FileSystemModelWorker::FileInfoMap& entry);
+    /**
+     * @brief Apply every result in #m_fetchResults.
+     */
+    void handleFetchResults();
+
+    /**
+     * @brief Send requests collected by wantMeta() and wantThumbnail() to the worker.
+     */
+    void flushMetaRequests();
+
+private:
+    /**
+     * @brief Get child directory node of \p parent, create it if not exist.
+     *
+     * If \p parent does not list \p name yet, a placeholder entry is appended
+     * so the new node has a row.
+     *
+     * @param[in] parent - The parent node.
+     * @param[in] name - Child name.
+     * @return The child node.
+     */
+    FileSystemModelNode* getChildNode(FileSystemModelNode* parent, const QString& name);
+
+    /**
+     * @brief List directory at \p url, unless it is already being listed.
+     * @param[in] url - URL of directory.
+     * @param[in] node - Node of the directory, or nullptr if not visited yet.
+     * @param[in] force - Also list if a listing recently completed.
+     * @param[in] priority - Scheduling priority of the listing.
+     */
+    void requestFetch(const QUrl& url, const FileSystemModelNode* node, bool force,
+                      TaskScheduler::Priority priority);
+
+    /**
+     * @brief Ask for metadata of an entry the view is showing.
+     *
+     * Requests are collected until control returns to the event loop, so one
+     * paint of the view becomes one request for the rows it painted.
+     *
+     * @param[in] dir - The directory node.
+     * @param[in] entry - Entry index in \p dir.
+     */
+    void wantMeta(const FileSystemModelNode* dir, int entry) const;
+
+    /**
+     * @brief Ask for the thumbnail of an entry the view is showing.
+     *
+     * Collected and sent along with wantMeta() requests.
+     *
+     * @param[in] dir - The directory node.
+     * @param[in] entry - Entry index in \p dir, must have metadata.
+     */
+    void wantThumbnail(const FileSystemModelNode* dir, int entry) const;
+
+    /**
+     * @brief Repaint rows that got metadata.
+     * @param[in] result - A metadata or thumbnail result.
+     */
+    void handleMetaResult(const FileSystemModelFetchResult& result);
+
+    /**
+     * @brief Keep decoded thumbnails until they are painted, and repaint their rows.
+     * @param[in] result - A thumbnail result.
+     */
+    void handleThumbnailResult(const FileSystemModelFetchResult& result);
+
+    /**
+     * @brief Apply one listing result.
+     * @param[in] result - The result. Its delta is recomputed if stale.
+     */
+    void handleFetchResult(FileSystemModelFetchResult& result);
+
+    /**
+     * @brief Switch \p node to \p store in one layout change.
+     *
+     * Used when the difference is too scattered to be published as a few row
+     * ranges. Persistent indexes are remapped to the new rows.
+     *
+     * @param[in] node - The directory node.
+     * @param[in] delta - Difference between current listing and \p store.
+     * @param[in] store - The new listing.
+     */
+    void applyFetchResultAsLayout(FileSystemModelNode* node, const DirStoreDelta& delta, const DirStore& store);
+
+    /**
+     * @brief Change the order of rows of \p nodes in one layout change.
+     *
+     * Persistent indexes follow their entries. \p reorder may also add and
+     * hide rows, indexes of hidden rows and everything below them become
+     * invalid.
+     *
+     * @param[in] nodes - Directory nodes.
+     * @param[in] reorder - Rearranges #FileSystemModelNode::m_visibleChildren of a node.
+     */
+    void reorderRows(const QVector<FileSystemModelNode*>& nodes,
+                     const std::function<void(FileSystemModelNode*)>& reorder);
+
+    /**
+     * @brief Show \p entries of \p node as rows, in sort order.
+     *
+     * A few entries are inserted one by one where they belong, many are
+     * merged in one layout change.
+     *
+     * @param[in] node - The directory node.
+     * @param[in] entries - Entries not shown yet.
+     * @param[in] force - Show them even if filters hide them.
+     */
+    void insertEntries(FileSystemModelNode* node, const QVector<int>& entries, bool force = false);
+
+    /**
+     * @brief Move rows of \p entries to where their metadata sorts them.
+     * @param[in] node - The directory node.
+     * @param[in] entries - Entries whose size or mtime changed.
+     */
+    void resortEntries(FileSystemModelNode* node, const QVector<int>& entries);
+
+    /**
+     * @brief Read metadata of every entry of \p node if rows are sorted by it.
+     * @param[in] node - The directory node.
+     */
+    void requestSortMeta(const FileSystemModelNode* node);
+
+    /**
+     * @brief Get the directories that may be evicted.
+     *
+     * A directory may be evicted if it has a listing, it is not the root
+     * path or above it, and no persistent index, which views hold for their
+     * root, current, selected and expanded items, refers into it.
+     *
+     * @return The nodes, most recently used first.
+     */
+    QVector<FileSystemModelNode*> evictableNodes() const;
 
 public:
     QVector<TitleEntry>     m_titles;       /**< The column titles. */
+    QString                 m_dirText;      /**< Size column text of directories, translated once. */
+    mutable FileSystemModelDateFormatter m_dateFormatter; /**< Formats the date column. */
 
     /**
      * @brief The root node.
@@ -184,7 +634,70 @@ public:
      */
     FileSystemModelNode*    m_root;
 
-    QThread                 m_workerThread;
+    FileSystemModelWorker*  m_worker;       /**< Tasks posted to the scheduler. */
+
+    QUrl                        m_rootUrl;              /**< The root path, never evicted. */
+    FetchCoordinator            m_fetches;              /**< Listings in flight. */
+    FileSystemModelFetchQueue   m_fetchResults;         /**< Results from worker. */
+    QAtomicInt                  m_fetchWakePending;     /**< See FileSystemModelWorker. */
+
+    /**
+     * @brief Result of evictableNodes() while MemoryBudget::trim() runs.
+     *
+     * Evicting pops the back, so the list is built once per trim instead of
+     * once per evicted directory.
+     */
+    QVector<FileSystemModelNode*> m_evictOrder;
+    bool                        m_evictOrderValid;      /**< #m_evictOrder is in use. */
+
+    /**
+     * @brief Metadata requests not yet sent, by listing version.
+     */
+    mutable QHash<quint64, FileSystemModelMetaRequest> m_metaWanted;
+    mutable bool                m_metaFlushPending;     /**< flushMetaRequests() is scheduled. */
+    QAtomicInteger<quint64>     m_metaGeneration;       /**< Generation of the latest metadata request. */
+
+    /**
+     * @brief Thumbnail requests not yet sent, by listing version.
+     */
+    mutable QHash<quint64, FileSystemModelMetaRequest> m_thumbWanted;
+    mutable QHash<QString, QImage>  m_thumbImages;      /**< Decoded thumbnails not painted yet, by key. */
+    QSet<QString>               m_thumbFailed;          /**< Keys of files that have no thumbnail. */
+    int                         m_thumbSize;            /**< Edge length of thumbnail pixmaps. */
+
+    /**
+     * @brief Keys of thumbnails turned into pixmaps in this pass.
+     *
+     * A pass ends when the root path or size changes, or once the cache has
+     * turned over. A pixmap QPixmapCache dropped within a pass is not decoded
+     * again, so a grid showing more than the cache holds does not decode and
+     * repaint in a loop.
+     */
+    mutable QSet<QString>       m_thumbPainted;
+
+    int                         m_sortColumn;           /**< Column rows are sorted by, or -1 for listing order. */
+    Qt::SortOrder               m_sortOrder;            /**< Order of #m_sortColumn. */
+    QCollator                   m_collator;             /**< Orders extensions. */
+    QHash<quint32, int>         m_extRanks;             /**< Collation rank of extensions seen while sorting, by id. */
+
+    NameFilter                  m_nameFilter;           /**< Rules rows of every directory pass. */
+    NameMatcher                 m_quickFilter;          /**< Rows of the root path contain it. */
+    QVector<FileSystemModelFilterStep> m_quickFilterSteps;  /**< Earlier texts the current one refines, shortest first. */
+    quint64                     m_quickFilterRowsVersion; /**< Rows version of root path #m_quickFilterSteps are for. */
+
+    /**
+     * @brief Entries that got metadata and may have to move, by URL of directory.
+     */
+    QHash<QUrl, FileSystemModelMetaRequest> m_resortWanted;
+    QAtomicInteger<quint64>     m_sortGeneration;       /**< Bumped every time sort order changes. */
+
+    /**
+     * @brief Bumped every time root path changes.
+     *
+     * Results of listings requested for an older root are dropped, so rows
+     * of the directory the user navigated away from never show up.
+     */
+    QAtomicInteger<quint64> m_rootGeneration;
 };
 
 } /* namespace qfcmd */
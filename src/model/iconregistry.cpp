@@ -0,0 +1,135 @@
+#include <QFileIconProvider>
+#include <QFileInfo>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QVector>
+
+#include "iconregistry.hpp"
+
+namespace qfcmd {
+struct IconRegistryInner
+{
+    IconRegistryInner();
+    ~IconRegistryInner();
+
+    QReadWriteLock          lock;
+    QHash<QString, quint32> ids;        /**< Id by file type. */
+    QVector<QIcon>          icons;      /**< Icon by id. */
+    quint32                 fileId;     /**< Id of the generic file icon. */
+    quint32                 folderId;   /**< Id of the generic folder icon. */
+};
+} /* namespace qfcmd */
+
+static qfcmd::IconRegistryInner* s_icon_registry = nullptr;
+
+qfcmd::IconRegistryInner::IconRegistryInner()
+{
+    QFileIconProvider provider;
+
+    icons.append(QIcon());
+    fileId = (quint32)icons.size();
+    icons.append(provider.icon(QFileIconProvider::File));
+    folderId = (quint32)icons.size();
+    icons.append(provider.icon(QFileIconProvider::Folder));
+}
+
+qfcmd::IconRegistryInner::~IconRegistryInner()
+{
+}
+
+/**
+ * @brief Get the key icons of \p url are shared by.
+ * @return Key, or empty string if the generic icon is used.
+ */
+static QString _icon_registry_key(const QUrl& url)
+{
+    const QString name = url.fileName();
+    const qsizetype dot = name.lastIndexOf('.');
+    if (dot < 0)
+    {
+        return QString();
+    }
+
+    const QString ext = name.mid(dot + 1).toLower();
+#if defined(_WIN32)
+    /* These carry their own icon. */
+    if (ext == "exe" || ext == "lnk" || ext == "ico" || ext == "url")
+    {
+        return url.toString();
+    }
+#endif
+    return ext;
+}
+
+void qfcmd::IconRegistry::init()
+{
+    if (s_icon_registry != nullptr)
+    {
+        return;
+    }
+
+    s_icon_registry = new qfcmd::IconRegistryInner;
+}
+
+void qfcmd::IconRegistry::exit()
+{
+    if (s_icon_registry == nullptr)
+    {
+        return;
+    }
+
+    delete s_icon_registry;
+    s_icon_registry = nullptr;
+}
+
+quint32 qfcmd::IconRegistry::typeIcon(const qfcmd_fs_stat_t& stat)
+{
+    return (stat.st_mode & QFCMD_FS_S_IFDIR) ? s_icon_registry->folderId : s_icon_registry->fileId;
+}
+
+quint32 qfcmd::IconRegistry::lookup(const QUrl& url, const qfcmd_fs_stat_t& stat)
+{
+    const QString key = _icon_registry_key(url);
+    if ((stat.st_mode & QFCMD_FS_S_IFDIR) || key.isEmpty() || url.scheme() != "file")
+    {
+        return typeIcon(stat);
+    }
+
+    {
+        QReadLocker locker(&s_icon_registry->lock);
+        auto it = s_icon_registry->ids.constFind(key);
+        if (it != s_icon_registry->ids.constEnd())
+        {
+            return it.value();
+        }
+    }
+
+    /* A MIME lookup, keep it out of the lock. */
+    QFileIconProvider provider;
+    const QIcon icon = provider.icon(QFileInfo(url.toLocalFile()));
+
+    QWriteLocker locker(&s_icon_registry->lock);
+
+    /* Someone may insert it between the two locks. */
+    auto it = s_icon_registry->ids.constFind(key);
+    if (it != s_icon_registry->ids.constEnd())
+    {
+        return it.value();
+    }
+
+    const quint32 id = icon.isNull() ? s_icon_registry->fileId : (quint32)s_icon_registry->icons.size();
+    if (!icon.isNull())
+    {
+        s_icon_registry->icons.append(icon);
+    }
+    s_icon_registry->ids.insert(key, id);
+
+    return id;
+}
+
+QIcon qfcmd::IconRegistry::icon(quint32 id)
+{
+    QReadLocker locker(&s_icon_registry->lock);
+    Q_ASSERT(id < (quint32)s_icon_registry->icons.size());
+    return s_icon_registry->icons[id];
+}
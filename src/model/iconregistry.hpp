@@ -0,0 +1,65 @@
+#ifndef QFCMD_MODEL_ICONREGISTRY_HPP
+#define QFCMD_MODEL_ICONREGISTRY_HPP
+
+#include <QIcon>
+#include <QUrl>
+
+#include "qfcmd/filesystem.h"
+
+namespace qfcmd {
+
+/**
+ * @brief Process wide table of file icons.
+ *
+ * Icons are resolved once per file type, which is the extension for files
+ * and the generic folder icon for directories, and identified by a compact
+ * id. Listings store the id only, so all files of a type in every tab share
+ * one QIcon and one set of pixmaps.
+ *
+ * All functions are thread safe. The id 0 is always the null icon.
+ */
+class IconRegistry
+{
+public:
+    /**
+     * @brief Initialize the table.
+     */
+    static void init();
+
+    /**
+     * @brief Exit the table.
+     */
+    static void exit();
+
+    /**
+     * @brief Get id of the generic icon for the type of file.
+     *
+     * Costs no I/O, used until the real icon is known.
+     *
+     * @param[in] stat - File status, only st_mode is used.
+     * @return Icon id.
+     */
+    static quint32 typeIcon(const qfcmd_fs_stat_t& stat);
+
+    /**
+     * @brief Get id of the icon of \p url.
+     *
+     * The first file of a type seen decides the icon of the type.
+     *
+     * @param[in] url - URL of file.
+     * @param[in] stat - File status.
+     * @return Icon id.
+     */
+    static quint32 lookup(const QUrl& url, const qfcmd_fs_stat_t& stat);
+
+    /**
+     * @brief Get icon by id.
+     * @param[in] id - Icon id.
+     * @return The shared icon.
+     */
+    static QIcon icon(quint32 id);
+};
+
+} /* namespace qfcmd */
+
+#endif
@@ -0,0 +1,204 @@
+#include <QRegularExpression>
+#include <QSet>
+#include <cstring>
+
+#include "namefilter.hpp"
+
+namespace qfcmd {
+
+/**
+ * @brief Compiled rules of one kind, include or exclude.
+ */
+struct NameFilterRuleSet
+{
+    NameFilterRuleSet();
+
+    QSet<QByteArray>    names;      /**< Whole names. */
+    QList<QByteArray>   prefixes;   /**< Leading bytes of names. */
+    QList<QByteArray>   suffixes;   /**< Trailing bytes of names. */
+    QStringList         patterns;   /**< Regular expressions of all other rules. */
+    QRegularExpression  regex;      /**< #patterns joined in one expression. */
+    bool                empty;      /**< No rule at all. */
+};
+
+struct NameFilterInner
+{
+    QStringList         rules;      /**< Source of the rules. */
+    NameFilterRuleSet   exclude;    /**< Hide matching entries. */
+    NameFilterRuleSet   include;    /**< Only show matching files. */
+};
+
+} /* namespace qfcmd */
+
+qfcmd::NameFilterRuleSet::NameFilterRuleSet()
+{
+    empty = true;
+}
+
+static bool _name_filter_is_wildcard(QChar c)
+{
+    return c == '*' || c == '?' || c == '[';
+}
+
+static bool _name_filter_is_plain(QStringView text)
+{
+    for (QChar c : text)
+    {
+        if (_name_filter_is_wildcard(c))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Add \p rule, without its prefix, to \p set.
+ */
+static void _name_filter_add_rule(qfcmd::NameFilterRuleSet& set, const QString& rule)
+{
+    if (rule.isEmpty())
+    {
+        return;
+    }
+
+    if (rule.size() >= 2 && rule.startsWith('/') && rule.endsWith('/'))
+    {
+        const QString pattern = rule.mid(1, rule.size() - 2);
+        if (!QRegularExpression(pattern).isValid())
+        {
+            return;
+        }
+        set.patterns.append(pattern);
+    }
+    else if (_name_filter_is_plain(rule))
+    {
+        set.names.insert(rule.toUtf8());
+    }
+    else if (rule.endsWith('*') && _name_filter_is_plain(QStringView(rule).chopped(1)))
+    {
+        set.prefixes.append(rule.chopped(1).toUtf8());
+    }
+    else if (rule.startsWith('*') && _name_filter_is_plain(QStringView(rule).mid(1)))
+    {
+        set.suffixes.append(rule.mid(1).toUtf8());
+    }
+    else
+    {
+        set.patterns.append(QRegularExpression::wildcardToRegularExpression(rule));
+    }
+    set.empty = false;
+}
+
+/**
+ * @brief Join the regular expressions of \p set into one.
+ */
+static void _name_filter_compile(qfcmd::NameFilterRuleSet& set)
+{
+    if (set.patterns.isEmpty())
+    {
+        return;
+    }
+
+    QString joined;
+    for (const QString& pattern : set.patterns)
+    {
+        joined += (joined.isEmpty() ? QString() : QStringLiteral("|")) + "(?:" + pattern + ")";
+    }
+    set.regex = QRegularExpression(joined, QRegularExpression::DontCaptureOption);
+    set.regex.optimize();
+}
+
+static bool _name_filter_match(const qfcmd::NameFilterRuleSet& set, const char* name, int len)
+{
+    if (set.names.contains(QByteArray::fromRawData(name, len)))
+    {
+        return true;
+    }
+    for (const QByteArray& prefix : set.prefixes)
+    {
+        if (prefix.size() <= len && memcmp(name, prefix.constData(), prefix.size()) == 0)
+        {
+            return true;
+        }
+    }
+    for (const QByteArray& suffix : set.suffixes)
+    {
+        if (suffix.size() <= len && memcmp(name + len - suffix.size(), suffix.constData(), suffix.size()) == 0)
+        {
+            return true;
+        }
+    }
+
+    /* Only rules that need it pay for decoding the name. */
+    return !set.patterns.isEmpty() && set.regex.match(QString::fromUtf8(name, len)).hasMatch();
+}
+
+qfcmd::NameFilter::NameFilter()
+{
+}
+
+qfcmd::NameFilter::NameFilter(const QStringList& rules)
+{
+    QSharedPointer<NameFilterInner> inner(new NameFilterInner);
+    inner->rules = rules;
+
+    for (const QString& rule : rules)
+    {
+        if (rule.startsWith('+'))
+        {
+            _name_filter_add_rule(inner->include, rule.mid(1));
+        }
+        else if (rule.startsWith('-'))
+        {
+            _name_filter_add_rule(inner->exclude, rule.mid(1));
+        }
+        else
+        {
+            _name_filter_add_rule(inner->exclude, rule);
+        }
+    }
+    _name_filter_compile(inner->include);
+    _name_filter_compile(inner->exclude);
+
+    /* Rules that all failed to compile are kept, so they can still be edited. */
+    if (!rules.isEmpty())
+    {
+        m_inner = inner;
+    }
+}
+
+QString qfcmd::NameFilter::hiddenFilesRule()
+{
+    return QStringLiteral("-.*");
+}
+
+QStringList qfcmd::NameFilter::rules() const
+{
+    return m_inner.isNull() ? QStringList() : m_inner->rules;
+}
+
+bool qfcmd::NameFilter::isEmpty() const
+{
+    return m_inner.isNull() || (m_inner->include.empty && m_inner->exclude.empty);
+}
+
+bool qfcmd::NameFilter::accepts(const DirStore& store, int idx) const
+{
+    if (isEmpty())
+    {
+        return true;
+    }
+
+    int len = 0;
+    const char* name = store.nameUtf8(idx, &len);
+    if (!m_inner->exclude.empty && _name_filter_match(m_inner->exclude, name, len))
+    {
+        return false;
+    }
+    if (m_inner->include.empty || store.isDir(idx))
+    {
+        return true;
+    }
+    return _name_filter_match(m_inner->include, name, len);
+}
@@ -0,0 +1,71 @@
+#ifndef QFCMD_MODEL_NAMEFILTER_HPP
+#define QFCMD_MODEL_NAMEFILTER_HPP
+
+#include <QSharedPointer>
+#include <QStringList>
+
+#include "dirstore.hpp"
+
+namespace qfcmd {
+
+struct NameFilterInner;
+
+/**
+ * @brief Compiled include and exclude rules on names of entries.
+ *
+ * Each rule is a wildcard, or a regular expression between slashes, prefixed
+ * by '-' to hide matching entries or '+' to only show matching files. A rule
+ * without prefix hides. Directories are never hidden by include rules.
+ *
+ * Rules are compiled once: plain names, prefixes such as ".*" and suffixes
+ * such as "*.o" are compared on the UTF-8 bytes of the listing, and all other
+ * rules of a kind are joined into one regular expression. Names are matched
+ * case sensitively.
+ *
+ * Cheap to copy and safe to share between threads once built.
+ */
+class NameFilter
+{
+public:
+    /**
+     * @brief Create a filter that shows every entry.
+     */
+    NameFilter();
+
+    /**
+     * @brief Compile \p rules.
+     * @param[in] rules - Rules in the syntax described above. Rules that do
+     *   not compile are ignored.
+     */
+    explicit NameFilter(const QStringList& rules);
+
+public:
+    /**
+     * @brief Get the rule that hides names starting with a dot.
+     */
+    static QString hiddenFilesRule();
+
+    /**
+     * @brief Get the rules the filter was compiled from.
+     */
+    QStringList rules() const;
+
+    /**
+     * @brief Check if the filter shows every entry.
+     */
+    bool isEmpty() const;
+
+    /**
+     * @brief Check if entry \p idx of \p store passes the rules.
+     * @param[in] store - The listing.
+     * @param[in] idx - Entry index.
+     */
+    bool accepts(const DirStore& store, int idx) const;
+
+private:
+    QSharedPointer<const NameFilterInner>   m_inner;    /**< Compiled rules, null if there is none. */
+};
+
+} /* namespace qfcmd */
+
+#endif
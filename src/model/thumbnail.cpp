@@ -0,0 +1,586 @@
+#include <cstring>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QList>
+#include <QMutex>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QTransform>
+#include <QVector>
+
+#include "utils/scheduler.hpp"
+#include "settings.hpp"
+#include "thumbnail.hpp"
+
+/**
+ * @brief Files larger than this get no thumbnail, reading them costs too much.
+ */
+static const quint64 THUMBNAIL_MAX_FILE_SIZE = 64 * 1024 * 1024;
+
+/**
+ * @brief Images in formats that cannot decode scaled get no thumbnail beyond this many pixels.
+ */
+static const qint64 THUMBNAIL_MAX_FULL_DECODE_PIXELS = 16 * 1024 * 1024;
+
+/**
+ * @brief Bytes at the start of a JPEG file searched for the EXIF segment, which is at most 64 KiB.
+ */
+static const qint64 THUMBNAIL_EXIF_HEAD_SIZE = 65536 + 1024;
+
+/**
+ * @brief Max number of thumbnails waiting to be written, more are not cached.
+ */
+static const int THUMBNAIL_MAX_PENDING_WRITES = 256;
+
+/**
+ * @brief Check the size of the disk cache after this many writes.
+ */
+static const int THUMBNAIL_CLEANUP_INTERVAL = 64;
+
+/**
+ * @brief A thumbnail read from disk is marked used again once this old.
+ */
+static const qint64 THUMBNAIL_TOUCH_SEC = 24 * 60 * 60;
+
+namespace qfcmd {
+
+struct ThumbnailWrite
+{
+    QString     path;       /**< Path in the disk cache. */
+    QImage      image;      /**< Thumbnail with its text keys set. */
+};
+
+struct ThumbnailInner
+{
+    ThumbnailInner();
+
+    QString                 cacheDir;       /**< Directory of the disk cache, empty if there is none. */
+    qint64                  cacheLimit;     /**< Max size of the disk cache in bytes. */
+
+    QMutex                  mutex;          /**< Protects the fields below. */
+    QList<ThumbnailWrite>   pending;        /**< Thumbnails to write. */
+    bool                    flushPending;   /**< A task to write #pending is posted. */
+    int                     writes;         /**< Writes since the last cleanup. */
+};
+
+} /* namespace qfcmd */
+
+static qfcmd::ThumbnailInner* s_thumbnail = nullptr;
+
+qfcmd::ThumbnailInner::ThumbnailInner()
+{
+    cacheLimit = 0;
+    flushPending = false;
+    writes = 0;
+}
+
+/**
+ * @brief Get path of the thumbnail of \p uri in the disk cache.
+ *
+ * Named like in the freedesktop.org thumbnail spec, so thumbnails are shared
+ * with other file managers.
+ */
+static QString _thumbnail_cache_path(const QByteArray& uri)
+{
+    const QByteArray md5 = QCryptographicHash::hash(uri, QCryptographicHash::Md5).toHex();
+    return s_thumbnail->cacheDir + "/" + QString::fromLatin1(md5) + ".png";
+}
+
+/**
+ * @brief Read the thumbnail of \p uri from the disk cache.
+ * @return The thumbnail, or null image if it is missing or made from another version of the file.
+ */
+static QImage _thumbnail_cache_read(const QByteArray& uri, const qfcmd_fs_stat_t& stat)
+{
+    QFile file(_thumbnail_cache_path(uri));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return QImage();
+    }
+
+    const qint64 size = file.size();
+    uchar* data = file.map(0, size);
+    if (data == nullptr)
+    {
+        return QImage();
+    }
+
+    QImage image;
+    const bool loaded = image.loadFromData(data, (int)size, "PNG");
+    file.unmap(data);
+    if (!loaded)
+    {
+        return QImage();
+    }
+
+    if (image.text("Thumb::URI") != QString::fromUtf8(uri)
+        || image.text("Thumb::MTime") != QString::number(stat.st_mtime))
+    {
+        return QImage();
+    }
+
+    /* Cleanup drops least recently used thumbnails first. */
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    if (file.fileTime(QFileDevice::FileModificationTime).secsTo(now) > THUMBNAIL_TOUCH_SEC)
+    {
+        file.setFileTime(now, QFileDevice::FileModificationTime);
+    }
+
+    return image;
+}
+
+/**
+ * @brief Drop least recently used thumbnails until the disk cache is well below its limit.
+ */
+static void _thumbnail_cache_cleanup()
+{
+    QDir dir(s_thumbnail->cacheDir);
+    const QFileInfoList files = dir.entryInfoList({ "*.png" }, QDir::Files, QDir::Time);
+
+    qint64 total = 0;
+    for (const QFileInfo& info : files)
+    {
+        total += info.size();
+    }
+
+    /* Sorted newest first. */
+    const qint64 target = s_thumbnail->cacheLimit / 4 * 3;
+    for (qsizetype i = files.size() - 1; i >= 0 && total > s_thumbnail->cacheLimit; i--)
+    {
+        if (QFile::remove(files[i].absoluteFilePath()))
+        {
+            total -= files[i].size();
+        }
+        if (total <= target)
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Write all pending thumbnails.
+ */
+static void _thumbnail_cache_flush()
+{
+    QList<qfcmd::ThumbnailWrite> pending;
+    {
+        QMutexLocker locker(&s_thumbnail->mutex);
+        pending.swap(s_thumbnail->pending);
+        s_thumbnail->flushPending = false;
+    }
+    if (pending.isEmpty())
+    {
+        return;
+    }
+
+    QDir().mkpath(s_thumbnail->cacheDir);
+    for (const qfcmd::ThumbnailWrite& write : pending)
+    {
+        QSaveFile file(write.path);
+        if (!file.open(QIODevice::WriteOnly) || !write.image.save(&file, "PNG") || !file.commit())
+        {
+            continue;
+        }
+        QFile::setPermissions(write.path, QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    }
+
+    bool cleanup = false;
+    {
+        QMutexLocker locker(&s_thumbnail->mutex);
+        s_thumbnail->writes += pending.size();
+        if (s_thumbnail->writes >= THUMBNAIL_CLEANUP_INTERVAL)
+        {
+            s_thumbnail->writes = 0;
+            cleanup = true;
+        }
+    }
+    if (cleanup)
+    {
+        _thumbnail_cache_cleanup();
+    }
+}
+
+/**
+ * @brief Queue \p image to be written to the disk cache in the background.
+ */
+static void _thumbnail_cache_write(const QByteArray& uri, const qfcmd_fs_stat_t& stat, QImage image)
+{
+    image.setText("Thumb::URI", QString::fromUtf8(uri));
+    image.setText("Thumb::MTime", QString::number(stat.st_mtime));
+    image.setText("Software", "qfcmd");
+
+    QMutexLocker locker(&s_thumbnail->mutex);
+    if (s_thumbnail->pending.size() >= THUMBNAIL_MAX_PENDING_WRITES)
+    {
+        return;
+    }
+    s_thumbnail->pending.append({ _thumbnail_cache_path(uri), image });
+
+    /* One task writes whatever is pending by the time it runs. */
+    if (!s_thumbnail->flushPending)
+    {
+        s_thumbnail->flushPending = true;
+        qfcmd::TaskScheduler::post(s_thumbnail, qfcmd::TaskScheduler::POOL_IO, qfcmd::TaskScheduler::PRIORITY_LOW,
+                                   _thumbnail_cache_flush);
+    }
+}
+
+/**
+ * @brief Read an unsigned integer from EXIF data.
+ * @param[in] p - Data, at least \p size bytes.
+ * @param[in] size - 2 or 4.
+ * @param[in] le - Little endian.
+ */
+static quint32 _thumbnail_exif_uint(const uchar* p, int size, bool le)
+{
+    quint32 v = 0;
+    for (int i = 0; i < size; i++)
+    {
+        v |= (quint32)p[le ? i : size - 1 - i] << (8 * i);
+    }
+    return v;
+}
+
+/**
+ * @brief Find the thumbnail embedded in the EXIF data of a JPEG file.
+ * @param[in] head - Start of the file.
+ * @param[out] orientation - EXIF orientation of the image, 1 if unknown.
+ * @return The embedded JPEG, or empty if there is none.
+ */
+static QByteArray _thumbnail_exif_extract(const QByteArray& head, int* orientation)
+{
+    *orientation = 1;
+
+    const uchar* data = reinterpret_cast<const uchar*>(head.constData());
+    const qsizetype size = head.size();
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+    {
+        return QByteArray();
+    }
+
+    /* Walk the segments before the image data for APP1 "Exif". */
+    qsizetype pos = 2;
+    const uchar* tiff = nullptr;
+    qsizetype tiffSize = 0;
+    while (pos + 4 <= size && data[pos] == 0xFF)
+    {
+        const uchar marker = data[pos + 1];
+        const qsizetype len = ((qsizetype)data[pos + 2] << 8) | data[pos + 3];
+        if (marker == 0xDA || len < 2 || pos + 2 + len > size)
+        {
+            break;
+        }
+        if (marker == 0xE1 && len >= 8 && memcmp(data + pos + 4, "Exif\0\0", 6) == 0)
+        {
+            tiff = data + pos + 10;
+            tiffSize = len - 8;
+            break;
+        }
+        pos += 2 + len;
+    }
+    if (tiff == nullptr || tiffSize < 8)
+    {
+        return QByteArray();
+    }
+
+    const bool le = tiff[0] == 'I' && tiff[1] == 'I';
+    if (!le && !(tiff[0] == 'M' && tiff[1] == 'M'))
+    {
+        return QByteArray();
+    }
+
+    /* IFD0 holds the orientation, IFD1 the thumbnail. */
+    quint32 thumbOffset = 0;
+    quint32 thumbLength = 0;
+    quint32 ifd = _thumbnail_exif_uint(tiff + 4, 4, le);
+    for (int n = 0; n < 2 && ifd != 0 && (qsizetype)ifd + 2 <= tiffSize; n++)
+    {
+        const quint32 count = _thumbnail_exif_uint(tiff + ifd, 2, le);
+        if ((qsizetype)ifd + 2 + (qsizetype)count * 12 + 4 > tiffSize)
+        {
+            break;
+        }
+
+        for (quint32 i = 0; i < count; i++)
+        {
+            const uchar* entry = tiff + ifd + 2 + i * 12;
+            const quint32 tag = _thumbnail_exif_uint(entry, 2, le);
+            const quint32 type = _thumbnail_exif_uint(entry + 2, 2, le);
+            const quint32 value = type == 3 ? _thumbnail_exif_uint(entry + 8, 2, le)
+                                            : _thumbnail_exif_uint(entry + 8, 4, le);
+            if (n == 0 && tag == 0x0112)
+            {
+                *orientation = (int)value;
+            }
+            else if (n == 1 && tag == 0x0201)
+            {
+                thumbOffset = value;
+            }
+            else if (n == 1 && tag == 0x0202)
+            {
+                thumbLength = value;
+            }
+        }
+        ifd = _thumbnail_exif_uint(tiff + ifd + 2 + count * 12, 4, le);
+    }
+
+    if (thumbOffset == 0 || thumbLength == 0 || (qsizetype)thumbOffset + thumbLength > tiffSize)
+    {
+        return QByteArray();
+    }
+    return QByteArray(reinterpret_cast<const char*>(tiff + thumbOffset), thumbLength);
+}
+
+/**
+ * @brief Turn \p image upright as told by EXIF \p orientation.
+ */
+static QImage _thumbnail_exif_orient(const QImage& image, int orientation)
+{
+    QTransform transform;
+    switch (orientation)
+    {
+    case 2: transform.scale(-1, 1); break;
+    case 3: transform.rotate(180); break;
+    case 4: transform.scale(1, -1); break;
+    case 5: transform.rotate(90); transform.scale(-1, 1); break;
+    case 6: transform.rotate(90); break;
+    case 7: transform.rotate(-90); transform.scale(-1, 1); break;
+    case 8: transform.rotate(-90); break;
+    default: return image;
+    }
+    return image.transformed(transform);
+}
+
+/**
+ * @brief Shrink \p src by averaging \p factor x \p factor pixel blocks.
+ *
+ * Averaging premultiplied channels is an exact area filter for integer
+ * factors. The inner loop adds four independent lanes, which compilers turn
+ * into vector code.
+ */
+static QImage _thumbnail_box_downscale(const QImage& src, int factor)
+{
+    const QImage in = src.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    const int w = in.width() / factor;
+    const int h = in.height() / factor;
+    const quint32 area = (quint32)(factor * factor);
+
+    QImage out(w, h, QImage::Format_ARGB32_Premultiplied);
+    QVector<quint32> sums((qsizetype)w * 4);
+    for (int y = 0; y < h; y++)
+    {
+        sums.fill(0);
+        quint32* sum = sums.data();
+        for (int dy = 0; dy < factor; dy++)
+        {
+            const uchar* line = in.constScanLine(y * factor + dy);
+            for (int x = 0; x < w; x++)
+            {
+                const uchar* p = line + (size_t)x * factor * 4;
+                for (int k = 0; k < factor * 4; k += 4)
+                {
+                    sum[x * 4 + 0] += p[k + 0];
+                    sum[x * 4 + 1] += p[k + 1];
+                    sum[x * 4 + 2] += p[k + 2];
+                    sum[x * 4 + 3] += p[k + 3];
+                }
+            }
+        }
+
+        uchar* dst = out.scanLine(y);
+        for (int i = 0; i < w * 4; i++)
+        {
+            dst[i] = (uchar)((sum[i] + area / 2) / area);
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief Shrink \p image to fit ThumbnailLoader::SIZE.
+ */
+static QImage _thumbnail_fit(const QImage& image)
+{
+    const int size = qfcmd::ThumbnailLoader::SIZE;
+    if (image.width() <= size && image.height() <= size)
+    {
+        return image;
+    }
+
+    const QSize target = image.size().scaled(size, size, Qt::KeepAspectRatio);
+    const int factor = qMin(image.width() / qMax(target.width(), 1), image.height() / qMax(target.height(), 1));
+    const QImage boxed = factor >= 2 ? _thumbnail_box_downscale(image, factor) : image;
+    if (boxed.size() == target)
+    {
+        return boxed;
+    }
+    return boxed.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+/**
+ * @brief Use the thumbnail embedded in a JPEG file if it is big enough.
+ * @param[in] head - Start of the file.
+ * @return The thumbnail, or null image.
+ */
+static QImage _thumbnail_decode_exif(const QByteArray& head)
+{
+    int orientation = 1;
+    const QByteArray jpeg = _thumbnail_exif_extract(head, &orientation);
+    if (jpeg.isEmpty())
+    {
+        return QImage();
+    }
+
+    QImage image;
+    if (!image.loadFromData(jpeg, "JPEG"))
+    {
+        return QImage();
+    }
+
+    /* Usually 160x120, too small only for tiny thumbnails of huge panoramas. */
+    const int size = qfcmd::ThumbnailLoader::SIZE;
+    if (image.width() < size && image.height() < size)
+    {
+        return QImage();
+    }
+    return _thumbnail_fit(_thumbnail_exif_orient(image, orientation));
+}
+
+/**
+ * @brief Decode the thumbnail of local file \p path.
+ *
+ * Cheapest first: the thumbnail embedded in EXIF, then a decode at reduced
+ * size for formats that support it, which for JPEG skips most of the IDCT.
+ * The result is shrunk with a box filter to fit ThumbnailLoader::SIZE.
+ */
+static QImage _thumbnail_decode(const QString& path, const qfcmd_fs_stat_t& stat)
+{
+    if (stat.st_size > THUMBNAIL_MAX_FILE_SIZE)
+    {
+        return QImage();
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return QImage();
+    }
+
+    /* Only JPEG has EXIF thumbnails, the check for its magic is inside. */
+    const QImage exif = _thumbnail_decode_exif(file.read(THUMBNAIL_EXIF_HEAD_SIZE));
+    if (!exif.isNull() || !file.seek(0))
+    {
+        return exif;
+    }
+
+    QImageReader reader(&file);
+    if (!reader.canRead())
+    {
+        return QImage();
+    }
+
+    reader.setAutoTransform(true);
+    const QSize full = reader.size();
+    const int size = qfcmd::ThumbnailLoader::SIZE;
+    if (full.isValid() && (full.width() > size * 2 || full.height() > size * 2))
+    {
+        if (reader.supportsOption(QImageIOHandler::ScaledSize))
+        {
+            /* Twice the target leaves the box filter something to average. */
+            reader.setScaledSize(full.scaled(size * 2, size * 2, Qt::KeepAspectRatio));
+        }
+        else if ((qint64)full.width() * full.height() > THUMBNAIL_MAX_FULL_DECODE_PIXELS)
+        {
+            return QImage();
+        }
+    }
+
+    QImage image;
+    if (!reader.read(&image))
+    {
+        return QImage();
+    }
+
+    return _thumbnail_fit(image);
+}
+
+static QSet<QString> _thumbnail_formats()
+{
+    QSet<QString> formats;
+    for (const QByteArray& format : QImageReader::supportedImageFormats())
+    {
+        formats.insert(QString::fromLatin1(format).toLower());
+    }
+    return formats;
+}
+
+void qfcmd::ThumbnailLoader::init()
+{
+    if (s_thumbnail != nullptr)
+    {
+        return;
+    }
+
+    s_thumbnail = new ThumbnailInner;
+    s_thumbnail->cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+        + "/thumbnails/normal";
+    s_thumbnail->cacheLimit = Settings::get<qint64>(Settings::THUMBNAIL_CACHE_MB) * 1024 * 1024;
+}
+
+void qfcmd::ThumbnailLoader::exit()
+{
+    if (s_thumbnail == nullptr)
+    {
+        return;
+    }
+
+    /* Write what is left instead of decoding it again next time. */
+    TaskScheduler::cancel(s_thumbnail);
+    _thumbnail_cache_flush();
+
+    delete s_thumbnail;
+    s_thumbnail = nullptr;
+}
+
+bool qfcmd::ThumbnailLoader::accepts(const QString& ext)
+{
+    static const QSet<QString> formats = _thumbnail_formats();
+    return !ext.isEmpty() && formats.contains(ext.toLower());
+}
+
+QString qfcmd::ThumbnailLoader::key(const QUrl& url, quint64 mtime)
+{
+    return QStringLiteral("thumb:%1:%2").arg(url.toString()).arg(mtime);
+}
+
+QImage qfcmd::ThumbnailLoader::load(const QUrl& url, const qfcmd_fs_stat_t& stat)
+{
+    if (url.scheme() != "file")
+    {
+        return QImage();
+    }
+
+    const bool cache = s_thumbnail != nullptr && s_thumbnail->cacheLimit > 0;
+    const QByteArray uri = url.toEncoded();
+    if (cache)
+    {
+        const QImage image = _thumbnail_cache_read(uri, stat);
+        if (!image.isNull())
+        {
+            return image;
+        }
+    }
+
+    const QImage image = _thumbnail_decode(url.toLocalFile(), stat);
+    if (cache && !image.isNull())
+    {
+        _thumbnail_cache_write(uri, stat, image);
+    }
+    return image;
+}
@@ -0,0 +1,73 @@
+#ifndef QFCMD_MODEL_THUMBNAIL_HPP
+#define QFCMD_MODEL_THUMBNAIL_HPP
+
+#include <QImage>
+#include <QString>
+#include <QUrl>
+
+#include "qfcmd/filesystem.h"
+
+namespace qfcmd {
+
+/**
+ * @brief Decode image files into thumbnails.
+ *
+ * Thumbnails are decoded into QImage, which may be done on any thread. They
+ * are turned into pixmaps on the GUI thread only when they are painted.
+ *
+ * Decoded thumbnails of local files are kept on disk in the freedesktop.org
+ * thumbnail cache, keyed by URI and mtime, and written in the background.
+ * The cache is capped by Settings::THUMBNAIL_CACHE_MB, least recently used
+ * thumbnails are dropped first.
+ *
+ * All functions are thread safe.
+ */
+class ThumbnailLoader
+{
+public:
+    /**
+     * @brief Edge length of the box thumbnails are scaled to fit in.
+     */
+    static const int SIZE = 128;
+
+public:
+    /**
+     * @brief Initialize the disk cache.
+     */
+    static void init();
+
+    /**
+     * @brief Write thumbnails still pending and exit the disk cache.
+     */
+    static void exit();
+
+    /**
+     * @brief Check if files with extension \p ext may have a thumbnail.
+     * @param[in] ext - Extension without dot, any case.
+     */
+    static bool accepts(const QString& ext);
+
+    /**
+     * @brief Get the key the thumbnail of a file is cached by.
+     * @param[in] url - URL of file.
+     * @param[in] mtime - Last modified time of file, a new version gets a new key.
+     * @return Key.
+     */
+    static QString key(const QUrl& url, quint64 mtime);
+
+    /**
+     * @brief Decode the thumbnail of \p url.
+     *
+     * Costs I/O and a decode if the thumbnail is not on disk yet, never call
+     * it on the GUI thread.
+     *
+     * @param[in] url - URL of file.
+     * @param[in] stat - File status.
+     * @return The thumbnail, or null image if the file has none.
+     */
+    static QImage load(const QUrl& url, const qfcmd_fs_stat_t& stat);
+};
+
+} /* namespace qfcmd */
+
+#endif
@@ -21,7 +21,13 @@
     xx(TABS_PANEL_0,            "Tabs/Panel_0",             QStringList())                          \
     xx(TABS_PANEL_1,            "Tabs/Panel_1",             QStringList())                          \
     xx(TABS_PANEL_0_ACTIVATE,   "Tabs/Panel_0_Activate",    0)                                      \
-    xx(TABS_PANEL_1_ACTIVATE,   "Tabs/Panel_1_Activate",    0)
+    xx(TABS_PANEL_1_ACTIVATE,   "Tabs/Panel_1_Activate",    0)                                      \
+    xx(TABS_HIBERNATE_SEC,      "Tabs/HibernateSec",        300)                                    \
+    xx(MEMORY_BUDGET_MB,        "Memory/BudgetMB",          256)                                    \
+    xx(THUMBNAIL_CACHE_MB,      "Thumbnails/CacheMB",       128)                                    \
+    xx(VIEW_GRID_ICON_SIZE,     "View/GridIconSize",        96)                                     \
+    xx(FILTER_PANEL_0,          "Filter/Panel_0",           QStringList{ "-.*" })                   \
+    xx(FILTER_PANEL_1,          "Filter/Panel_1",           QStringList{ "-.*" })
 
 namespace qfcmd {
 
@@ -0,0 +1,98 @@
+#include <QByteArray>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QVector>
+
+#include "interner.hpp"
+
+namespace qfcmd {
+struct StringInternerInner
+{
+    StringInternerInner();
+    ~StringInternerInner();
+
+    QReadWriteLock              lock;
+    QHash<QByteArray, quint32>  ids;        /**< Id by UTF-8 string. */
+    QVector<QString>            strings;    /**< String by id. */
+};
+} /* namespace qfcmd */
+
+static qfcmd::StringInternerInner* s_interner = nullptr;
+
+qfcmd::StringInternerInner::StringInternerInner()
+{
+    ids.insert(QByteArray(), 0);
+    strings.append(QString());
+}
+
+qfcmd::StringInternerInner::~StringInternerInner()
+{
+}
+
+void qfcmd::StringInterner::init()
+{
+    if (s_interner != nullptr)
+    {
+        return;
+    }
+
+    s_interner = new qfcmd::StringInternerInner;
+}
+
+void qfcmd::StringInterner::exit()
+{
+    if (s_interner == nullptr)
+    {
+        return;
+    }
+
+    delete s_interner;
+    s_interner = nullptr;
+}
+
+quint32 qfcmd::StringInterner::intern(const char* str, int len)
+{
+    if (len <= 0)
+    {
+        return 0;
+    }
+
+    /* Lookup without copy, the common case. */
+    const QByteArray key = QByteArray::fromRawData(str, len);
+    {
+        QReadLocker locker(&s_interner->lock);
+        auto it = s_interner->ids.constFind(key);
+        if (it != s_interner->ids.constEnd())
+        {
+            return it.value();
+        }
+    }
+
+    QWriteLocker locker(&s_interner->lock);
+
+    /* Someone may insert it between the two locks. */
+    auto it = s_interner->ids.constFind(key);
+    if (it != s_interner->ids.constEnd())
+    {
+        return it.value();
+    }
+
+    const quint32 id = (quint32)s_interner->strings.size();
+    s_interner->strings.append(QString::fromUtf8(str, len));
+    s_interner->ids.insert(QByteArray(str, len), id);
+
+    return id;
+}
+
+quint32 qfcmd::StringInterner::intern(const QString& str)
+{
+    const QByteArray utf8 = str.toUtf8();
+    return intern(utf8.constData(), utf8.size());
+}
+
+QString qfcmd::StringInterner::get(quint32 id)
+{
+    QReadLocker locker(&s_interner->lock);
+    Q_ASSERT(id < (quint32)s_interner->strings.size());
+    return s_interner->strings[id];
+}
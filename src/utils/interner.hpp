@@ -0,0 +1,55 @@
+#ifndef QFCMD_UTILS_INTERNER_HPP
+#define QFCMD_UTILS_INTERNER_HPP
+
+#include <QString>
+
+namespace qfcmd {
+
+/**
+ * @brief Process wide string table.
+ *
+ * Every distinct string is stored once and identified by a compact id, so
+ * strings that repeat across directories and tabs (for example file
+ * extensions) share one allocation.
+ *
+ * All functions are thread safe. The id 0 is always the empty string.
+ */
+class StringInterner
+{
+public:
+    /**
+     * @brief Initialize the string table.
+     */
+    static void init();
+
+    /**
+     * @brief Exit the string table.
+     */
+    static void exit();
+
+    /**
+     * @brief Get id of string.
+     * @param[in] str - UTF-8 string, not required to be NUL terminated.
+     * @param[in] len - Length of \p str in bytes.
+     * @return String id.
+     */
+    static quint32 intern(const char* str, int len);
+
+    /**
+     * @brief Get id of string.
+     * @param[in] str - String.
+     * @return String id.
+     */
+    static quint32 intern(const QString& str);
+
+    /**
+     * @brief Get string by id.
+     * @param[in] id - String id.
+     * @return The shared string.
+     */
+    static QString get(quint32 id);
+};
+
+} /* namespace qfcmd */
+
+#endif
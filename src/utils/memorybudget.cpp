@@ -0,0 +1,256 @@
+#include <climits>
+#include <QList>
+#include <QPixmapCache>
+#include <QTimer>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <QSocketNotifier>
+#endif
+
+#include "settings.hpp"
+#include "memorybudget.hpp"
+
+/**
+ * @brief Fraction of the budget, in 1/N, given to QPixmapCache.
+ */
+static const int MEMORY_BUDGET_PIXMAP_SHARE = 8;
+
+#if defined(__linux__)
+/**
+ * @brief Notify when tasks stall on memory for 150ms within 1s.
+ */
+static const char* MEMORY_BUDGET_PSI_TRIGGER = "some 150000 1000000";
+#endif
+
+namespace qfcmd {
+struct MemoryBudgetInner
+{
+    MemoryBudgetInner();
+    ~MemoryBudgetInner();
+
+    QList<MemoryConsumer*>  consumers;      /**< Registered consumers. */
+    qint64                  budget;         /**< Budget in bytes. */
+    qint64                  lastTick;       /**< Last stamp handed out. */
+    bool                    checkPending;   /**< A check is scheduled. */
+
+#if defined(__linux__)
+    int                     psiFd;          /**< Memory pressure trigger, or -1. */
+    QSocketNotifier*        psiNotifier;    /**< Watches #psiFd. */
+#endif
+};
+} /* namespace qfcmd */
+
+static qfcmd::MemoryBudgetInner* s_memory_budget = nullptr;
+
+qfcmd::MemoryConsumer::~MemoryConsumer()
+{
+}
+
+void qfcmd::MemoryConsumer::memoryTrimBegin()
+{
+}
+
+void qfcmd::MemoryConsumer::memoryTrimEnd()
+{
+}
+
+qfcmd::MemoryBudgetInner::MemoryBudgetInner()
+{
+    budget = 0;
+    lastTick = 0;
+    checkPending = false;
+#if defined(__linux__)
+    psiFd = -1;
+    psiNotifier = nullptr;
+#endif
+}
+
+qfcmd::MemoryBudgetInner::~MemoryBudgetInner()
+{
+#if defined(__linux__)
+    delete psiNotifier;
+    if (psiFd >= 0)
+    {
+        close(psiFd);
+    }
+#endif
+}
+
+/**
+ * @brief The system is short of memory, give back half of what we hold.
+ */
+static void _memory_budget_on_pressure()
+{
+    QPixmapCache::clear();
+    qfcmd::MemoryBudget::trim(qfcmd::MemoryBudget::usage() / 2);
+}
+
+#if defined(__linux__)
+/**
+ * @brief Register a memory pressure stall trigger.
+ *
+ * Kernels without PSI, or without permission to create triggers, just get
+ * no notifications.
+ */
+static void _memory_budget_setup_psi(qfcmd::MemoryBudgetInner* inner)
+{
+    int fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    const size_t len = strlen(MEMORY_BUDGET_PSI_TRIGGER) + 1;
+    if (write(fd, MEMORY_BUDGET_PSI_TRIGGER, len) != (ssize_t)len)
+    {
+        close(fd);
+        return;
+    }
+
+    /* The kernel signals a trigger with POLLPRI. */
+    inner->psiFd = fd;
+    inner->psiNotifier = new QSocketNotifier(fd, QSocketNotifier::Exception);
+    QObject::connect(inner->psiNotifier, &QSocketNotifier::activated, _memory_budget_on_pressure);
+}
+#endif
+
+void qfcmd::MemoryBudget::init()
+{
+    if (s_memory_budget != nullptr)
+    {
+        return;
+    }
+
+    s_memory_budget = new MemoryBudgetInner;
+
+    const qint64 mb = Settings::get<qint64>(Settings::MEMORY_BUDGET_MB);
+    s_memory_budget->budget = qMax<qint64>(mb, 16) * 1024 * 1024;
+
+    const qint64 pixmapKb = s_memory_budget->budget / MEMORY_BUDGET_PIXMAP_SHARE / 1024;
+    QPixmapCache::setCacheLimit((int)qMin<qint64>(pixmapKb, INT_MAX));
+
+#if defined(__linux__)
+    _memory_budget_setup_psi(s_memory_budget);
+#endif
+}
+
+void qfcmd::MemoryBudget::exit()
+{
+    if (s_memory_budget == nullptr)
+    {
+        return;
+    }
+
+    delete s_memory_budget;
+    s_memory_budget = nullptr;
+}
+
+void qfcmd::MemoryBudget::add(MemoryConsumer* consumer)
+{
+    s_memory_budget->consumers.append(consumer);
+}
+
+void qfcmd::MemoryBudget::remove(MemoryConsumer* consumer)
+{
+    if (s_memory_budget == nullptr)
+    {
+        return;
+    }
+    s_memory_budget->consumers.removeOne(consumer);
+}
+
+qint64 qfcmd::MemoryBudget::tick()
+{
+    return ++s_memory_budget->lastTick;
+}
+
+qint64 qfcmd::MemoryBudget::budget()
+{
+    return s_memory_budget->budget;
+}
+
+qint64 qfcmd::MemoryBudget::usage()
+{
+    /* Listings shared between consumers are counted once. */
+    QSet<const void*> counted;
+
+    qint64 total = 0;
+    for (const MemoryConsumer* consumer : s_memory_budget->consumers)
+    {
+        total += consumer->memoryUsage(&counted);
+    }
+    return total;
+}
+
+void qfcmd::MemoryBudget::check()
+{
+    if (s_memory_budget->checkPending)
+    {
+        return;
+    }
+    s_memory_budget->checkPending = true;
+
+    QTimer::singleShot(0, []() {
+        if (s_memory_budget == nullptr)
+        {
+            return;
+        }
+        s_memory_budget->checkPending = false;
+        trim(s_memory_budget->budget);
+    });
+}
+
+qint64 qfcmd::MemoryBudget::trim(qint64 target)
+{
+    qint64 total = usage();
+    if (total <= target)
+    {
+        return total;
+    }
+
+    for (MemoryConsumer* consumer : s_memory_budget->consumers)
+    {
+        consumer->memoryTrimBegin();
+    }
+
+    while (total > target)
+    {
+        MemoryConsumer* oldest = nullptr;
+        qint64 oldestUse = -1;
+        for (MemoryConsumer* consumer : s_memory_budget->consumers)
+        {
+            const qint64 use = consumer->memoryOldestUse();
+            if (use >= 0 && (oldest == nullptr || use < oldestUse))
+            {
+                oldest = consumer;
+                oldestUse = use;
+            }
+        }
+
+        /* Everything left is in use. */
+        if (oldest == nullptr)
+        {
+            break;
+        }
+
+        /*
+         * Freed bytes may be shared with other consumers, in which case the
+         * estimate is too optimistic. Recount once the estimate says done.
+         */
+        total -= oldest->memoryEvictOldest();
+        if (total <= target)
+        {
+            total = usage();
+        }
+    }
+
+    for (MemoryConsumer* consumer : s_memory_budget->consumers)
+    {
+        consumer->memoryTrimEnd();
+    }
+
+    return total;
+}
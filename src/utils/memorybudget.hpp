@@ -0,0 +1,128 @@
+#ifndef QFCMD_UTILS_MEMORYBUDGET_HPP
+#define QFCMD_UTILS_MEMORYBUDGET_HPP
+
+#include <QSet>
+#include <QtGlobal>
+
+namespace qfcmd {
+
+/**
+ * @brief Something that holds memory MemoryBudget may ask back.
+ *
+ * Consumers hand out their items in least recently used order, so the budget
+ * can evict the globally oldest item first, whichever consumer has it.
+ */
+class MemoryConsumer
+{
+public:
+    virtual ~MemoryConsumer();
+
+public:
+    /**
+     * @brief Get the memory held.
+     * @param[in,out] counted - Shared allocations already in it count as
+     *   zero, and shared allocations of this consumer are added to it. May
+     *   be nullptr to count everything.
+     * @return Size in bytes.
+     */
+    virtual qint64 memoryUsage(QSet<const void*>* counted) const = 0;
+
+    /**
+     * @brief Get when the least recently used evictable item was last used.
+     * @return Stamp from MemoryBudget::tick(), or -1 if nothing can be evicted.
+     */
+    virtual qint64 memoryOldestUse() const = 0;
+
+    /**
+     * @brief Evict the least recently used evictable item.
+     * @return Bytes freed.
+     */
+    virtual qint64 memoryEvictOldest() = 0;
+
+    /**
+     * @brief MemoryBudget::trim() is about to evict.
+     *
+     * Items can only be evicted between this call and memoryTrimEnd(), so a
+     * consumer may work out its eviction order once here.
+     */
+    virtual void memoryTrimBegin();
+
+    /**
+     * @brief MemoryBudget::trim() is done evicting.
+     */
+    virtual void memoryTrimEnd();
+};
+
+/**
+ * @brief Process wide memory budget.
+ *
+ * The budget is read from settings. When consumers together hold more, the
+ * least recently used items are evicted until they fit. QPixmapCache, which
+ * holds rendered icons, gets a share of the budget as its own limit.
+ *
+ * On Linux the budget also listens to memory pressure stall notifications,
+ * and shrinks usage to half when the system is short of memory.
+ *
+ * All functions must be called from the GUI thread.
+ */
+class MemoryBudget
+{
+public:
+    /**
+     * @brief Initialize the budget.
+     */
+    static void init();
+
+    /**
+     * @brief Exit the budget.
+     */
+    static void exit();
+
+    /**
+     * @brief Register consumer.
+     * @param[in] consumer - Consumer, must be removed before it is destroyed.
+     */
+    static void add(MemoryConsumer* consumer);
+
+    /**
+     * @brief Unregister consumer.
+     * @param[in] consumer - Consumer.
+     */
+    static void remove(MemoryConsumer* consumer);
+
+    /**
+     * @brief Get a new use stamp, greater than every stamp before.
+     */
+    static qint64 tick();
+
+    /**
+     * @brief Get the budget.
+     * @return Size in bytes.
+     */
+    static qint64 budget();
+
+    /**
+     * @brief Get the memory held by all consumers.
+     * @return Size in bytes.
+     */
+    static qint64 usage();
+
+    /**
+     * @brief Enforce the budget once control returns to the event loop.
+     *
+     * Call it after memory held by a consumer grows. Calls before the check
+     * runs are merged.
+     */
+    static void check();
+
+    /**
+     * @brief Evict least recently used items until usage is at most \p target.
+     * @param[in] target - Size in bytes.
+     * @return Usage afterwards.
+     */
+    static qint64 trim(qint64 target);
+};
+
+} /* namespace qfcmd */
+
+#endif
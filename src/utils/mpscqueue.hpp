@@ -0,0 +1,91 @@
+#ifndef QFCMD_UTILS_MPSCQUEUE_HPP
+#define QFCMD_UTILS_MPSCQUEUE_HPP
+
+#include <utility>
+#include <QAtomicPointer>
+
+namespace qfcmd {
+
+/**
+ * @brief Unbounded multi-producer/single-consumer queue.
+ *
+ * Any thread may call push(), exactly one thread may call pop(). Neither side
+ * takes a lock. A producer preempted between its two steps hides the values
+ * pushed after it until it resumes, pop() then reports an empty queue, so the
+ * consumer must be woken up again by that producer, as it would be anyway.
+ *
+ * Values are moved in and out, so move-only types are supported. \p T must be
+ * default constructible.
+ */
+template <typename T>
+class MpscQueue
+{
+    Q_DISABLE_COPY_MOVE(MpscQueue)
+
+public:
+    MpscQueue()
+    {
+        m_head = new Node;
+        m_tail.storeRelaxed(m_head);
+    }
+
+    ~MpscQueue()
+    {
+        while (m_head != nullptr)
+        {
+            Node* next = m_head->next.loadRelaxed();
+            delete m_head;
+            m_head = next;
+        }
+    }
+
+public:
+    /**
+     * @brief Append a value. Any thread.
+     * @param[in] value - The value.
+     */
+    void push(T&& value)
+    {
+        Node* node = new Node;
+        node->value = std::move(value);
+
+        /* Claim the tail slot first, then link the previous tail to it. */
+        Node* prev = m_tail.fetchAndStoreAcquire(node);
+        prev->next.storeRelease(node);
+    }
+
+    /**
+     * @brief Take the oldest value. Consumer side only.
+     * @param[out] value - The value.
+     * @return true if a value is taken, false if queue is empty.
+     */
+    bool pop(T& value)
+    {
+        Node* next = m_head->next.loadAcquire();
+        if (next == nullptr)
+        {
+            return false;
+        }
+
+        /* The old head is a consumed dummy, next becomes the new dummy. */
+        value = std::move(next->value);
+        delete m_head;
+        m_head = next;
+
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        QAtomicPointer<Node>    next;   /**< Newer node. */
+        T                       value;  /**< The value, moved out once consumed. */
+    };
+
+    alignas(64) Node*                   m_head;     /**< Consumer side, always a consumed node. */
+    alignas(64) QAtomicPointer<Node>    m_tail;     /**< Producer side, the newest node. */
+};
+
+} /* namespace qfcmd */
+
+#endif
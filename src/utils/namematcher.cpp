@@ -0,0 +1,128 @@
+#include <QtAlgorithms>
+
+#include "namematcher.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QFCMD_NAME_MATCHER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+static inline char _name_matcher_fold(char c)
+{
+    return c >= 'A' && c <= 'Z' ? (char)(c + ('a' - 'A')) : c;
+}
+
+/**
+ * @brief Compare \p len bytes of \p data with folded \p pattern.
+ */
+static inline bool _name_matcher_equal(const char* data, const char* pattern, qsizetype len)
+{
+    for (qsizetype i = 0; i < len; i++)
+    {
+        if (_name_matcher_fold(data[i]) != pattern[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+qfcmd::NameMatcher::NameMatcher(const QString& pattern)
+{
+    m_pattern = pattern;
+    m_folded = pattern.toUtf8();
+    m_ascii = true;
+
+    for (char& c : m_folded)
+    {
+        if ((uchar)c >= 0x80)
+        {
+            m_ascii = false;
+        }
+        c = _name_matcher_fold(c);
+    }
+}
+
+const QString& qfcmd::NameMatcher::pattern() const
+{
+    return m_pattern;
+}
+
+bool qfcmd::NameMatcher::isEmpty() const
+{
+    return m_pattern.isEmpty();
+}
+
+bool qfcmd::NameMatcher::isAscii() const
+{
+    return m_ascii;
+}
+
+int qfcmd::NameMatcher::size() const
+{
+    return (int)m_folded.size();
+}
+
+bool qfcmd::NameMatcher::matches(const char* name, int len) const
+{
+    if (m_pattern.isEmpty())
+    {
+        return true;
+    }
+    if (m_ascii)
+    {
+        return indexIn(name, len) >= 0;
+    }
+
+    /* Case of other scripts needs Unicode tables. */
+    return QString::fromUtf8(name, len).contains(m_pattern, Qt::CaseInsensitive);
+}
+
+qsizetype qfcmd::NameMatcher::indexIn(const char* data, qsizetype len, qsizetype from) const
+{
+    Q_ASSERT(m_ascii);
+
+    const qsizetype n = m_folded.size();
+    if (n == 0)
+    {
+        return from <= len ? from : -1;
+    }
+
+    const char* pattern = m_folded.constData();
+    const char first = pattern[0];
+    const char firstUpper = first >= 'a' && first <= 'z' ? (char)(first - ('a' - 'A')) : first;
+
+    /* Last offset the pattern may start at. */
+    const qsizetype last = len - n;
+    qsizetype i = from;
+
+#if defined(QFCMD_NAME_MATCHER_SSE2)
+    /* Find the first character in either case, 16 offsets at a time. */
+    const __m128i lower = _mm_set1_epi8(first);
+    const __m128i upper = _mm_set1_epi8(firstUpper);
+    for (; i + 16 <= last + 1; i += 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        quint32 mask = (quint32)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, lower),
+                                                                _mm_cmpeq_epi8(block, upper)));
+        while (mask != 0)
+        {
+            const qsizetype pos = i + qCountTrailingZeroBits(mask);
+            if (_name_matcher_equal(data + pos + 1, pattern + 1, n - 1))
+            {
+                return pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i <= last; i++)
+    {
+        if ((data[i] == first || data[i] == firstUpper) && _name_matcher_equal(data + i + 1, pattern + 1, n - 1))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
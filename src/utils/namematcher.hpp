@@ -0,0 +1,74 @@
+#ifndef QFCMD_UTILS_NAMEMATCHER_HPP
+#define QFCMD_UTILS_NAMEMATCHER_HPP
+
+#include <QByteArray>
+#include <QString>
+
+namespace qfcmd {
+
+/**
+ * @brief Case insensitive substring search in UTF-8 file names.
+ *
+ * The pattern is folded once. A pattern of ASCII characters is searched in
+ * the raw bytes, 16 at a time where SSE2 is available, without decoding
+ * names. Other patterns fall back to QString comparison.
+ */
+class NameMatcher
+{
+public:
+    /**
+     * @brief Create matcher.
+     * @param[in] pattern - Text to look for, empty matches every name.
+     */
+    explicit NameMatcher(const QString& pattern = QString());
+
+public:
+    /**
+     * @brief Get the pattern.
+     */
+    const QString& pattern() const;
+
+    /**
+     * @brief Check if the pattern is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * @brief Check if the pattern only has ASCII characters, see indexIn().
+     */
+    bool isAscii() const;
+
+    /**
+     * @brief Get length of the pattern in UTF-8 bytes.
+     */
+    int size() const;
+
+    /**
+     * @brief Check if \p name contains the pattern.
+     * @param[in] name - UTF-8 name, not required to be NUL terminated.
+     * @param[in] len - Length of \p name in bytes.
+     */
+    bool matches(const char* name, int len) const;
+
+    /**
+     * @brief Find the pattern in \p data.
+     *
+     * Only valid if isAscii(). Suits many names stored back to back, which
+     * are then searched in one pass.
+     *
+     * @param[in] data - UTF-8 bytes.
+     * @param[in] len - Length of \p data in bytes.
+     * @param[in] from - Offset to start at.
+     * @return Offset of the first occurrence, or -1.
+     */
+    qsizetype indexIn(const char* data, qsizetype len, qsizetype from = 0) const;
+
+private:
+    QString     m_pattern;  /**< The pattern. */
+    QByteArray  m_folded;   /**< UTF-8 pattern, ASCII letters in lower case. */
+    bool        m_ascii;    /**< #m_pattern has only ASCII characters. */
+};
+
+} /* namespace qfcmd */
+
+#endif
@@ -0,0 +1,472 @@
+#include <QAtomicInt>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "scheduler.hpp"
+
+/**
+ * @brief Number of priority levels.
+ */
+static const int SCHEDULER_PRIORITY_COUNT = qfcmd::TaskScheduler::PRIORITY_LOW + 1;
+
+namespace qfcmd {
+
+struct TaskSchedulerOwner;
+typedef QSharedPointer<TaskSchedulerOwner> TaskSchedulerOwnerPtr;
+
+/**
+ * @brief A queued task.
+ */
+struct TaskSchedulerTask
+{
+    TaskSchedulerTask();
+
+    TaskSchedulerOwnerPtr       owner;      /**< Owner. */
+    TaskScheduler::TaskFn       fn;         /**< The task. */
+    TaskScheduler::Pool         pool;       /**< Pool to run in. */
+    TaskScheduler::Priority     priority;   /**< Priority. */
+    QString                     strand;     /**< Strand, or empty. */
+};
+
+/**
+ * @brief Bookkeeping of all tasks of one owner.
+ */
+struct TaskSchedulerOwner
+{
+    TaskSchedulerOwner();
+
+    QAtomicInt                  cancelled;  /**< Non-zero once cancel() started. */
+    QAtomicInt                  running;    /**< Tasks taken off a queue and not yet returned. */
+    QMutex                      mutex;      /**< Used to wait for #running. */
+    QWaitCondition              idle;       /**< Signalled when #running drops to zero. */
+};
+
+/**
+ * @brief A queue of tasks, one list per priority.
+ */
+struct TaskSchedulerDeque
+{
+    QMutex                      mutex;
+    QList<TaskSchedulerTask>    tasks[SCHEDULER_PRIORITY_COUNT];
+};
+
+struct TaskSchedulerPool
+{
+    TaskSchedulerPool();
+    ~TaskSchedulerPool();
+
+    bool                            stealing;   /**< Workers have own queues and steal from each other. */
+    TaskSchedulerDeque              global;     /**< Tasks posted from outside the pool. */
+    QVector<TaskSchedulerDeque*>    locals;     /**< Tasks posted from worker N, if #stealing. */
+    QVector<QThread*>               threads;    /**< Workers. */
+
+    QAtomicInt                      pending;    /**< Number of queued tasks. */
+    QMutex                          sleepMutex; /**< Protects sleeping on #wake. */
+    QWaitCondition                  wake;       /**< Signalled when a task is queued. */
+};
+
+struct TaskSchedulerInner
+{
+    TaskSchedulerInner();
+    ~TaskSchedulerInner();
+
+    TaskSchedulerPool                               pools[2];   /**< Indexed by TaskScheduler::Pool. */
+    QAtomicInt                                      quit;       /**< Non-zero when exiting. */
+
+    QMutex                                          ownerMutex; /**< Protects #owners. */
+    QHash<const void*, TaskSchedulerOwnerPtr>       owners;     /**< Owners that have tasks. */
+
+    QMutex                                          strandMutex;    /**< Protects #strands. */
+
+    /**
+     * @brief Busy strands, and the tasks waiting for them.
+     *
+     * A strand is in the table while one of its tasks is queued or running.
+     */
+    QHash<QString, QList<TaskSchedulerTask>>        strands;
+};
+
+} /* namespace qfcmd */
+
+static qfcmd::TaskSchedulerInner* s_scheduler = nullptr;
+
+/**
+ * @brief Pool and queue index of the current thread, if it is a worker.
+ */
+static thread_local qfcmd::TaskSchedulerPool* s_scheduler_current_pool = nullptr;
+static thread_local int s_scheduler_current_index = -1;
+
+qfcmd::TaskSchedulerTask::TaskSchedulerTask()
+{
+    pool = TaskScheduler::POOL_CPU;
+    priority = TaskScheduler::PRIORITY_NORMAL;
+}
+
+qfcmd::TaskSchedulerOwner::TaskSchedulerOwner()
+    : cancelled(0)
+    , running(0)
+{
+}
+
+qfcmd::TaskSchedulerPool::TaskSchedulerPool()
+    : stealing(false)
+    , pending(0)
+{
+}
+
+qfcmd::TaskSchedulerPool::~TaskSchedulerPool()
+{
+    qDeleteAll(locals);
+}
+
+qfcmd::TaskSchedulerInner::TaskSchedulerInner()
+    : quit(0)
+{
+}
+
+qfcmd::TaskSchedulerInner::~TaskSchedulerInner()
+{
+}
+
+/**
+ * @brief Take a task from the front of \p deque.
+ *
+ * The owner's running counter is raised while the queue is still locked, so
+ * cancel() either removes the task or sees it running.
+ */
+static bool _scheduler_take(qfcmd::TaskSchedulerPool* pool, qfcmd::TaskSchedulerDeque* deque,
+                            int priority, bool fromBack, qfcmd::TaskSchedulerTask& task)
+{
+    QMutexLocker locker(&deque->mutex);
+
+    QList<qfcmd::TaskSchedulerTask>& tasks = deque->tasks[priority];
+    if (tasks.isEmpty())
+    {
+        return false;
+    }
+
+    task = fromBack ? tasks.takeLast() : tasks.takeFirst();
+    task.owner->running.ref();
+    pool->pending.deref();
+
+    return true;
+}
+
+static bool _scheduler_pop(qfcmd::TaskSchedulerPool* pool, int index, qfcmd::TaskSchedulerTask& task)
+{
+    for (int priority = 0; priority < SCHEDULER_PRIORITY_COUNT; priority++)
+    {
+        if (index >= 0 && _scheduler_take(pool, pool->locals[index], priority, false, task))
+        {
+            return true;
+        }
+        if (_scheduler_take(pool, &pool->global, priority, false, task))
+        {
+            return true;
+        }
+        if (!pool->stealing)
+        {
+            continue;
+        }
+
+        /* Steal from the back, the victim is working from the front. */
+        for (int i = 1; i < pool->locals.size(); i++)
+        {
+            const int victim = (index + i + pool->locals.size()) % pool->locals.size();
+            if (victim != index && _scheduler_take(pool, pool->locals[victim], priority, true, task))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static void _scheduler_enqueue(qfcmd::TaskSchedulerTask&& task)
+{
+    qfcmd::TaskSchedulerPool* pool = &s_scheduler->pools[task.pool];
+
+    qfcmd::TaskSchedulerDeque* deque = &pool->global;
+    if (pool->stealing && s_scheduler_current_pool == pool)
+    {
+        deque = pool->locals[s_scheduler_current_index];
+    }
+
+    {
+        QMutexLocker locker(&deque->mutex);
+        deque->tasks[task.priority].append(std::move(task));
+        pool->pending.ref();
+    }
+
+    QMutexLocker locker(&pool->sleepMutex);
+    pool->wake.wakeOne();
+}
+
+/**
+ * @brief Queue the next task of a strand that just finished, or free the strand.
+ */
+static void _scheduler_strand_next(const QString& strand)
+{
+    qfcmd::TaskSchedulerTask next;
+    {
+        QMutexLocker locker(&s_scheduler->strandMutex);
+
+        auto it = s_scheduler->strands.find(strand);
+        if (it == s_scheduler->strands.end())
+        {
+            return;
+        }
+
+        QList<qfcmd::TaskSchedulerTask>& waiting = it.value();
+        while (!waiting.isEmpty() && waiting.first().owner->cancelled.loadAcquire() != 0)
+        {
+            waiting.removeFirst();
+        }
+        if (waiting.isEmpty())
+        {
+            s_scheduler->strands.erase(it);
+            return;
+        }
+        next = waiting.takeFirst();
+    }
+
+    _scheduler_enqueue(std::move(next));
+}
+
+static void _scheduler_run(qfcmd::TaskSchedulerTask& task)
+{
+    if (task.owner->cancelled.loadAcquire() == 0)
+    {
+        task.fn();
+    }
+
+    if (!task.strand.isEmpty())
+    {
+        _scheduler_strand_next(task.strand);
+    }
+
+    /* Release captures of the task before the owner is told it is idle. */
+    task.fn = qfcmd::TaskScheduler::TaskFn();
+
+    if (!task.owner->running.deref())
+    {
+        QMutexLocker locker(&task.owner->mutex);
+        task.owner->idle.wakeAll();
+    }
+}
+
+static void _scheduler_worker(qfcmd::TaskSchedulerPool* pool, int index)
+{
+    s_scheduler_current_pool = pool;
+    s_scheduler_current_index = index;
+
+    while (s_scheduler->quit.loadAcquire() == 0)
+    {
+        qfcmd::TaskSchedulerTask task;
+        if (_scheduler_pop(pool, pool->stealing ? index : -1, task))
+        {
+            _scheduler_run(task);
+            continue;
+        }
+
+        QMutexLocker locker(&pool->sleepMutex);
+        if (pool->pending.loadAcquire() == 0 && s_scheduler->quit.loadAcquire() == 0)
+        {
+            pool->wake.wait(&pool->sleepMutex);
+        }
+    }
+}
+
+static void _scheduler_pool_start(qfcmd::TaskSchedulerPool* pool, const char* name, int count, bool stealing)
+{
+    pool->stealing = stealing;
+    for (int i = 0; stealing && i < count; i++)
+    {
+        pool->locals.append(new qfcmd::TaskSchedulerDeque);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        QThread* thread = QThread::create(_scheduler_worker, pool, i);
+        thread->setObjectName(QString("%1-%2").arg(name).arg(i));
+        thread->start();
+        pool->threads.append(thread);
+    }
+}
+
+static void _scheduler_pool_stop(qfcmd::TaskSchedulerPool* pool)
+{
+    {
+        QMutexLocker locker(&pool->sleepMutex);
+        pool->wake.wakeAll();
+    }
+
+    for (QThread* thread : pool->threads)
+    {
+        thread->wait();
+        delete thread;
+    }
+    pool->threads.clear();
+}
+
+/**
+ * @brief Remove queued tasks of \p owner from \p deque.
+ * @param[out] strands - Strands of removed tasks, they must be passed on.
+ */
+static void _scheduler_remove_owner_tasks(qfcmd::TaskSchedulerPool* pool, qfcmd::TaskSchedulerDeque* deque,
+                                          const qfcmd::TaskSchedulerOwner* owner, QStringList& strands)
+{
+    QMutexLocker locker(&deque->mutex);
+    for (QList<qfcmd::TaskSchedulerTask>& tasks : deque->tasks)
+    {
+        for (auto it = tasks.begin(); it != tasks.end();)
+        {
+            if (it->owner.data() != owner)
+            {
+                it++;
+                continue;
+            }
+            if (!it->strand.isEmpty())
+            {
+                strands.append(it->strand);
+            }
+            it = tasks.erase(it);
+            pool->pending.deref();
+        }
+    }
+}
+
+void qfcmd::TaskScheduler::init()
+{
+    if (s_scheduler != nullptr)
+    {
+        return;
+    }
+
+    s_scheduler = new TaskSchedulerInner;
+
+    const int cores = qMax(1, QThread::idealThreadCount());
+    _scheduler_pool_start(&s_scheduler->pools[POOL_CPU], "qfcmd-cpu", cores, true);
+    _scheduler_pool_start(&s_scheduler->pools[POOL_IO], "qfcmd-io", qMax(4, cores), false);
+}
+
+void qfcmd::TaskScheduler::exit()
+{
+    if (s_scheduler == nullptr)
+    {
+        return;
+    }
+
+    s_scheduler->quit.storeRelease(1);
+    for (TaskSchedulerPool& pool : s_scheduler->pools)
+    {
+        _scheduler_pool_stop(&pool);
+    }
+
+    delete s_scheduler;
+    s_scheduler = nullptr;
+}
+
+void qfcmd::TaskScheduler::post(const void* owner, Pool pool, Priority priority, const TaskFn& fn,
+                                const QString& strand)
+{
+    TaskSchedulerTask task;
+    {
+        QMutexLocker locker(&s_scheduler->ownerMutex);
+        TaskSchedulerOwnerPtr& ptr = s_scheduler->owners[owner];
+        if (ptr.isNull())
+        {
+            ptr.reset(new TaskSchedulerOwner);
+        }
+        task.owner = ptr;
+    }
+    if (task.owner->cancelled.loadAcquire() != 0)
+    {
+        return;
+    }
+
+    task.fn = fn;
+    task.pool = pool;
+    task.priority = priority;
+    task.strand = strand;
+
+    if (!strand.isEmpty())
+    {
+        QMutexLocker locker(&s_scheduler->strandMutex);
+
+        /* Strand busy, run after the tasks already in it. */
+        auto it = s_scheduler->strands.find(strand);
+        if (it != s_scheduler->strands.end())
+        {
+            it.value().append(std::move(task));
+            return;
+        }
+        s_scheduler->strands.insert(strand, QList<TaskSchedulerTask>());
+    }
+
+    _scheduler_enqueue(std::move(task));
+}
+
+void qfcmd::TaskScheduler::cancel(const void* owner)
+{
+    TaskSchedulerOwnerPtr ptr;
+    {
+        QMutexLocker locker(&s_scheduler->ownerMutex);
+        ptr = s_scheduler->owners.value(owner);
+    }
+    if (ptr.isNull())
+    {
+        return;
+    }
+
+    /* From now on nothing new is queued or started for this owner. */
+    ptr->cancelled.storeRelease(1);
+
+    QStringList strands;
+    for (TaskSchedulerPool& pool : s_scheduler->pools)
+    {
+        _scheduler_remove_owner_tasks(&pool, &pool.global, ptr.data(), strands);
+        for (TaskSchedulerDeque* deque : pool.locals)
+        {
+            _scheduler_remove_owner_tasks(&pool, deque, ptr.data(), strands);
+        }
+    }
+
+    {
+        QMutexLocker locker(&s_scheduler->strandMutex);
+        for (QList<TaskSchedulerTask>& waiting : s_scheduler->strands)
+        {
+            waiting.removeIf([&ptr](const TaskSchedulerTask& task) {
+                return task.owner == ptr;
+            });
+        }
+    }
+
+    /* Removed tasks held their strands, let other owners' tasks in them go. */
+    for (const QString& strand : strands)
+    {
+        _scheduler_strand_next(strand);
+    }
+
+    {
+        QMutexLocker locker(&ptr->mutex);
+        while (ptr->running.loadAcquire() != 0)
+        {
+            ptr->idle.wait(&ptr->mutex);
+        }
+    }
+
+    /* The owner may post again later, it gets a fresh record. */
+    QMutexLocker locker(&s_scheduler->ownerMutex);
+    if (s_scheduler->owners.value(owner) == ptr)
+    {
+        s_scheduler->owners.remove(owner);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef QFCMD_UTILS_SCHEDULER_HPP
+#define QFCMD_UTILS_SCHEDULER_HPP
+
+#include <functional>
+#include <QString>
+
+namespace qfcmd {
+
+/**
+ * @brief Process wide background task scheduler.
+ *
+ * There are two pools:
+ * + #POOL_CPU is sized to the number of cores. Each worker has its own queue
+ *   that tasks posted from the worker go to, and idle workers steal from the
+ *   others.
+ * + #POOL_IO is for tasks that block on file systems, so that a slow disk or
+ *   network share does not starve the CPU pool.
+ *
+ * Every task belongs to an owner, usually the object that posts it, so all
+ * tasks of an object can be cancelled when it goes away. Tasks sharing a
+ * strand run one at a time, in the order they were posted, no matter which
+ * owner posted them.
+ *
+ * All functions are thread safe.
+ */
+class TaskScheduler
+{
+public:
+    enum Pool
+    {
+        POOL_CPU,       /**< Computation. */
+        POOL_IO,        /**< Blocking I/O. */
+    };
+
+    enum Priority
+    {
+        PRIORITY_HIGH,      /**< The user is waiting for it. */
+        PRIORITY_NORMAL,    /**< Default. */
+        PRIORITY_LOW,       /**< Prefetch and housekeeping. */
+    };
+
+    typedef std::function<void()> TaskFn;
+
+public:
+    /**
+     * @brief Start worker threads.
+     */
+    static void init();
+
+    /**
+     * @brief Stop worker threads. Tasks not yet started are dropped.
+     */
+    static void exit();
+
+    /**
+     * @brief Queue a task.
+     * @param[in] owner - Owner of the task, see cancel().
+     * @param[in] pool - Pool to run the task in.
+     * @param[in] priority - Priority of the task.
+     * @param[in] fn - The task.
+     * @param[in] strand - If not empty, tasks with the same strand never run
+     *   concurrently and run in posting order.
+     */
+    static void post(const void* owner, Pool pool, Priority priority, const TaskFn& fn,
+                     const QString& strand = QString());
+
+    /**
+     * @brief Drop queued tasks of \p owner and wait for running ones to return.
+     *
+     * Tasks \p owner posts while this is in progress are dropped too. Must
+     * not be called from a task of \p owner.
+     *
+     * @param[in] owner - Owner of tasks.
+     */
+    static void cancel(const void* owner);
+};
+
+} /* namespace qfcmd */
+
+#endif
@@ -0,0 +1,71 @@
+#include <cerrno>
+#include <QAtomicInt>
+
+#include "canceltoken.hpp"
+
+namespace qfcmd {
+struct CancelTokenInner
+{
+    CancelTokenInner(const QDeadlineTimer& deadline);
+
+    QAtomicInt      cancelled;  /**< Non-zero if cancelled. */
+    QDeadlineTimer  deadline;   /**< Deadline. Never changed after construct. */
+};
+} /* namespace qfcmd */
+
+qfcmd::CancelTokenInner::CancelTokenInner(const QDeadlineTimer& deadline)
+    : cancelled(0)
+    , deadline(deadline)
+{
+}
+
+qfcmd::CancelToken::CancelToken()
+{
+}
+
+qfcmd::CancelToken qfcmd::CancelToken::create(const QDeadlineTimer& deadline)
+{
+    CancelToken token;
+    token.m_inner.reset(new CancelTokenInner(deadline));
+    return token;
+}
+
+void qfcmd::CancelToken::cancel()
+{
+    if (m_inner.isNull())
+    {
+        return;
+    }
+    m_inner->cancelled.storeRelease(1);
+}
+
+bool qfcmd::CancelToken::isCancelled() const
+{
+    return error() != 0;
+}
+
+int qfcmd::CancelToken::error() const
+{
+    if (m_inner.isNull())
+    {
+        return 0;
+    }
+    if (m_inner->cancelled.loadAcquire() != 0)
+    {
+        return -ECANCELED;
+    }
+    if (m_inner->deadline.hasExpired())
+    {
+        return -ETIMEDOUT;
+    }
+    return 0;
+}
+
+QDeadlineTimer qfcmd::CancelToken::deadline() const
+{
+    if (m_inner.isNull())
+    {
+        return QDeadlineTimer(QDeadlineTimer::Forever);
+    }
+    return m_inner->deadline;
+}
@@ -0,0 +1,65 @@
+#ifndef QFCMD_VFS_CANCELTOKEN_HPP
+#define QFCMD_VFS_CANCELTOKEN_HPP
+
+#include <QDeadlineTimer>
+#include <QSharedPointer>
+
+namespace qfcmd {
+
+struct CancelTokenInner;
+
+/**
+ * @brief Cancellation handle for long running file system operations.
+ *
+ * A token is a cheap shared handle: every copy observes the same state, so the
+ * requester keeps one copy and hands another one to whoever does the work.
+ *
+ * A default constructed token is never cancelled and has no deadline, so it
+ * can be used as argument for callers that do not care about cancellation.
+ */
+class CancelToken
+{
+public:
+    CancelToken();
+
+    /**
+     * @brief Create a new token that can be cancelled.
+     * @param[in] deadline - The token reports cancelled once \p deadline expired.
+     * @return The token.
+     */
+    static CancelToken create(const QDeadlineTimer& deadline = QDeadlineTimer(QDeadlineTimer::Forever));
+
+public:
+    /**
+     * @brief Mark the token as cancelled.
+     *
+     * This function is thread safe. It is a no-op for default constructed token.
+     */
+    void cancel();
+
+    /**
+     * @brief Check whether the result is still wanted.
+     * @return true if the token was cancelled or the deadline expired.
+     */
+    bool isCancelled() const;
+
+    /**
+     * @brief Get the error code describing why the token is cancelled.
+     * @return 0 if not cancelled, -ECANCELED if cancelled, or -ETIMEDOUT if
+     *   the deadline expired.
+     */
+    int error() const;
+
+    /**
+     * @brief Get the deadline of the token.
+     * @return The deadline.
+     */
+    QDeadlineTimer deadline() const;
+
+private:
+    QSharedPointer<CancelTokenInner> m_inner;
+};
+
+} /* namespace qfcmd */
+
+#endif
@@ -1,37 +1,101 @@
+#include <QStringList>
+
 #include "filesystem.hpp"
 
 namespace qfcmd {
 class FileSystemInner
 {
 public:
-    FileSystemInner(FileSystem* parent, qfcmd_filesystem_t* fs);
+    FileSystemInner(FileSystem* parent, qfcmd_filesystem_t* fs, const QString& apiVersion);
     ~FileSystemInner();
 
     FileSystem*             parent;
     qfcmd_filesystem_t*     fs;
+    bool                    hasEx;  /* #fs has ls_ex and read_ex, API 1.1 or later. */
+};
+
+/**
+ * @brief Bridge #qfcmd::CancelToken to #qfcmd_fs_cancel_t.
+ */
+struct FileSystemCancelProxy
+{
+    FileSystemCancelProxy(const CancelToken& token);
+
+    qfcmd_fs_cancel_t       handle; /**< Must be the first member. */
+    const CancelToken*      token;
+};
+
+struct FileSystemLsProxy
+{
+    const FileSystem::FillDirFn*    fn;
+    const CancelToken*              token;
 };
 } /* namespace qfcmd */
 
+static int _fs_proxy_is_cancelled(qfcmd_fs_cancel_t* thiz)
+{
+    qfcmd::FileSystemCancelProxy* proxy = reinterpret_cast<qfcmd::FileSystemCancelProxy*>(thiz);
+    return proxy->token->error();
+}
+
+static int64_t _fs_proxy_remaining(qfcmd_fs_cancel_t* thiz)
+{
+    qfcmd::FileSystemCancelProxy* proxy = reinterpret_cast<qfcmd::FileSystemCancelProxy*>(thiz);
+    return proxy->token->deadline().remainingTime();
+}
+
 /**
  * @brief Proxy callback function for ls command.
  * @param[in] name - The name of the file or directory
  * @param[in] stat - Pointer to the file or directory stat structure
- * @param[in] data - Pointer to user data
- * @return the result of the callback function
+ * @param[in] data - Pointer to #qfcmd::FileSystemLsProxy
+ * @return non-zero to stop listing if the token is cancelled.
  */
 static int _fs_proxy_ls_cb(const char* name, const qfcmd_fs_stat_t* stat, void* data)
 {
-    qfcmd::FileSystem::FileInfoEntry* entry = static_cast<qfcmd::FileSystem::FileInfoEntry*>(data);
+    qfcmd::FileSystemLsProxy* proxy = static_cast<qfcmd::FileSystemLsProxy*>(data);
+    if (proxy->token->isCancelled())
+    {
+        return 1;
+    }
+
+    return (*proxy->fn)(QString::fromUtf8(name), stat);
+}
+
+/**
+ * @brief Check if plugin API \p version is at least \p major.\p minor.
+ * @param[in] version - Version as "major.minor".
+ */
+static bool _fs_api_at_least(const QString& version, int major, int minor)
+{
+    const QStringList parts = version.split('.');
+    if (parts.size() < 2)
+    {
+        return false;
+    }
 
-    entry->insert(QString::fromUtf8(name), *stat);
+    bool ok1 = false, ok2 = false;
+    const int verMajor = parts[0].toInt(&ok1);
+    const int verMinor = parts[1].toInt(&ok2);
+    if (!ok1 || !ok2)
+    {
+        return false;
+    }
+    return verMajor > major || (verMajor == major && verMinor >= minor);
+}
 
-    return 0;
+qfcmd::FileSystemCancelProxy::FileSystemCancelProxy(const CancelToken& token)
+{
+    this->token = &token;
+    handle.is_cancelled = _fs_proxy_is_cancelled;
+    handle.remaining = _fs_proxy_remaining;
 }
 
-qfcmd::FileSystemInner::FileSystemInner(FileSystem *parent, qfcmd_filesystem_t* fs)
+qfcmd::FileSystemInner::FileSystemInner(FileSystem *parent, qfcmd_filesystem_t* fs, const QString& apiVersion)
 {
     this->parent = parent;
     this->fs = fs;
+    hasEx = fs != nullptr && _fs_api_at_least(apiVersion, 1, 1);
 }
 
 qfcmd::FileSystemInner::~FileSystemInner()
@@ -44,13 +108,13 @@ qfcmd::FileSystemInner::~FileSystemInner()
 }
 
 qfcmd::FileSystem::FileSystem(QObject *parent)
-    : FileSystem(nullptr, parent)
+    : FileSystem(nullptr, QString(), parent)
 {
 }
 
-qfcmd::FileSystem::FileSystem(qfcmd_filesystem_t *fs, QObject *parent)
+qfcmd::FileSystem::FileSystem(qfcmd_filesystem_t *fs, const QString& apiVersion, QObject *parent)
     : QObject(parent)
-    , m_inner(new FileSystemInner(this, fs))
+    , m_inner(new FileSystemInner(this, fs, apiVersion))
 {
 }
 
@@ -59,17 +123,48 @@ qfcmd::FileSystem::~FileSystem()
     delete m_inner;
 }
 
-int qfcmd::FileSystem::ls(const QUrl& url, FileInfoEntry* entry)
+int qfcmd::FileSystem::ls(const QUrl& url, FileInfoEntry* entry, const CancelToken& token)
+{
+    return ls(url, [entry](const QString& name, const qfcmd_fs_stat_t* stat) {
+        entry->insert(name, *stat);
+        return 0;
+    }, token);
+}
+
+int qfcmd::FileSystem::ls(const QUrl& url, const FillDirFn& fn, const CancelToken& token, int flags)
 {
+    /* Plugins always report full stat, which satisfies every flag. */
+    (void)flags;
+
     qfcmd_filesystem_t* fs = m_inner->fs;
-    if (fs == nullptr || fs->ls == nullptr)
+    if (fs == nullptr)
+    {
+        return -ENOSYS;
+    }
+    const bool useEx = m_inner->hasEx && fs->ls_ex != nullptr;
+    if (!useEx && fs->ls == nullptr)
     {
         return -ENOSYS;
     }
 
     QByteArray c_path = url.toString().toUtf8();
-    void* data = static_cast<void*>(entry);
-    return fs->ls(fs, c_path.data(), _fs_proxy_ls_cb, data);
+    FileSystemLsProxy ls_proxy = { &fn, &token };
+    void* data = static_cast<void*>(&ls_proxy);
+
+    int ret;
+    if (useEx)
+    {
+        FileSystemCancelProxy cancel_proxy(token);
+        ret = fs->ls_ex(fs, c_path.data(), _fs_proxy_ls_cb, data, &cancel_proxy.handle);
+    }
+    else
+    {
+        ret = fs->ls(fs, c_path.data(), _fs_proxy_ls_cb, data);
+    }
+
+    /* The provider may not tell the listing is incomplete. */
+    int err = token.error();
+    return err != 0 ? err : ret;
 }
 
 int qfcmd::FileSystem::stat(const QUrl& url, qfcmd_fs_stat_t* stat)
@@ -107,14 +202,31 @@ int qfcmd::FileSystem::close(uintptr_t fh)
     return fs->close(fs, fh);
 }
 
-int qfcmd::FileSystem::read(uintptr_t fh, void* buf, size_t size)
+int qfcmd::FileSystem::read(uintptr_t fh, void* buf, size_t size, const CancelToken& token)
 {
     qfcmd_filesystem_t* fs = m_inner->fs;
-    if (fs == nullptr || fs->read == nullptr)
+    if (fs == nullptr)
+    {
+        return -ENOSYS;
+    }
+    const bool useEx = m_inner->hasEx && fs->read_ex != nullptr;
+    if (!useEx && fs->read == nullptr)
     {
         return -ENOSYS;
     }
 
+    int err = token.error();
+    if (err != 0)
+    {
+        return err;
+    }
+
+    if (useEx)
+    {
+        FileSystemCancelProxy cancel_proxy(token);
+        return fs->read_ex(fs, fh, buf, size, &cancel_proxy.handle);
+    }
+
     return fs->read(fs, fh, buf, size);
 }
 
@@ -9,6 +9,7 @@
 #include <QMap>
 
 #include "qfcmd/filesystem.h"
+#include "canceltoken.hpp"
 
 namespace qfcmd {
 
@@ -38,21 +39,61 @@ public:
      */
     typedef std::function<int(const QUrl& url, FsPtr& fs)> MountFn;
 
-    typedef std::function<int(const QString&, const qfcmd_fs_stat_t*)> FillDirFn;
+    /**
+     * @brief Receive one item of a directory listing.
+     * @param[in] name - Item name.
+     * @param[in] stat - Item status.
+     * @return 0 to continue, non-zero to stop listing.
+     */
+    typedef std::function<int(const QString& name, const qfcmd_fs_stat_t* stat)> FillDirFn;
+
+    /**
+     * @brief Flags for ls().
+     */
+    enum LsFlag
+    {
+        /**
+         * Only st_mode is wanted. File systems that can tell the type
+         * without a stat() of every item may leave size and mtime zero.
+         */
+        LS_TYPE_ONLY = 0x01,
+    };
 
 public:
     FileSystem(QObject *parent = nullptr);
-    FileSystem(qfcmd_filesystem_t* fs, QObject *parent = nullptr);
+
+    /**
+     * @brief Wrap a file system provided by a plugin.
+     * @param[in] fs - The file system, owned by this object.
+     * @param[in] apiVersion - #QFCMD_API_VERSION the plugin declared in
+     *   setup(). Members added in later versions are past the end of the
+     *   structure of older plugins and are never read.
+     * @param[in] parent - Parent object.
+     */
+    FileSystem(qfcmd_filesystem_t* fs, const QString& apiVersion, QObject *parent = nullptr);
     virtual ~FileSystem();
 
 public:
     /**
      * @brief List items in directory.
      * @param[in] url - URL of directory.
-     * @param[in] cb - Callback function.
-     * @return  0 on success, or -errno on error.
+     * @param[out] entry - Items in directory.
+     * @param[in] token - Stop listing once cancelled.
+     * @return  0 on success, or -errno on error. If \p token is cancelled,
+     *   the error from CancelToken::error() is returned.
+     */
+    int ls(const QUrl& url, FileInfoEntry* entry, const CancelToken& token = CancelToken());
+
+    /**
+     * @brief List items in directory, passing each item to \p fn as it is read.
+     * @param[in] url - URL of directory.
+     * @param[in] fn - Called for every item, in the order the file system returns them.
+     * @param[in] token - Stop listing once cancelled.
+     * @param[in] flags - Bitwise or of #LsFlag.
+     * @return  0 on success, or -errno on error. If \p token is cancelled,
+     *   the error from CancelToken::error() is returned.
      */
-    virtual int ls(const QUrl& url, FileInfoEntry* entry);
+    virtual int ls(const QUrl& url, const FillDirFn& fn, const CancelToken& token = CancelToken(), int flags = 0);
 
     /**
      * @brief Get file status.
@@ -83,9 +124,10 @@ public:
      * @param[in] fh - File handle.
      * @param[in] buf - Buffer to store data.
      * @param[in] size - Size of data.
+     * @param[in] token - Stop reading once cancelled.
      * @return Number of bytes read on success, or -errno on error.
      */
-    virtual int read(uintptr_t fh, void* buf, size_t size);
+    virtual int read(uintptr_t fh, void* buf, size_t size, const CancelToken& token = CancelToken());
 
     /**
      * @brief Write data to file.
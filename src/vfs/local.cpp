@@ -1,14 +1,18 @@
 #include "local.hpp"
 #include <QDir>
+#include <QDirIterator>
 #include <QFileInfo>
 
 /**
- * @brief Converts a local file information to a qfcmd::IFileSystem::FileStat structure.
- * @param[in] info - The QFileInfo object containing the local file information.
- * @return A qfcmd::IFileSystem::FileStat structure representing the local file information.
- * @throws None
+ * @brief Get file type only.
+ *
+ * Directory iterators already know the type of most entries, so unlike
+ * size and mtime this does not cost a stat() per file.
+ *
+ * @param[in] info - The file information.
+ * @return Stat with only st_mode filled.
  */
-static qfcmd_fs_stat_t _local_file_info_to_stat(const QFileInfo& info)
+static qfcmd_fs_stat_t _local_file_info_to_type(const QFileInfo& info)
 {
     qfcmd_fs_stat_t stat;
     memset(&stat, 0, sizeof(stat));
@@ -22,6 +26,19 @@ static qfcmd_fs_stat_t _local_file_info_to_stat(const QFileInfo& info)
         stat.st_mode |= QFCMD_FS_S_IFREG;
     }
 
+    return stat;
+}
+
+/**
+ * @brief Converts a local file information to a qfcmd::IFileSystem::FileStat structure.
+ * @param[in] info - The QFileInfo object containing the local file information.
+ * @return A qfcmd::IFileSystem::FileStat structure representing the local file information.
+ * @throws None
+ */
+static qfcmd_fs_stat_t _local_file_info_to_stat(const QFileInfo& info)
+{
+    qfcmd_fs_stat_t stat = _local_file_info_to_type(info);
+
     stat.st_size = info.size();
     stat.st_mtime = info.lastModified().toSecsSinceEpoch();
 
@@ -85,23 +102,37 @@ int qfcmd::LocalFS::mount(const QUrl& url, FsPtr& fs)
     return 0;
 }
 
-int qfcmd::LocalFS::ls(const QUrl& url, FileInfoEntry* entry)
+int qfcmd::LocalFS::ls(const QUrl& url, const FillDirFn& fn, const CancelToken& token, int flags)
 {
     const QString file_path = url.toLocalFile();
-    QFileInfoList info_list = QDir(file_path).entryInfoList();
 
-    for (QFileInfo& info : info_list)
+    /*
+     * Iterate instead of QDir::entryInfoList(), so a listing that is no longer
+     * wanted stops without reading the rest of the directory.
+     *
+     * Hidden and system files are listed as well, name filter rules of the
+     * panel decide whether they are shown.
+     */
+    QDirIterator it(file_path, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+    while (it.hasNext())
     {
-        const QString fileName = info.fileName();
-        if (fileName == "." || fileName == "..")
+        int ret = token.error();
+        if (ret != 0)
         {
-            continue;
+            return ret;
         }
 
-        entry->insert(fileName, _local_file_info_to_stat(info));
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        const qfcmd_fs_stat_t stat = (flags & LS_TYPE_ONLY) ? _local_file_info_to_type(info)
+                                                            : _local_file_info_to_stat(info);
+        if (fn(info.fileName(), &stat) != 0)
+        {
+            break;
+        }
     }
 
-    return 0;
+    return token.error();
 }
 
 int qfcmd::LocalFS::stat(const QUrl& url, qfcmd_fs_stat_t* stat)
@@ -137,10 +168,38 @@ int qfcmd::LocalFS::close(uintptr_t fh)
     return 0;
 }
 
-int qfcmd::LocalFS::read(uintptr_t fh, void* buf, size_t size)
+int qfcmd::LocalFS::read(uintptr_t fh, void* buf, size_t size, const CancelToken& token)
 {
+    /* Read in chunks so large reads can be cancelled in between. */
+    const size_t chunkSize = 65536;
+
     QFile* file = reinterpret_cast<QFile*>(fh);
-    return file->read((char*)buf, (qint64)size);
+    char* data = static_cast<char*>(buf);
+
+    size_t total = 0;
+    while (total < size)
+    {
+        int ret = token.error();
+        if (ret != 0)
+        {
+            return ret;
+        }
+
+        const size_t want = qMin(chunkSize, size - total);
+        const qint64 got = file->read(data + total, (qint64)want);
+        if (got < 0)
+        {
+            return total != 0 ? (int)total : -EIO;
+        }
+
+        total += (size_t)got;
+        if ((size_t)got < want)
+        {
+            break;
+        }
+    }
+
+    return (int)total;
 }
 
 int qfcmd::LocalFS::write(uintptr_t fh, const void* buf, size_t size)
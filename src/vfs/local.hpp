@@ -26,11 +26,12 @@ public:
     static int mount(const QUrl& url, FsPtr& fs);
 
 public:
-    virtual int ls(const QUrl& url, FileInfoEntry* info) override;
+    using FileSystem::ls;
+    virtual int ls(const QUrl& url, const FillDirFn& fn, const CancelToken& token = CancelToken(), int flags = 0) override;
     virtual int stat(const QUrl& path, qfcmd_fs_stat_t* stat) override;
     virtual int open(uintptr_t* fh, const QUrl& path, uint64_t flags) override;
     virtual int close(uintptr_t fh) override;
-    virtual int read(uintptr_t fh, void* buf, size_t size) override;
+    virtual int read(uintptr_t fh, void* buf, size_t size, const CancelToken& token = CancelToken()) override;
     virtual int write(uintptr_t fh, const void* buf, size_t size) override;
 };
 
@@ -251,11 +251,11 @@ qfcmd::VFS::~VFS()
 {
 }
 
-int qfcmd::VFS::ls(const QUrl &url, FileInfoEntry *entry)
+int qfcmd::VFS::ls(const QUrl &url, const FillDirFn &fn, const CancelToken& token, int flags)
 {
     QUrl relative_path;
     FileSystem::FsPtr fs = _vfs_op(url, relative_path);
-    return fs->ls(relative_path, entry);
+    return fs->ls(relative_path, fn, token, flags);
 }
 
 int qfcmd::VFS::stat(const QUrl &url, qfcmd_fs_stat_t *stat)
@@ -298,7 +298,7 @@ int qfcmd::VFS::close(uintptr_t fh)
     return handle.fs->close(handle.real);
 }
 
-int qfcmd::VFS::read(uintptr_t fh, void *buf, size_t size)
+int qfcmd::VFS::read(uintptr_t fh, void *buf, size_t size, const CancelToken& token)
 {
     auto it = s_vfs->fhMap.find(fh);
     if (it == s_vfs->fhMap.end())
@@ -307,7 +307,7 @@ int qfcmd::VFS::read(uintptr_t fh, void *buf, size_t size)
     }
 
     qfcmd::VfsFileHandle handle = it.value();
-    return handle.fs->read(handle.real, buf, size);
+    return handle.fs->read(handle.real, buf, size, token);
 }
 
 int qfcmd::VFS::write(uintptr_t fh, const void *buf, size_t size)
@@ -63,11 +63,12 @@ public:
     virtual ~VFS();
 
 public:
-    virtual int ls(const QUrl &url, FileInfoEntry *entry) override;
+    using FileSystem::ls;
+    virtual int ls(const QUrl &url, const FillDirFn &fn, const CancelToken& token = CancelToken(), int flags = 0) override;
     virtual int stat(const QUrl &url, qfcmd_fs_stat_t *stat) override;
     virtual int open(uintptr_t *fh, const QUrl &url, uint64_t flags) override;
     virtual int close(uintptr_t fh) override;
-    virtual int read(uintptr_t fh, void *buf, size_t size) override;
+    virtual int read(uintptr_t fh, void *buf, size_t size, const CancelToken& token = CancelToken()) override;
     virtual int write(uintptr_t fh, const void *buf, size_t size) override;
 };
 
@@ -5,8 +5,15 @@
 #include <QApplication>
 #include <QHBoxLayout>
 #include <QHeaderView>
+#include <QKeyEvent>
+#include <QLineEdit>
 #include <QPlainTextEdit>
 #include <QPushButton>
+#include <QScrollBar>
+#include <QShowEvent>
+#include <QSlider>
+#include <QStackedWidget>
+#include <QTimer>
 #include <QTreeView>
 #include <QVBoxLayout>
 #include <QWidget>
@@ -23,7 +30,10 @@
 #endif
 
 #include "fsfoldertab.hpp"
+#include "fsgridview.hpp"
+#include "model/dircache.hpp"
 #include "model/filesystem.hpp"
+#include "settings.hpp"
 
 #if 0
 #define QFCMD_FS_MODEL  QFileSystemModel
@@ -32,6 +42,19 @@
 #endif
 
 namespace qfcmd {
+/**
+ * @brief What a hibernated tab keeps of its model and view.
+ */
+struct FolderTabSnapshot
+{
+    int                 scrollX;                /* Horizontal scroll position. */
+    int                 scrollY;                /* Vertical scroll position. */
+    QString             current;                /* Path of current item, or empty. */
+    QStringList         selected;               /* Paths of selected items. */
+    QByteArray          header;                 /* Header state, including sort indicator. */
+    DirCacheRef         listing;                /* Keeps the listing cached for a fast restore. */
+};
+
 struct FolderTabInner
 {
     FolderTabInner(FolderTab* parent);
@@ -45,9 +68,17 @@ struct FolderTabInner
     QPushButton*        goForward;
     QPushButton*        goUp;
     QPlainTextEdit*     url;
+    QPushButton*        gridMode;               /* Toggles between details and thumbnails. */
+    QSlider*            iconSize;               /* Icon size of the grid, shown in grid mode. */
+    QLineEdit*          filter;                 /* Quick filter, shown while it has text. */
+    QStackedWidget*     views;                  /* Shows one of #treeView and #gridView. */
     QTreeView*          treeView;
+    FsGridView*         gridView;
 
-    QFCMD_FS_MODEL*     model;                  /* File system model. */
+    QFCMD_FS_MODEL*     model;                  /* File system model, nullptr while hibernated. */
+    NameFilter          nameFilter;             /* Rules of the panel, given to every new model. */
+    QTimer*             hibernateTimer;         /* Hibernates the tab once hidden for a while. */
+    FolderTabSnapshot*  snapshot;               /* State to restore, set from hibernation until restored. */
     qsizetype           cfg_path_max_history;   /* Max number of path history.*/
     qsizetype           path_idx;               /* Current path. */
     QStringList         path_history;           /* Path history. */
@@ -101,20 +132,61 @@ qfcmd::FolderTabInner::FolderTabInner(FolderTab *parent)
 
     horizontalLayout->addWidget(url);
 
+    iconSize = new QSlider(Qt::Horizontal, parent);
+    iconSize->setMaximumWidth(96);
+    iconSize->setRange(FsGridView::MIN_ICON_SIZE, FsGridView::maxIconSize());
+    iconSize->setSingleStep(FsGridView::ICON_SIZE_STEP);
+    iconSize->setPageStep(FsGridView::ICON_SIZE_STEP);
+    iconSize->setVisible(false);
+
+    horizontalLayout->addWidget(iconSize);
+
+    gridMode = new QPushButton(parent);
+    sizePolicy.setHeightForWidth(gridMode->sizePolicy().hasHeightForWidth());
+    gridMode->setSizePolicy(sizePolicy);
+    gridMode->setMaximumSize(QSize(32, 32));
+    gridMode->setFlat(true);
+    gridMode->setCheckable(true);
+
+    horizontalLayout->addWidget(gridMode);
+
     verticalLayout->addLayout(horizontalLayout);
 
-    treeView = new QTreeView(parent);
+    filter = new QLineEdit(parent);
+    filter->setClearButtonEnabled(true);
+    filter->setVisible(false);
+
+    verticalLayout->addWidget(filter);
+
+    views = new QStackedWidget(parent);
+
+    treeView = new QTreeView(views);
     treeView->setContextMenuPolicy(Qt::CustomContextMenu);
     treeView->setSelectionBehavior(QAbstractItemView::SelectRows);
     treeView->setWordWrap(false);
+    treeView->header()->setSortIndicator(0, Qt::AscendingOrder);
+    treeView->setSortingEnabled(true);
+
+    views->addWidget(treeView);
+
+    gridView = new FsGridView(views);
+    gridView->setContextMenuPolicy(Qt::CustomContextMenu);
 
-    verticalLayout->addWidget(treeView);
+    views->addWidget(gridView);
+
+    verticalLayout->addWidget(views);
+
+    model = nullptr;
+    hibernateTimer = nullptr;
+    snapshot = nullptr;
 
     QMetaObject::connectSlotsByName(parent);
 }
 
 qfcmd::FolderTabInner::~FolderTabInner()
 {
+    delete snapshot;
+    delete model;
 }
 
 #if defined(_WIN32)
@@ -160,14 +232,53 @@ static void _update_ui_visibility(qfcmd::FolderTabInner* inner)
     inner->goUp->setEnabled(dir.cdUp());
 }
 
+/**
+ * @brief Get the view on screen.
+ * @return #FolderTabInner::treeView or #FolderTabInner::gridView.
+ */
+static QAbstractItemView* _folder_tab_view(qfcmd::FolderTabInner* inner)
+{
+    return static_cast<QAbstractItemView*>(inner->views->currentWidget());
+}
+
+static void _folder_tab_create_model(qfcmd::FolderTabInner* inner)
+{
+    inner->model = new QFCMD_FS_MODEL;
+    inner->treeView->setModel(inner->model);
+    inner->gridView->setModel(inner->model);
+    inner->model->setNameFilter(inner->nameFilter);
+    inner->model->setThumbnailSize(inner->gridView->cellIconSize());
+
+    /* The view only sorts when the indicator changes. */
+    const QHeaderView* header = inner->treeView->header();
+    inner->model->sort(header->sortIndicatorSection(), header->sortIndicatorOrder());
+
+    /* One selection, so switching views keeps it. */
+    QItemSelectionModel* selection = inner->gridView->selectionModel();
+    inner->gridView->setSelectionModel(inner->treeView->selectionModel());
+    delete selection;
+
+    QObject::connect(inner->model, &QFCMD_FS_MODEL::directoryLoaded,
+                     inner->parent, &qfcmd::FolderTab::slotRestoreSnapshot);
+}
+
 /**
  * @brief Set current folder.
  * @param[in] path - path to folder.
  */
 static void _folder_tab_cd(qfcmd::FolderTabInner* inner, const QString& path)
 {
+    /* The model drops the filter with the old directory. */
+    {
+        const QSignalBlocker blocker(inner->filter);
+        inner->filter->clear();
+        inner->filter->setVisible(false);
+    }
+
     inner->url->setPlainText(path);
-    inner->treeView->setRootIndex(inner->model->setRootPath(path));
+    const QModelIndex root = inner->model->setRootPath(path);
+    inner->treeView->setRootIndex(root);
+    inner->gridView->setRootIndex(root);
 
     QDir dir(path);
     inner->parent->setWindowTitle(dir.dirName());
@@ -215,11 +326,20 @@ qfcmd::FolderTab::FolderTab(const QString& path, QWidget *parent)
         m_inner->goBack->setIcon(style.standardIcon(QStyle::SP_ArrowBack));
         m_inner->goForward->setIcon(style.standardIcon(QStyle::SP_ArrowForward));
         m_inner->goUp->setIcon(style.standardIcon(QStyle::SP_ArrowUp));
+        m_inner->gridMode->setIcon(style.standardIcon(QStyle::SP_FileDialogContentsView));
+        m_inner->gridMode->setToolTip(tr("Thumbnails"));
+        m_inner->filter->setPlaceholderText(tr("Filter"));
     }
 
+    m_inner->gridView->slotSetCellIconSize(qfcmd::Settings::get<int>(qfcmd::Settings::VIEW_GRID_ICON_SIZE));
+    m_inner->iconSize->setValue(m_inner->gridView->cellIconSize());
+
     {
-        m_inner->model = new QFCMD_FS_MODEL;
-        m_inner->treeView->setModel(m_inner->model);
+        _folder_tab_create_model(m_inner);
+
+        m_inner->hibernateTimer = new QTimer(this);
+        m_inner->hibernateTimer->setSingleShot(true);
+        connect(m_inner->hibernateTimer, &QTimer::timeout, this, &FolderTab::slotHibernate);
 
         m_inner->cfg_path_max_history = 1024;
         _folder_tab_cd_with_history(m_inner, path);
@@ -230,6 +350,16 @@ qfcmd::FolderTab::FolderTab(const QString& path, QWidget *parent)
     connect(m_inner->goUp, &QPushButton::clicked, this, &FolderTab::onGoUpClicked);
     connect(m_inner->treeView, &QTableView::doubleClicked, this, &FolderTab::slotOpenItem);
     connect(m_inner->treeView, &QTableView::customContextMenuRequested, this, &FolderTab::slotTableViewContextMenuRequested);
+    connect(m_inner->gridView, &QListView::doubleClicked, this, &FolderTab::slotOpenItem);
+    connect(m_inner->gridView, &QListView::customContextMenuRequested, this, &FolderTab::slotTableViewContextMenuRequested);
+    connect(m_inner->gridMode, &QPushButton::toggled, this, &FolderTab::slotSetGridMode);
+    connect(m_inner->iconSize, &QSlider::valueChanged, m_inner->gridView, &FsGridView::slotSetCellIconSize);
+    connect(m_inner->gridView, &FsGridView::signalCellIconSizeChanged, this, &FolderTab::slotGridIconSizeChanged);
+    connect(m_inner->filter, &QLineEdit::textChanged, this, &FolderTab::slotQuickFilterChanged);
+
+    m_inner->treeView->installEventFilter(this);
+    m_inner->gridView->installEventFilter(this);
+    m_inner->filter->installEventFilter(this);
 }
 
 qfcmd::FolderTab::~FolderTab()
@@ -242,6 +372,126 @@ QString qfcmd::FolderTab::path() const
     return m_inner->path_history[m_inner->path_idx];
 }
 
+qint64 qfcmd::FolderTab::memoryUsage() const
+{
+    return m_inner->model != nullptr ? m_inner->model->memoryUsage() : 0;
+}
+
+void qfcmd::FolderTab::setNameFilter(const NameFilter& filter)
+{
+    m_inner->nameFilter = filter;
+    if (m_inner->model != nullptr)
+    {
+        m_inner->model->setNameFilter(filter);
+    }
+}
+
+void qfcmd::FolderTab::showEvent(QShowEvent* event)
+{
+    QWidget::showEvent(event);
+    if (event->spontaneous())
+    {
+        return;
+    }
+
+    m_inner->hibernateTimer->stop();
+    if (m_inner->model != nullptr)
+    {
+        return;
+    }
+
+    /* The listing is still cached, so rows arrive before the next paint. */
+    _folder_tab_create_model(m_inner);
+    m_inner->treeView->header()->restoreState(m_inner->snapshot->header);
+    _folder_tab_cd(m_inner, path());
+}
+
+void qfcmd::FolderTab::hideEvent(QHideEvent* event)
+{
+    QWidget::hideEvent(event);
+
+    /* Minimizing the window does not put the tab in background. */
+    const int sec = qfcmd::Settings::get<int>(qfcmd::Settings::TABS_HIBERNATE_SEC);
+    if (event->spontaneous() || sec <= 0)
+    {
+        return;
+    }
+    m_inner->hibernateTimer->start(sec * 1000);
+}
+
+void qfcmd::FolderTab::slotHibernate()
+{
+    if (m_inner->model == nullptr || isVisible())
+    {
+        return;
+    }
+
+    QAbstractItemView* view = _folder_tab_view(m_inner);
+    FolderTabSnapshot* snapshot = new FolderTabSnapshot;
+    snapshot->scrollX = view->horizontalScrollBar()->value();
+    snapshot->scrollY = view->verticalScrollBar()->value();
+    snapshot->header = m_inner->treeView->header()->saveState();
+    snapshot->listing.reset(QUrl::fromLocalFile(path()));
+
+    const QModelIndex current = m_inner->treeView->currentIndex();
+    if (current.isValid())
+    {
+        snapshot->current = m_inner->model->filePath(current);
+    }
+    for (const QModelIndex& index : m_inner->treeView->selectionModel()->selectedRows())
+    {
+        snapshot->selected.append(m_inner->model->filePath(index));
+    }
+
+    delete m_inner->snapshot;
+    m_inner->snapshot = snapshot;
+
+    /* The views do not delete selection models they replace. */
+    QItemSelectionModel* selection = m_inner->treeView->selectionModel();
+    m_inner->treeView->setModel(nullptr);
+    m_inner->gridView->setModel(nullptr);
+    delete selection;
+
+    delete m_inner->model;
+    m_inner->model = nullptr;
+}
+
+void qfcmd::FolderTab::slotRestoreSnapshot(const QString& path)
+{
+    FolderTabSnapshot* snapshot = m_inner->snapshot;
+    if (snapshot == nullptr || QDir::cleanPath(path) != QDir::cleanPath(this->path()))
+    {
+        return;
+    }
+    m_inner->snapshot = nullptr;
+
+    QItemSelectionModel* selection = m_inner->treeView->selectionModel();
+    for (const QString& item : snapshot->selected)
+    {
+        const QModelIndex index = m_inner->model->index(item);
+        if (index.isValid())
+        {
+            selection->select(index, QItemSelectionModel::Select | QItemSelectionModel::Rows);
+        }
+    }
+    if (!snapshot->current.isEmpty())
+    {
+        const QModelIndex index = m_inner->model->index(snapshot->current);
+        if (index.isValid())
+        {
+            selection->setCurrentIndex(index, QItemSelectionModel::NoUpdate);
+        }
+    }
+
+    /* Scroll ranges are only updated by a layout, which is otherwise delayed. */
+    QAbstractItemView* view = _folder_tab_view(m_inner);
+    view->doItemsLayout();
+    view->horizontalScrollBar()->setValue(snapshot->scrollX);
+    view->verticalScrollBar()->setValue(snapshot->scrollY);
+
+    delete snapshot;
+}
+
 void qfcmd::FolderTab::slotGoBack()
 {
     if (m_inner->path_idx > 0)
@@ -293,7 +543,8 @@ void qfcmd::FolderTab::slotOpenItem()
 
 void qfcmd::FolderTab::slotTableViewContextMenuRequested(QPoint pos)
 {
-    const QModelIndex idx = m_inner->treeView->indexAt(pos);
+    QAbstractItemView* view = _folder_tab_view(m_inner);
+    const QModelIndex idx = view->indexAt(pos);
     QMenu* menu = new QMenu(this);
     menu->addAction(tr("Open"), this, &FolderTab::slotOpenItem);
     if (m_inner->model->isDir(idx))
@@ -306,7 +557,7 @@ void qfcmd::FolderTab::slotTableViewContextMenuRequested(QPoint pos)
     }
 
     menu->addAction(tr("Properties"), this, &FolderTab::slotShowProperties);
-    menu->exec(m_inner->treeView->viewport()->mapToGlobal(pos));
+    menu->exec(view->viewport()->mapToGlobal(pos));
 }
 
 void qfcmd::FolderTab::slotShowProperties()
@@ -335,3 +586,80 @@ void qfcmd::FolderTab::slotOpenInNewTab()
     QString path = m_inner->model->filePath(index);
     emit signalOpenInNewTab(path);
 }
+
+void qfcmd::FolderTab::slotSetGridMode(bool enable)
+{
+    QAbstractItemView* view = enable ? static_cast<QAbstractItemView*>(m_inner->gridView) : m_inner->treeView;
+    m_inner->views->setCurrentWidget(view);
+    m_inner->iconSize->setVisible(enable);
+
+    /* The selection is shared, only the scroll position has to follow. */
+    const QModelIndex current = view->currentIndex();
+    if (current.isValid())
+    {
+        view->scrollTo(current);
+    }
+}
+
+void qfcmd::FolderTab::slotGridIconSizeChanged(int size)
+{
+    m_inner->iconSize->setValue(size);
+    qfcmd::Settings::set(qfcmd::Settings::VIEW_GRID_ICON_SIZE, size);
+
+    if (m_inner->model != nullptr)
+    {
+        m_inner->model->setThumbnailSize(size);
+    }
+}
+
+void qfcmd::FolderTab::slotQuickFilterChanged(const QString& text)
+{
+    if (m_inner->model != nullptr)
+    {
+        m_inner->model->setQuickFilter(text);
+    }
+}
+
+bool qfcmd::FolderTab::eventFilter(QObject* watched, QEvent* event)
+{
+    if (event->type() != QEvent::KeyPress)
+    {
+        return QWidget::eventFilter(watched, event);
+    }
+    QKeyEvent* keyEvent = static_cast<QKeyEvent*>(event);
+
+    if (watched == m_inner->filter)
+    {
+        switch (keyEvent->key())
+        {
+        case Qt::Key_Escape:
+            m_inner->filter->clear();
+            m_inner->filter->setVisible(false);
+            _folder_tab_view(m_inner)->setFocus();
+            return true;
+
+        case Qt::Key_Return:
+        case Qt::Key_Enter:
+        case Qt::Key_Down:
+            _folder_tab_view(m_inner)->setFocus();
+            return true;
+
+        default:
+            break;
+        }
+        return QWidget::eventFilter(watched, event);
+    }
+
+    /* Printable text starts filtering, shortcuts and navigation keep going to the view. */
+    const Qt::KeyboardModifiers modifiers = Qt::ControlModifier | Qt::AltModifier | Qt::MetaModifier;
+    const QString text = keyEvent->text();
+    if ((keyEvent->modifiers() & modifiers) || text.isEmpty() || !text.at(0).isPrint() || text.at(0).isSpace())
+    {
+        return QWidget::eventFilter(watched, event);
+    }
+
+    m_inner->filter->setVisible(true);
+    m_inner->filter->setFocus();
+    m_inner->filter->insert(text);
+    return true;
+}
@@ -6,6 +6,7 @@
 namespace qfcmd {
 
 struct FolderTabInner;
+class NameFilter;
 
 class FolderTab : public QWidget
 {
@@ -23,6 +24,18 @@ public:
      */
     QString path() const;
 
+    /**
+     * @brief Get memory held by the tab.
+     * @return Size in bytes, listings shared with other tabs included.
+     */
+    qint64 memoryUsage() const;
+
+    /**
+     * @brief Hide entries that \p filter rejects, also after hibernation.
+     * @param[in] filter - Compiled rules of the panel.
+     */
+    void setNameFilter(const NameFilter& filter);
+
 public slots:
     /**
      * @brief Go back to previous directory.
@@ -34,6 +47,12 @@ public slots:
      */
     void slotGoForward();
 
+    /**
+     * @brief Show thumbnails in a grid, or details in a list.
+     * @param[in] enable - true for the grid.
+     */
+    void slotSetGridMode(bool enable);
+
 signals:
     /**
      * @brief Open focus file in new tab.
@@ -60,6 +79,46 @@ private slots:
     void slotTableViewContextMenuRequested(QPoint pos);
     void slotShowProperties();
 
+    /**
+     * @brief Drop model and view state, keeping a snapshot to restore them.
+     */
+    void slotHibernate();
+
+    /**
+     * @brief Apply the snapshot once the directory is listed.
+     * @param[in] path - Directory that was listed.
+     */
+    void slotRestoreSnapshot(const QString& path);
+
+    /**
+     * @brief Follow and save the icon size of the grid.
+     * @param[in] size - Icon edge in pixels.
+     */
+    void slotGridIconSizeChanged(int size);
+
+    /**
+     * @brief Show only rows whose name contains \p text.
+     * @param[in] text - Filter text, empty to show every row.
+     */
+    void slotQuickFilterChanged(const QString& text);
+
+protected:
+    /**
+     * @see https://doc.qt.io/qt-6/qwidget.html#showEvent
+     */
+    virtual void showEvent(QShowEvent* event) override;
+
+    /**
+     * @see https://doc.qt.io/qt-6/qwidget.html#hideEvent
+     */
+    virtual void hideEvent(QHideEvent* event) override;
+
+    /**
+     * @brief Start the quick filter by typing in a view, and leave it with Esc.
+     * @see https://doc.qt.io/qt-6/qobject.html#eventFilter
+     */
+    virtual bool eventFilter(QObject* watched, QEvent* event) override;
+
 private:
     FolderTabInner*     m_inner;     /* Internal. */
 };
@@ -0,0 +1,171 @@
+#include <QEvent>
+#include <QStyledItemDelegate>
+#include <QWheelEvent>
+
+#include "fsgridview.hpp"
+#include "model/thumbnail.hpp"
+
+/**
+ * @brief Room around an icon for the focus frame and the name below it.
+ */
+static const int FS_GRID_VIEW_CELL_MARGIN = 8;
+
+namespace qfcmd {
+
+/**
+ * @brief Paints the icon above the name and gives every cell the same size.
+ *
+ * The size does not depend on the item, so the view never has to ask the
+ * model for data of rows that are not painted.
+ */
+class FsGridViewDelegate : public QStyledItemDelegate
+{
+public:
+    explicit FsGridViewDelegate(QObject* parent);
+
+public:
+    virtual QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+
+protected:
+    virtual void initStyleOption(QStyleOptionViewItem* option, const QModelIndex& index) const override;
+
+public:
+    QSize   cellSize;   /* Size of every cell. */
+    QSize   iconSize;   /* Box icons are fitted in. */
+};
+
+struct FsGridViewInner
+{
+    FsGridViewInner(FsGridView* parent);
+
+    FsGridView*         parent;
+    FsGridViewDelegate* delegate;   /* Cell painter. */
+    int                 wheelDelta; /* Ctrl+wheel rotation not turned into a step yet. */
+};
+
+} /* namespace qfcmd */
+
+qfcmd::FsGridViewDelegate::FsGridViewDelegate(QObject* parent)
+    : QStyledItemDelegate(parent)
+{
+}
+
+QSize qfcmd::FsGridViewDelegate::sizeHint(const QStyleOptionViewItem&, const QModelIndex&) const
+{
+    return cellSize;
+}
+
+void qfcmd::FsGridViewDelegate::initStyleOption(QStyleOptionViewItem* option, const QModelIndex& index) const
+{
+    QStyledItemDelegate::initStyleOption(option, index);
+
+    /* A fixed box keeps names aligned whatever the aspect of thumbnails. */
+    option->decorationPosition = QStyleOptionViewItem::Top;
+    option->decorationAlignment = Qt::AlignCenter;
+    option->decorationSize = iconSize;
+    option->displayAlignment = Qt::AlignHCenter | Qt::AlignVCenter;
+    option->features &= ~QStyleOptionViewItem::WrapText;
+}
+
+qfcmd::FsGridViewInner::FsGridViewInner(FsGridView* parent)
+{
+    this->parent = parent;
+    delegate = new FsGridViewDelegate(parent);
+    wheelDelta = 0;
+}
+
+/**
+ * @brief Apply \p size to the delegate and the view.
+ * @param[in] size - Icon edge in pixels, already clamped.
+ */
+static void _fs_grid_view_apply_size(qfcmd::FsGridViewInner* inner, int size)
+{
+    const int textHeight = inner->parent->fontMetrics().lineSpacing();
+    inner->delegate->iconSize = QSize(size, size);
+    inner->delegate->cellSize = QSize(size + FS_GRID_VIEW_CELL_MARGIN * 3,
+                                      size + textHeight + FS_GRID_VIEW_CELL_MARGIN * 2);
+
+    /* Changing the grid lays out again, which also drops the cached item size. */
+    inner->parent->setIconSize(inner->delegate->iconSize);
+    inner->parent->setGridSize(inner->delegate->cellSize);
+}
+
+qfcmd::FsGridView::FsGridView(QWidget* parent)
+    : QListView(parent)
+    , m_inner(new qfcmd::FsGridViewInner(this))
+{
+    /*
+     * List mode lays out rows in flow order from the uniform size alone, icon
+     * mode would place each item in a spatial tree.
+     */
+    setViewMode(QListView::ListMode);
+    setFlow(QListView::LeftToRight);
+    setWrapping(true);
+    setResizeMode(QListView::Adjust);
+    setMovement(QListView::Static);
+    setUniformItemSizes(true);
+    setSelectionRectVisible(true);
+    setSelectionBehavior(QAbstractItemView::SelectRows);
+    setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    setTextElideMode(Qt::ElideMiddle);
+    setWordWrap(false);
+    setItemDelegate(m_inner->delegate);
+
+    _fs_grid_view_apply_size(m_inner, MIN_ICON_SIZE);
+}
+
+qfcmd::FsGridView::~FsGridView()
+{
+    delete m_inner;
+}
+
+int qfcmd::FsGridView::maxIconSize()
+{
+    return ThumbnailLoader::SIZE;
+}
+
+int qfcmd::FsGridView::cellIconSize() const
+{
+    return m_inner->delegate->iconSize.width();
+}
+
+void qfcmd::FsGridView::slotSetCellIconSize(int size)
+{
+    size = qBound(MIN_ICON_SIZE, size, maxIconSize());
+    if (size == cellIconSize())
+    {
+        return;
+    }
+
+    _fs_grid_view_apply_size(m_inner, size);
+    emit signalCellIconSizeChanged(size);
+}
+
+void qfcmd::FsGridView::wheelEvent(QWheelEvent* event)
+{
+    if (!(event->modifiers() & Qt::ControlModifier))
+    {
+        m_inner->wheelDelta = 0;
+        QListView::wheelEvent(event);
+        return;
+    }
+
+    /* Touchpads send a fraction of a notch at a time. */
+    m_inner->wheelDelta += event->angleDelta().y();
+    const int steps = m_inner->wheelDelta / QWheelEvent::DefaultDeltasPerStep;
+    m_inner->wheelDelta -= steps * QWheelEvent::DefaultDeltasPerStep;
+    if (steps != 0)
+    {
+        slotSetCellIconSize(cellIconSize() + steps * ICON_SIZE_STEP);
+    }
+    event->accept();
+}
+
+void qfcmd::FsGridView::changeEvent(QEvent* event)
+{
+    QListView::changeEvent(event);
+    if (event->type() == QEvent::FontChange)
+    {
+        _fs_grid_view_apply_size(m_inner, cellIconSize());
+    }
+}
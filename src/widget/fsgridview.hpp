@@ -0,0 +1,74 @@
+#ifndef QFCMD_FS_GRIDVIEW_HPP
+#define QFCMD_FS_GRIDVIEW_HPP
+
+#include <QListView>
+
+namespace qfcmd {
+
+struct FsGridViewInner;
+
+/**
+ * @brief Thumbnail grid over the first column of a model.
+ *
+ * All cells have the same size, so laying out a directory is arithmetic on
+ * row numbers and only cells on screen are ever asked for their data. The
+ * model decodes thumbnails for what is painted and updates cells as they
+ * arrive.
+ */
+class FsGridView : public QListView
+{
+    Q_OBJECT
+
+public:
+    static const int MIN_ICON_SIZE = 32;    /**< Smallest icon edge in pixels. */
+    static const int ICON_SIZE_STEP = 16;   /**< Icon edge change of one wheel step. */
+
+public:
+    explicit FsGridView(QWidget* parent = nullptr);
+    virtual ~FsGridView();
+
+public:
+    /**
+     * @brief Get largest icon edge, the size thumbnails are decoded at.
+     * @return Size in pixels.
+     */
+    static int maxIconSize();
+
+    /**
+     * @brief Get icon edge.
+     * @return Size in pixels.
+     */
+    int cellIconSize() const;
+
+public slots:
+    /**
+     * @brief Resize cells to fit icons of \p size.
+     * @param[in] size - Icon edge in pixels, clamped to the supported range.
+     */
+    void slotSetCellIconSize(int size);
+
+signals:
+    /**
+     * @brief Icon edge changed, from code or by Ctrl+wheel.
+     * @param[in] size - Icon edge in pixels.
+     */
+    void signalCellIconSizeChanged(int size);
+
+protected:
+    /**
+     * @see https://doc.qt.io/qt-6/qabstractscrollarea.html#wheelEvent
+     */
+    virtual void wheelEvent(QWheelEvent* event) override;
+
+    /**
+     * @see https://doc.qt.io/qt-6/qwidget.html#changeEvent
+     */
+    virtual void changeEvent(QEvent* event) override;
+
+private:
+    FsGridViewInner*    m_inner;    /* Internal. */
+};
+
+} /* namespace qfcmd */
+
+#endif // QFCMD_FS_GRIDVIEW_HPP
@@ -1,4 +1,8 @@
 #include <QDir>
+#include <QHash>
+#include <QHelpEvent>
+#include <QInputDialog>
+#include <QLocale>
 #include <QMenu>
 #include <QTabBar>
 #include <QAction>
@@ -6,6 +10,7 @@
 
 #include "fstabwidget.hpp"
 #include "fsfoldertab.hpp"
+#include "model/namefilter.hpp"
 #include "settings.hpp"
 
 namespace qfcmd {
@@ -16,18 +21,49 @@ struct FsTabWidgetInner
 
     FsTabWidget*                                    parent;
     std::function<void(const QStringList&, int)>    cb;
+    QHash<QWidget*, QString>                        placeholders;   /**< Path of tabs not built yet. */
+    bool                                            building;       /**< A placeholder is being replaced. */
+    NameFilter                                      filter;         /**< Rules of every tab, compiled once. */
 };
 } /* namespace qfcmd */
 
 qfcmd::FsTabWidgetInner::FsTabWidgetInner(FsTabWidget *parent)
 {
     this->parent = parent;
+    building = false;
 }
 
 qfcmd::FsTabWidgetInner::~FsTabWidgetInner()
 {
 }
 
+/**
+ * @brief Get path of tab page \p page, built or not.
+ * @return Path, or empty string if \p page is not a tab.
+ */
+static QString _fs_tab_widget_path(qfcmd::FsTabWidgetInner* inner, QWidget* page)
+{
+    qfcmd::FolderTab* tab = qobject_cast<qfcmd::FolderTab*>(page);
+    if (tab != nullptr)
+    {
+        return tab->path();
+    }
+    return inner->placeholders.value(page);
+}
+
+/**
+ * @brief Add a tab for \p path that is only built once it is activated.
+ *
+ * A restored session may have many tabs, of which only the active one is
+ * seen. The placeholder holds no model and reads nothing.
+ */
+static void _fs_tab_widget_add_placeholder(qfcmd::FsTabWidgetInner* inner, const QString& path)
+{
+    QWidget* placeholder = new QWidget;
+    inner->placeholders.insert(placeholder, path);
+    inner->parent->addTab(placeholder, QDir(path).dirName());
+}
+
 qfcmd::FsTabWidget::FsTabWidget(QWidget* parent,
                                 const QStringList& paths,
                                 int activate_idx,
@@ -40,17 +76,20 @@ qfcmd::FsTabWidget::FsTabWidget(QWidget* parent,
 
     connect(this, &QTabWidget::tabCloseRequested, this, &FsTabWidget::slotTabCloseRequest);
     connect(this, &QWidget::customContextMenuRequested, this, &FsTabWidget::slotContextMenuRequest);
+    tabBar()->installEventFilter(this);
 
     for(QString path : paths)
     {
-        slotOpenNewTab(path);
+        _fs_tab_widget_add_placeholder(m_inner, path);
     }
     if (paths.size() == 0)
     {
-        slotOpenNewTab(QDir::homePath());
+        _fs_tab_widget_add_placeholder(m_inner, QDir::homePath());
     }
 
+    connect(this, &QTabWidget::currentChanged, this, &FsTabWidget::slotCurrentChanged);
     setCurrentIndex(activate_idx);
+    slotCurrentChanged(currentIndex());
 }
 
 qfcmd::FsTabWidget::~FsTabWidget()
@@ -59,13 +98,13 @@ qfcmd::FsTabWidget::~FsTabWidget()
 
     for (int i = 0; i < count(); i++)
     {
-        qfcmd::FolderTab* tab = qobject_cast<qfcmd::FolderTab*>(widget(i));
-        if (tab == nullptr)
+        const QString path = _fs_tab_widget_path(m_inner, widget(i));
+        if (path.isEmpty())
         {
             continue;
         }
 
-        tabs << tab->path();
+        tabs << path;
     }
 
     m_inner->cb(tabs, currentIndex());
@@ -98,6 +137,31 @@ void qfcmd::FsTabWidget::goForward()
     tab->slotGoForward();
 }
 
+void qfcmd::FsTabWidget::setFilterRules(const QStringList& rules)
+{
+    if (rules == m_inner->filter.rules())
+    {
+        return;
+    }
+    m_inner->filter = NameFilter(rules);
+
+    for (int i = 0; i < count(); i++)
+    {
+        qfcmd::FolderTab* tab = qobject_cast<qfcmd::FolderTab*>(widget(i));
+        if (tab != nullptr)
+        {
+            tab->setNameFilter(m_inner->filter);
+        }
+    }
+
+    emit signalFilterRulesChanged(rules);
+}
+
+QStringList qfcmd::FsTabWidget::filterRules() const
+{
+    return m_inner->filter.rules();
+}
+
 void qfcmd::FsTabWidget::mousePressEvent(QMouseEvent *event)
 {
     int tab_idx = tabBar()->tabAt(event->pos());
@@ -116,6 +180,30 @@ void qfcmd::FsTabWidget::mousePressEvent(QMouseEvent *event)
     slotTabCloseRequest(tab_idx);
 }
 
+bool qfcmd::FsTabWidget::eventFilter(QObject* watched, QEvent* event)
+{
+    if (watched != tabBar() || event->type() != QEvent::ToolTip)
+    {
+        return QTabWidget::eventFilter(watched, event);
+    }
+
+    /* Usage changes all the time, so it is looked up when asked for. */
+    QHelpEvent* help = static_cast<QHelpEvent*>(event);
+    const int idx = tabBar()->tabAt(help->pos());
+    qfcmd::FolderTab* tab = qobject_cast<qfcmd::FolderTab*>(widget(idx));
+    if (tab != nullptr)
+    {
+        const QString size = QLocale().formattedDataSize(tab->memoryUsage());
+        setTabToolTip(idx, tr("%1\nMemory: %2").arg(tab->path(), size));
+    }
+    else if (idx >= 0)
+    {
+        setTabToolTip(idx, _fs_tab_widget_path(m_inner, widget(idx)));
+    }
+
+    return QTabWidget::eventFilter(watched, event);
+}
+
 void qfcmd::FsTabWidget::slotUpdateTabTitle(const QString& title)
 {
     QWidget* widget = qobject_cast<QWidget*>(sender());
@@ -139,7 +227,13 @@ void qfcmd::FsTabWidget::slotTabCloseRequest(int index)
     {
         return;
     }
+
+    QWidget* page = widget(index);
     removeTab(index);
+    if (m_inner->placeholders.remove(page) != 0)
+    {
+        delete page;
+    }
 
     /*
      * Re-focus on this widget, so user can press Ctrl+W again to close other tabs.
@@ -147,16 +241,46 @@ void qfcmd::FsTabWidget::slotTabCloseRequest(int index)
     setFocus();
 }
 
-void qfcmd::FsTabWidget::slotOpenNewTab(const QString& path)
+qfcmd::FolderTab* qfcmd::FsTabWidget::createFolderTab(const QString& path)
 {
     qfcmd::FolderTab* tab = new qfcmd::FolderTab(path);
-
-    int idx = QTabWidget::addTab(tab, tab->windowTitle());
     connect(tab, &QWidget::windowTitleChanged, this, &FsTabWidget::slotUpdateTabTitle);
     connect(tab, &qfcmd::FolderTab::signalOpenInNewTab, this, &FsTabWidget::slotOpenNewTab);
+    tab->setNameFilter(m_inner->filter);
+    return tab;
+}
+
+void qfcmd::FsTabWidget::slotOpenNewTab(const QString& path)
+{
+    qfcmd::FolderTab* tab = createFolderTab(path);
+
+    int idx = QTabWidget::addTab(tab, tab->windowTitle());
     setCurrentIndex(idx);
 }
 
+void qfcmd::FsTabWidget::slotCurrentChanged(int index)
+{
+    QWidget* placeholder = widget(index);
+    auto it = m_inner->placeholders.find(placeholder);
+    if (m_inner->building || it == m_inner->placeholders.end())
+    {
+        return;
+    }
+
+    const QString path = it.value();
+    m_inner->placeholders.erase(it);
+
+    /* Swapping pages moves the current index around, which must not build other tabs. */
+    m_inner->building = true;
+    qfcmd::FolderTab* tab = createFolderTab(path);
+    removeTab(index);
+    insertTab(index, tab, tab->windowTitle());
+    setCurrentIndex(index);
+    m_inner->building = false;
+
+    delete placeholder;
+}
+
 void qfcmd::FsTabWidget::slotContextMenuRequest(const QPoint &pos)
 {
     int idx = tabBar()->tabAt(pos);
@@ -164,14 +288,14 @@ void qfcmd::FsTabWidget::slotContextMenuRequest(const QPoint &pos)
     {
         return;
     }
-    qfcmd::FolderTab* tab = qobject_cast<qfcmd::FolderTab*>(widget(idx));
+    const QString path = _fs_tab_widget_path(m_inner, widget(idx));
 
     QMenu* menu = new QMenu(this);
-    if (tab != nullptr)
+    if (!path.isEmpty())
     {
         QAction* act = menu->addAction(tr("Duplicate tab"), this, &FsTabWidget::slotDuplicateSelectedTab);
         act->setShortcut(qfcmd::Settings::get<QKeySequence>(qfcmd::Settings::SHORTCUT_DUPLICATE_TAB));
-        act->setData(tab->path());
+        act->setData(path);
     }
 
     if (count() > 1)
@@ -181,6 +305,14 @@ void qfcmd::FsTabWidget::slotContextMenuRequest(const QPoint &pos)
         act->setData(idx);
     }
 
+    menu->addSeparator();
+    {
+        QAction* act = menu->addAction(tr("Show hidden files"), this, &FsTabWidget::slotShowHiddenFiles);
+        act->setCheckable(true);
+        act->setChecked(!filterRules().contains(NameFilter::hiddenFilesRule()));
+    }
+    menu->addAction(tr("Filter rules..."), this, &FsTabWidget::slotEditFilterRules);
+
     menu->exec(tabBar()->mapToGlobal(pos));
 }
 
@@ -197,3 +329,38 @@ void qfcmd::FsTabWidget::slotTabCloseAction()
     int idx = act->data().toInt();
     slotTabCloseRequest(idx);
 }
+
+void qfcmd::FsTabWidget::slotShowHiddenFiles(bool show)
+{
+    QStringList rules = filterRules();
+    rules.removeAll(NameFilter::hiddenFilesRule());
+    if (!show)
+    {
+        rules.prepend(NameFilter::hiddenFilesRule());
+    }
+    setFilterRules(rules);
+}
+
+void qfcmd::FsTabWidget::slotEditFilterRules()
+{
+    bool ok = false;
+    const QString text = QInputDialog::getMultiLineText(this, tr("Filter rules"),
+        tr("One rule per line. '-' hides matching names, '+' only shows matching files.\n"
+           "Wildcards such as *.o, or regular expressions between slashes."),
+        filterRules().join('\n'), &ok);
+    if (!ok)
+    {
+        return;
+    }
+
+    QStringList rules;
+    for (const QString& line : text.split('\n'))
+    {
+        const QString rule = line.trimmed();
+        if (!rule.isEmpty())
+        {
+            rules.append(rule);
+        }
+    }
+    setFilterRules(rules);
+}
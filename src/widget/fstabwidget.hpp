@@ -7,6 +7,7 @@
 namespace qfcmd {
 
 struct FsTabWidgetInner;
+class FolderTab;
 
 class FsTabWidget : public QTabWidget
 {
@@ -40,12 +41,36 @@ public:
      */
     void goForward();
 
+    /**
+     * @brief Set include and exclude rules of every tab in the panel.
+     * @param[in] rules - Rules, see NameFilter.
+     */
+    void setFilterRules(const QStringList& rules);
+
+    /**
+     * @brief Get include and exclude rules of the panel.
+     */
+    QStringList filterRules() const;
+
+signals:
+    /**
+     * @brief Rules changed, from code or from the tab menu.
+     * @param[in] rules - The new rules.
+     */
+    void signalFilterRulesChanged(const QStringList& rules);
+
 protected:
     /**
      * @see https://doc.qt.io/qt-6/qwidget.html#mousePressEvent
      */
     virtual void mousePressEvent(QMouseEvent* event) override;
 
+    /**
+     * @brief Fill in tab tooltips with path and memory usage when shown.
+     * @see https://doc.qt.io/qt-6/qobject.html#eventFilter
+     */
+    virtual bool eventFilter(QObject* watched, QEvent* event) override;
+
 public slots:
     /**
      * @brief Add new tab with given path.
@@ -83,6 +108,30 @@ private slots:
      */
     void slotDuplicateSelectedTab();
 
+    /**
+     * @brief Triggered when user toggles hidden files from menu.
+     * @param[in] show - true to show names starting with a dot.
+     */
+    void slotShowHiddenFiles(bool show);
+
+    /**
+     * @brief Triggered when user chooses to edit filter rules from menu.
+     */
+    void slotEditFilterRules();
+
+    /**
+     * @brief Build the tab at \p index if it is still a placeholder.
+     * @param[in] index - The activated tab.
+     */
+    void slotCurrentChanged(int index);
+
+private:
+    /**
+     * @brief Create a folder tab wired to this widget.
+     * @param[in] path - Path to folder.
+     */
+    FolderTab* createFolderTab(const QString& path);
+
 private:
     FsTabWidgetInner* m_inner;
 };
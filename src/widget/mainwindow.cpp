@@ -112,6 +112,10 @@ qfcmd::MainWindowInner::MainWindowInner(MainWindow* parent)
                                          qfcmd::Settings::set(qfcmd::Settings::TABS_PANEL_0_ACTIVATE, idx);
                                      });
     panel_0->setMovable(true);
+    panel_0->setFilterRules(qfcmd::Settings::get<QStringList>(qfcmd::Settings::FILTER_PANEL_0));
+    QObject::connect(panel_0, &qfcmd::FsTabWidget::signalFilterRulesChanged, [](const QStringList& rules) {
+        qfcmd::Settings::set(qfcmd::Settings::FILTER_PANEL_0, rules);
+    });
     pannel->addWidget(panel_0);
     panel_1 = new qfcmd::FsTabWidget(pannel,
                                      qfcmd::Settings::get<QStringList>(qfcmd::Settings::TABS_PANEL_1),
@@ -121,6 +125,10 @@ qfcmd::MainWindowInner::MainWindowInner(MainWindow* parent)
                                          qfcmd::Settings::set(qfcmd::Settings::TABS_PANEL_1_ACTIVATE, idx);
                                      });
     panel_1->setMovable(true);
+    panel_1->setFilterRules(qfcmd::Settings::get<QStringList>(qfcmd::Settings::FILTER_PANEL_1));
+    QObject::connect(panel_1, &qfcmd::FsTabWidget::signalFilterRulesChanged, [](const QStringList& rules) {
+        qfcmd::Settings::set(qfcmd::Settings::FILTER_PANEL_1, rules);
+    });
     pannel->addWidget(panel_1);
 	centralwidget->addWidget(pannel);
 	parent->setCentralWidget(centralwidget);